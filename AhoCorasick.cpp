@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "AhoCorasick.h"
+
+#include <deque>
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& patterns)
+{
+    std::vector<std::string> folded;
+    folded.reserve(patterns.size());
+    lengths_.reserve(patterns.size());
+    for (const auto& pattern : patterns)
+    {
+        folded.push_back(pattern);
+        Fold(folded.back());
+        lengths_.push_back(static_cast<uint32_t>(folded.back().size()));
+    }
+
+    // One class per distinct byte the patterns use; upper-case ASCII joins its lower case.
+    for (const auto& pattern : folded)
+    {
+        for (const unsigned char byte : pattern)
+        {
+            if (classOf_[byte] == 0) classOf_[byte] = static_cast<uint8_t>(classCount_++);
+        }
+    }
+    for (unsigned char c = 'A'; c <= 'Z'; ++c)
+    {
+        classOf_[c] = classOf_[c - 'A' + 'a'];
+    }
+
+    // The trie. A zero transition means "no child" until the links are filled in below;
+    // no trie edge can lead back to the root, so zero is free to mean that.
+    auto addState = [this]() {
+        next_.resize(next_.size() + classCount_, 0);
+        report_.push_back(0);
+        nextReport_.push_back(0);
+        output_.push_back(0);
+        return static_cast<uint32_t>(report_.size() - 1);
+    };
+    std::vector<bool> hasOutput;
+    addState();
+    hasOutput.push_back(false);
+    for (uint32_t index = 0; index < folded.size(); ++index)
+    {
+        if (folded[index].empty()) continue;
+        uint32_t state = 0;
+        for (const unsigned char byte : folded[index])
+        {
+            const size_t slot = state * classCount_ + classOf_[byte];
+            if (next_[slot] == 0) {
+                const uint32_t child = addState();
+                hasOutput.push_back(false);
+                next_[slot] = child;
+            }
+            state = next_[slot];
+        }
+        if (!hasOutput[state]) {
+            hasOutput[state] = true;
+            output_[state] = index;
+        }
+    }
+
+    // Breadth first, so a state's failure link and its row are complete before its
+    // children need them. Missing transitions take the failure link's, which turns
+    // the trie into a DFA.
+    std::vector<uint32_t> failure(report_.size(), 0);
+    std::deque<uint32_t> queue;
+    for (uint32_t c = 0; c < classCount_; ++c)
+    {
+        if (const uint32_t child = next_[c]) {
+            report_[child] = hasOutput[child] ? child : 0;
+            queue.push_back(child);
+        }
+    }
+    while (!queue.empty())
+    {
+        const uint32_t state = queue.front();
+        queue.pop_front();
+        for (uint32_t c = 0; c < classCount_; ++c)
+        {
+            const size_t slot = state * classCount_ + c;
+            const uint32_t fallback = next_[failure[state] * classCount_ + c];
+            const uint32_t child = next_[slot];
+            if (child == 0) {
+                next_[slot] = fallback;
+                continue;
+            }
+            failure[child] = fallback;
+            // Outputs along the suffix chain, nearest first, skipping states without one.
+            nextReport_[child] = report_[fallback];
+            report_[child] = hasOutput[child] ? child : report_[fallback];
+            queue.push_back(child);
+        }
+    }
+}
+
+size_t AhoCorasick::MemoryBytes() const
+{
+    return (next_.capacity() + report_.capacity() + nextReport_.capacity() + output_.capacity() + lengths_.capacity())
+        * sizeof(uint32_t) + sizeof(classOf_);
+}
+
+uint32_t AhoCorasick::FoldCodepoint(uint32_t codepoint)
+{
+    if (codepoint < 0xC0) {
+        return codepoint >= 'A' && codepoint <= 'Z' ? codepoint + 0x20 : codepoint;
+    }
+    if (codepoint <= 0xDE) return codepoint == 0xD7 ? codepoint : codepoint + 0x20; // Latin-1, not the multiplication sign
+    if (codepoint >= 0x100 && codepoint <= 0x17F)
+    {
+        // Latin Extended-A pairs upper and lower case, with the pairing shifted by one twice.
+        if (codepoint == 0x178) return 0xFF;
+        if (codepoint <= 0x137 || (codepoint >= 0x14A && codepoint <= 0x177)) return codepoint | 1;
+        if ((codepoint >= 0x139 && codepoint <= 0x148) || (codepoint >= 0x179 && codepoint <= 0x17E)) {
+            return codepoint & 1 ? codepoint + 1 : codepoint;
+        }
+        return codepoint;
+    }
+    if (codepoint >= 0x386 && codepoint <= 0x3A9)
+    {
+        if (codepoint >= 0x391) return codepoint == 0x3A2 ? codepoint : codepoint + 0x20;
+        if (codepoint == 0x386) return 0x3AC;
+        if (codepoint >= 0x388 && codepoint <= 0x38A) return codepoint + 0x25;
+        if (codepoint == 0x38C) return 0x3CC;
+        if (codepoint == 0x38E || codepoint == 0x38F) return codepoint + 0x3F;
+        return codepoint;
+    }
+    if (codepoint == 0x3C2) return 0x3C3; // Final sigma
+    if (codepoint >= 0x400 && codepoint <= 0x40F) return codepoint + 0x50;
+    if (codepoint >= 0x410 && codepoint <= 0x42F) return codepoint + 0x20;
+    return codepoint;
+}
+
+bool AhoCorasick::FoldPair(unsigned char& lead, unsigned char& trail)
+{
+    if ((lead & 0xE0) != 0xC0 || (trail & 0xC0) != 0x80) return false;
+
+    const uint32_t folded = FoldCodepoint(((lead & 0x1Fu) << 6) | (trail & 0x3Fu));
+    lead = static_cast<unsigned char>(0xC0 | (folded >> 6));
+    trail = static_cast<unsigned char>(0x80 | (folded & 0x3F));
+    return true;
+}
+
+void AhoCorasick::Fold(std::string& text)
+{
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        auto lead = static_cast<unsigned char>(text[i]);
+        if (lead < 0x80) {
+            text[i] = static_cast<char>(FoldCodepoint(lead));
+            continue;
+        }
+        if (i + 1 < text.size())
+        {
+            auto trail = static_cast<unsigned char>(text[i + 1]);
+            if (FoldPair(lead, trail)) {
+                text[i] = static_cast<char>(lead);
+                text[i + 1] = static_cast<char>(trail);
+                ++i;
+            }
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Case-insensitive multi-pattern matcher over UTF-8 text.
+ *
+ * An Aho-Corasick automaton compiled into a dense transition table: scanning costs one
+ * table lookup per byte however many patterns there are, plus the matches it reports.
+ * Bytes are mapped to classes first (every byte that appears in no pattern shares one
+ * class, and ASCII letters share the class of their lower case), which keeps the table
+ * small. Case is folded with Fold; the scan folds text on the fly without copying it.
+ *
+ * Immutable once built, so any number of threads may scan with it.
+ */
+class AhoCorasick
+{
+public:
+    struct Match
+    {
+        size_t begin = 0; // Byte offsets in the scanned text; end is exclusive
+        size_t end = 0;
+        uint32_t pattern = 0; // Index in the list the matcher was built from
+    };
+
+    // Empty patterns never match; of duplicate patterns (after folding) only the first reports.
+    explicit AhoCorasick(const std::vector<std::string>& patterns);
+
+    // Calls onMatch(const Match&) for every occurrence of every pattern, in order of end offset.
+    template <typename OnMatch>
+    void Scan(std::string_view text, OnMatch&& onMatch) const;
+
+    size_t StateCount() const { return report_.size(); }
+    size_t ClassCount() const { return classCount_; }
+    size_t MemoryBytes() const;
+
+    // Lower-cases ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic letters in place.
+    // All of these fold within the same UTF-8 length, so byte offsets are kept.
+    static void Fold(std::string& text);
+
+private:
+    std::array<uint8_t, 256> classOf_{}; // Class 0: bytes in no pattern
+    uint32_t classCount_ = 1;
+    std::vector<uint32_t> next_; // [state * classCount_ + class]; state 0 is the root
+    std::vector<uint32_t> report_; // First state with an output on the state's suffix chain, or 0
+    std::vector<uint32_t> nextReport_; // The one after that, for states with an output
+    std::vector<uint32_t> output_; // Pattern ending at a state with an output
+    std::vector<uint32_t> lengths_; // Byte length of each pattern
+
+    static uint32_t FoldCodepoint(uint32_t codepoint);
+    // Folds a two-byte sequence; false if it is not one.
+    static bool FoldPair(unsigned char& lead, unsigned char& trail);
+
+    uint32_t Step(uint32_t state, unsigned char byte) const { return next_[state * classCount_ + classOf_[byte]]; }
+};
+
+template <typename OnMatch>
+void AhoCorasick::Scan(std::string_view text, OnMatch&& onMatch) const
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t size = text.size();
+    uint32_t state = 0;
+
+    auto report = [&](size_t end) {
+        for (uint32_t s = report_[state]; s != 0; s = nextReport_[s])
+        {
+            const uint32_t pattern = output_[s];
+            onMatch(Match{ end - lengths_[pattern], end, pattern });
+        }
+    };
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        unsigned char lead = data[i];
+        // Two-byte letters are folded as a pair; ASCII case is folded by the byte classes.
+        if (lead >= 0xC3 && lead <= 0xD1 && i + 1 < size)
+        {
+            unsigned char trail = data[i + 1];
+            if (FoldPair(lead, trail))
+            {
+                state = Step(state, lead);
+                report(i + 1);
+                state = Step(state, trail);
+                report(i + 2);
+                ++i;
+                continue;
+            }
+        }
+        state = Step(state, lead);
+        report(i + 1);
+    }
+}
@@ -0,0 +1,427 @@
+#include "pch.h"
+#include "Benchmarks.h"
+#include "ChatFilter.h"
+#include "ChatHistory.h"
+#include "ChatMetrics.h"
+#include "GlyphCache.h"
+#include "TextSanitizer.h"
+#include "WireFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double ElapsedNs(Clock::time_point start)
+    {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    size_t ArgOr(const std::vector<std::string>& args, size_t index, size_t fallback)
+    {
+        if (args.size() <= index) return fallback;
+        try { return static_cast<size_t>(std::stoul(args[index])); }
+        catch (const std::exception&) { return fallback; }
+    }
+
+    /**
+     * @brief Generates chat-like messages from a small vocabulary, spread over a few channels.
+     */
+    std::vector<ChatMessage> MakeCorpus(size_t count)
+    {
+        static const char* words[] = {
+            "gg", "nice", "shot", "save", "what", "a", "rotate", "boost", "kickoff", "demo",
+            "anyone", "want", "to", "queue", "2s", "3s", "ranked", "casual", "champ", "diamond",
+            "ssl", "flip", "reset", "musty", "ceiling", "air", "dribble", "lag", "server", "eu"
+        };
+        static const char* channels[] = { "general", "eu", "na", "trading", "lfg", "ranked", "help", "offtopic" };
+
+        std::mt19937 rng(1234);
+        std::vector<ChatMessage> corpus;
+        corpus.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ChatMessage message;
+            message.platform = (i % 3) ? "steam" : "epic";
+            message.channel = channels[rng() % std::size(channels)];
+            message.user = "Player" + std::to_string(rng() % 2000);
+            message.highestRank = static_cast<int>(rng() % 23);
+            const size_t wordCount = 3 + rng() % 15;
+            for (size_t w = 0; w < wordCount; ++w)
+            {
+                if (w) message.text.push_back(' ');
+                message.text += words[rng() % std::size(words)];
+            }
+            corpus.push_back(std::move(message));
+        }
+        return corpus;
+    }
+
+    /**
+     * @brief globalchat_bench_search [messages] [queries]
+     * Measures index maintenance cost per appended/evicted message and query latency.
+     */
+    void BenchSearch(const std::vector<std::string>& args)
+    {
+        const size_t messageCount = ArgOr(args, 1, 10000);
+        const size_t queryCount = ArgOr(args, 2, 1000);
+        const auto corpus = MakeCorpus(messageCount * 2);
+
+        // Capacity is per channel; size it so the first pass fills the history without evicting.
+        ChatHistory history(messageCount);
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < messageCount; ++i) history.Append(corpus[i]);
+        const double appendNs = ElapsedNs(start) / static_cast<double>(messageCount);
+
+        static const char* queries[] = { "gg", "nice shot", "player12", "rotate", "musty", "ceiling re", "xyz", "boost lag", "2s", "anyone want" };
+        double totalQueryNs = 0.0;
+        double worstQueryNs = 0.0;
+        size_t totalHits = 0;
+        for (size_t i = 0; i < queryCount; ++i)
+        {
+            start = Clock::now();
+            totalHits += history.Search(queries[i % std::size(queries)], 100).size();
+            const double ns = ElapsedNs(start);
+            totalQueryNs += ns;
+            if (ns > worstQueryNs) worstQueryNs = ns;
+        }
+
+        // Steady state: every append also evicts and unindexes the oldest message of its channel.
+        ChatHistory bounded(messageCount / 8);
+        for (size_t i = 0; i < messageCount; ++i) bounded.Append(corpus[i]);
+        start = Clock::now();
+        for (size_t i = messageCount; i < corpus.size(); ++i) bounded.Append(corpus[i]);
+        const double evictNs = ElapsedNs(start) / static_cast<double>(messageCount);
+
+        LOG("[bench_search] messages={} append={:.0f} ns/msg append+evict={:.0f} ns/msg",
+            messageCount, appendNs, evictNs);
+        LOG("[bench_search] queries={} avg={:.1f} us worst={:.1f} us hits={}",
+            queryCount, totalQueryNs / static_cast<double>(queryCount) / 1000.0, worstQueryNs / 1000.0, totalHits);
+    }
+
+    /**
+     * @brief Decodes every frame with `decode`, repeated `rounds` times, and logs ns per
+     * message. Allocations per message are counted by tests/WireFormatAllocTest, in a
+     * process of its own, since counting them here would mean replacing operator new
+     * for the whole game.
+     */
+    template <typename Decode>
+    void MeasureDecode(const char* label, const std::vector<std::string>& frames, size_t rounds, Decode decode)
+    {
+        size_t checksum = 0;
+        const auto start = Clock::now();
+        for (size_t round = 0; round < rounds; ++round)
+        {
+            for (const auto& frame : frames) checksum += decode(frame);
+        }
+        const double count = static_cast<double>(frames.size() * rounds);
+        const double ns = ElapsedNs(start) / count;
+
+        LOG("[bench_decode] {:<24} {:.0f} ns/msg (checksum {})", label, ns, checksum);
+    }
+
+    /**
+     * @brief globalchat_bench_decode [messages] [rounds]
+     * Compares the single-pass chat message decoder with the generic DOM parse, for
+     * JSON text and MessagePack frames built from a realistic corpus.
+     */
+    void BenchDecode(const std::vector<std::string>& args)
+    {
+        const size_t messageCount = ArgOr(args, 1, 10000);
+        const size_t rounds = std::max<size_t>(ArgOr(args, 2, 10), 1);
+        const auto corpus = MakeCorpus(messageCount);
+
+        std::vector<std::string> textFrames;
+        std::vector<std::string> binaryFrames;
+        size_t textBytes = 0;
+        size_t binaryBytes = 0;
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            const ChatMessage& message = corpus[i];
+            const nlohmann::json payload = {
+                {"platform", message.platform},
+                {"channel", message.channel},
+                {"highest_rank", message.highestRank},
+                {"user", message.user},
+                {"text", message.text},
+                {"seq", i + 1},
+            };
+            textFrames.push_back(WireFormat::Encode(payload, WireFormat::JSON_PROTOCOL));
+            binaryFrames.push_back(WireFormat::Encode(payload, WireFormat::MSGPACK_PROTOCOL));
+            textBytes += textFrames.back().size();
+            binaryBytes += binaryFrames.back().size();
+        }
+        LOG("[bench_decode] messages={} rounds={} json={:.0f} B/msg msgpack={:.0f} B/msg", messageCount, rounds,
+            static_cast<double>(textBytes) / messageCount, static_cast<double>(binaryBytes) / messageCount);
+
+        for (const bool binary : { false, true })
+        {
+            const auto& frames = binary ? binaryFrames : textFrames;
+            MeasureDecode(binary ? "msgpack dom" : "json dom", frames, rounds, [binary](const std::string& frame) {
+                return WireFormat::ParseChatMessage(WireFormat::Decode(frame, binary)).text.size();
+            });
+            MeasureDecode(binary ? "msgpack single-pass" : "json single-pass", frames, rounds, [binary](const std::string& frame) {
+                ChatMessage message;
+                std::string clientId;
+                return WireFormat::DecodeChatMessage(frame, binary, message, clientId) ? message.text.size() : 0;
+            });
+        }
+    }
+
+    /**
+     * @brief Chat lines mixing ASCII with Latin accents, Cyrillic, CJK and Hangul, roughly
+     * in the proportions an international channel shows. With `dirty`, one line in eight
+     * also carries an emoji, a broken sequence or a control character.
+     */
+    std::vector<std::string> MakeMixedCorpus(size_t count, bool dirty)
+    {
+        static const char* words[] = {
+            "gg", "nice shot", "what a save", "rotate", "kickoff", "anyone 2s?",
+            "\xC3\xA7" "a va", "d\xC3\xA9j\xC3\xA0 vu", "sch\xC3\xB6n", // Latin-1
+            "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", "\xD0\xB3\xD0\xB3 \xD0\xB2\xD0\xBF", // Cyrillic
+            "\xE3\x83\x8A\xE3\x82\xA4\xE3\x82\xB9", "\xE5\xA5\xBD\xE7\x90\x83", // Kana, Han
+            "\xEC\xA0\x9C\xEB\xB0\x9C", // Hangul
+        };
+        static const char* faults[] = {
+            "\xF0\x9F\x94\xA5", "\xF0\x9F\x98\x82", // Emoji, past the BMP
+            "\xC3", "\xE4\xB8", "\xFF", "\xC0\xAF", "\xED\xA0\x80", "\x07", "\r\n", "\xC2\x85",
+        };
+
+        std::mt19937 rng(4321);
+        std::vector<std::string> corpus;
+        corpus.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string text;
+            const size_t wordCount = 3 + rng() % 15;
+            for (size_t w = 0; w < wordCount; ++w)
+            {
+                if (w) text.push_back(' ');
+                text += words[rng() % std::size(words)];
+            }
+            if (dirty && rng() % 8 == 0) {
+                text.insert(rng() % (text.size() + 1), faults[rng() % std::size(faults)]);
+            }
+            corpus.push_back(std::move(text));
+        }
+        return corpus;
+    }
+
+    /**
+     * @brief globalchat_bench_utf8 [messages] [rounds]
+     * Throughput of the ingest check (vectorized against byte-at-a-time) and of the
+     * rewrite of dirty text, on printable ASCII, clean mixed-script and dirty corpora.
+     */
+    void BenchUtf8(const std::vector<std::string>& args)
+    {
+        const size_t messageCount = std::max<size_t>(ArgOr(args, 1, 10000), 1);
+        const size_t rounds = std::max<size_t>(ArgOr(args, 2, 20), 1);
+
+        std::vector<std::string> ascii;
+        ascii.reserve(messageCount);
+        for (auto& message : MakeCorpus(messageCount)) ascii.push_back(std::move(message.text));
+
+        const std::pair<const char*, std::vector<std::string>> corpora[] = {
+            { "ascii", std::move(ascii) },
+            { "mixed", MakeMixedCorpus(messageCount, false) },
+            { "dirty", MakeMixedCorpus(messageCount, true) },
+        };
+        constexpr size_t limit = TextSanitizer::MAX_TEXT_CODEPOINTS;
+
+        for (const auto& [label, texts] : corpora)
+        {
+            size_t bytes = 0;
+            for (const auto& text : texts) bytes += text.size();
+            const double megabytes = static_cast<double>(bytes * rounds) / 1048576.0;
+
+            auto measure = [&](auto check) {
+                size_t clean = 0;
+                const auto start = Clock::now();
+                for (size_t round = 0; round < rounds; ++round)
+                {
+                    for (const auto& text : texts) clean += check(text);
+                }
+                return std::make_pair(megabytes / (ElapsedNs(start) / 1e9), clean / rounds);
+            };
+            const auto [scalarRate, scalarClean] = measure([](const std::string& text) { return TextSanitizer::IsCleanScalar(text, limit); });
+            const auto [vectorRate, vectorClean] = measure([](const std::string& text) { return TextSanitizer::IsClean(text, limit); });
+
+            // What ingest does: check, and rewrite only what fails. Copies reuse their capacity.
+            std::vector<std::string> copies(texts.size());
+            size_t rewritten = 0;
+            const auto start = Clock::now();
+            for (size_t round = 0; round < rounds; ++round)
+            {
+                for (size_t i = 0; i < texts.size(); ++i)
+                {
+                    copies[i].assign(texts[i]);
+                    rewritten += TextSanitizer::Sanitize(copies[i], limit);
+                }
+            }
+            const double sanitizeRate = megabytes / (ElapsedNs(start) / 1e9);
+
+            LOG("[bench_utf8] {:<5} {:.0f} B/msg scalar={:.0f} MB/s simd={:.0f} MB/s ({:.1f}x) sanitize={:.0f} MB/s clean={}/{}{} rewritten={}",
+                label, static_cast<double>(bytes) / texts.size(), scalarRate, vectorRate, vectorRate / scalarRate, sanitizeRate,
+                vectorClean, texts.size(), vectorClean == scalarClean ? "" : " MISMATCH", rewritten / rounds);
+        }
+    }
+
+    /**
+     * @brief globalchat_bench_filter [messages] [rounds]
+     * Chat filter throughput for word lists of growing size, against a find() per word.
+     * The automaton's cost per byte should stay flat as the list grows.
+     */
+    void BenchFilter(const std::vector<std::string>& args)
+    {
+        const size_t messageCount = std::max<size_t>(ArgOr(args, 1, 10000), 1);
+        const size_t rounds = std::max<size_t>(ArgOr(args, 2, 10), 1);
+
+        std::vector<std::string> texts;
+        texts.reserve(messageCount);
+        for (auto& message : MakeCorpus(messageCount / 2)) texts.push_back(std::move(message.text));
+        for (auto& text : MakeMixedCorpus(messageCount - texts.size(), false)) texts.push_back(std::move(text));
+        size_t bytes = 0;
+        for (const auto& text : texts) bytes += text.size();
+        const double megabytes = static_cast<double>(bytes * rounds) / 1048576.0;
+
+        std::mt19937 rng(99);
+        for (const size_t listSize : { 10, 100, 1000, 10000 })
+        {
+            // Random words, plus two from the corpus so there is something to report.
+            std::vector<std::string> words = { "lag", "server" };
+            while (words.size() < listSize)
+            {
+                std::string word(4 + rng() % 6, 'a');
+                for (char& c : word) c = static_cast<char>('a' + rng() % 26);
+                words.push_back(std::move(word));
+            }
+
+            auto start = Clock::now();
+            const ChatFilter filter(words);
+            const double buildMs = ElapsedNs(start) / 1e6;
+
+            size_t matches = 0;
+            start = Clock::now();
+            for (size_t round = 0; round < rounds; ++round)
+            {
+                for (auto& text : texts) matches += filter.Apply(text, false);
+            }
+            const double filterRate = megabytes / (ElapsedNs(start) / 1e9);
+
+            // The naive loop, for lists small enough to finish: fold, then search for each word.
+            std::string naiveRate = "-";
+            if (listSize <= 1000)
+            {
+                size_t found = 0;
+                std::string folded;
+                start = Clock::now();
+                for (size_t round = 0; round < rounds; ++round)
+                {
+                    for (const auto& text : texts)
+                    {
+                        folded = text;
+                        AhoCorasick::Fold(folded);
+                        for (const auto& word : words) found += folded.find(word) != std::string::npos;
+                    }
+                }
+                naiveRate = std::to_string(static_cast<int>(megabytes / (ElapsedNs(start) / 1e9) + 0.5)) + " MB/s (" + std::to_string(found / rounds) + " hits)";
+            }
+
+            LOG("[bench_filter] words={:<5} build={:.2f} ms states={} classes={} {} KB automaton={:.0f} MB/s ({} matches) naive={}",
+                listSize, buildMs, filter.Matcher().StateCount(), filter.Matcher().ClassCount(), filter.Matcher().MemoryBytes() / 1024,
+                filterRate, matches / rounds, naiveRate);
+        }
+    }
+
+    /**
+     * @brief globalchat_bench_glyphs [glyphs]
+     * What a prebuilt atlas for the scripts seen in chat (Cyrillic, CJK, kana, Hangul)
+     * would cost at startup, against the on-demand glyph cache: rasterization time and
+     * texture memory. The live glyph wait and upload histograms show the first-render
+     * stalls the cache actually causes.
+     */
+    void BenchGlyphs(const std::shared_ptr<CVarManagerWrapper>& cvarManager, const std::vector<std::string>& args)
+    {
+        const size_t sample = std::max<size_t>(ArgOr(args, 1, 2000), 1);
+        const float size = cvarManager->getCvar("globalchat_font_size").getFloatValue();
+        const auto files = FontSet::ResolveFiles(cvarManager->getCvar("globalchat_fonts").getStringValue());
+
+        auto start = Clock::now();
+        FontSet fonts;
+        if (!fonts.Load(files, size))
+        {
+            LOG("[bench_glyphs] no chat font could be loaded");
+            return;
+        }
+        LOG("[bench_glyphs] {} of {} fonts mapped ({:.1f} MB) in {:.1f} ms, size {}px", fonts.Count(), files.size(),
+            fonts.MappedBytes() / 1048576.0, ElapsedNs(start) / 1e6, size);
+
+        // The ranges ImGui's own tables would bake for these scripts.
+        static const ImWchar ranges[][2] = {
+            { 0x0020, 0x00FF }, { 0x0400, 0x052F }, { 0x2000, 0x206F }, { 0x3000, 0x30FF },
+            { 0x3131, 0x3163 }, { 0x4E00, 0x9FAF }, { 0xAC00, 0xD7A3 }, { 0xFF00, 0xFFEF },
+        };
+        const int maxSize = static_cast<int>(size * 2.0f);
+        FontSet::Glyph glyph;
+        size_t glyphCount = 0;
+        size_t pixels = 0;
+        start = Clock::now();
+        for (const auto& range : ranges)
+        {
+            for (unsigned int codepoint = range[0]; codepoint <= range[1]; ++codepoint)
+            {
+                fonts.Rasterize(static_cast<ImWchar>(codepoint), maxSize, glyph);
+                if (!glyph.found) continue;
+                ++glyphCount;
+                pixels += static_cast<size_t>(glyph.width + 1) * (glyph.height + 1); // One pixel of packing padding
+            }
+        }
+        LOG("[bench_glyphs] prebuilt atlas: {} glyphs, {:.1f} ms to rasterize, ~{:.1f} MB RGBA texture",
+            glyphCount, ElapsedNs(start) / 1e6, pixels * 4 / 1048576.0);
+
+        // A first sighting costs one glyph on the worker plus its cell upload on the render thread.
+        constexpr unsigned int firstIdeograph = 0x4E00;
+        constexpr unsigned int ideographs = 0x9FAF - 0x4E00 + 1;
+        start = Clock::now();
+        for (size_t i = 0; i < sample; ++i)
+        {
+            fonts.Rasterize(static_cast<ImWchar>(firstIdeograph + i % ideographs), maxSize, glyph);
+        }
+        LOG("[bench_glyphs] on demand: {:.1f} us per glyph, {:.1f} MB texture for {} cached glyphs",
+            ElapsedNs(start) / sample / 1000.0, GlyphCache::TextureBytes(size) / 1048576.0, GlyphCache::CAPACITY);
+
+        for (const auto& line : GetMetrics().Describe())
+        {
+            if (line.rfind("glyph", 0) == 0) LOG("[bench_glyphs] live {}", line);
+        }
+    }
+}
+
+void Benchmarks::Register(const std::shared_ptr<CVarManagerWrapper>& cvarManager)
+{
+    cvarManager->registerNotifier("globalchat_bench_search", [](std::vector<std::string> args) {
+        BenchSearch(args);
+    }, "Benchmark the chat search index: globalchat_bench_search [messages] [queries]", PERMISSION_ALL);
+
+    cvarManager->registerNotifier("globalchat_bench_decode", [](std::vector<std::string> args) {
+        BenchDecode(args);
+    }, "Benchmark chat message decoding: globalchat_bench_decode [messages] [rounds]", PERMISSION_ALL);
+
+    cvarManager->registerNotifier("globalchat_bench_utf8", [](std::vector<std::string> args) {
+        BenchUtf8(args);
+    }, "Benchmark incoming text validation: globalchat_bench_utf8 [messages] [rounds]", PERMISSION_ALL);
+
+    cvarManager->registerNotifier("globalchat_bench_filter", [](std::vector<std::string> args) {
+        BenchFilter(args);
+    }, "Benchmark the chat word filter: globalchat_bench_filter [messages] [rounds]", PERMISSION_ALL);
+
+    // Weak, since the manager owns this callback.
+    std::weak_ptr<CVarManagerWrapper> weakManager = cvarManager;
+    cvarManager->registerNotifier("globalchat_bench_glyphs", [weakManager](std::vector<std::string> args) {
+        if (auto manager = weakManager.lock()) BenchGlyphs(manager, args);
+    }, "Compare on-demand chat glyphs with a prebuilt atlas: globalchat_bench_glyphs [glyphs]", PERMISSION_ALL);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "bakkesmod/wrappers/cvarmanagerwrapper.h"
+
+#include <memory>
+
+/**
+ * @brief Console commands that measure hot paths in-game (globalchat_bench_*).
+ * Results are written to the BakkesMod console.
+ */
+namespace Benchmarks
+{
+    void Register(const std::shared_ptr<CVarManagerWrapper>& cvarManager);
+}
@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "ChatFilter.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+    std::string_view Trim(std::string_view text)
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos) return {};
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+}
+
+std::vector<std::string> ChatFilter::ParseList(std::string_view list)
+{
+    std::vector<std::string> entries;
+    size_t start = 0;
+    while (start < list.size())
+    {
+        size_t end = list.find_first_of(",\n", start);
+        if (end == std::string_view::npos) end = list.size();
+        const std::string_view entry = Trim(list.substr(start, end - start));
+        if (!entry.empty() && entry.front() != '#') entries.emplace_back(entry);
+        start = end + 1;
+    }
+    return entries;
+}
+
+ChatFilter::ChatFilter(const std::vector<std::string>& entries) : matcher_(Patterns(entries, entries_, entryIndices_))
+{
+}
+
+std::vector<std::string> ChatFilter::Patterns(const std::vector<std::string>& entries, std::vector<Entry>& flags,
+    std::vector<size_t>& entryIndices)
+{
+    std::vector<std::string> patterns;
+    std::unordered_map<std::string, size_t> indices; // Folded pattern to its index
+    for (size_t index = 0; index < entries.size(); ++index)
+    {
+        std::string_view pattern = Trim(entries[index]);
+        Entry entry;
+        if (!pattern.empty() && pattern.front() == '*') {
+            entry.wordStart = false;
+            pattern.remove_prefix(1);
+        }
+        if (!pattern.empty() && pattern.back() == '*') {
+            entry.wordEnd = false;
+            pattern.remove_suffix(1);
+        }
+        if (pattern.empty()) continue;
+
+        // "spam" and "spam*" fold into one pattern that matches as loosely as either.
+        std::string key(pattern);
+        AhoCorasick::Fold(key);
+        const auto [it, added] = indices.try_emplace(std::move(key), patterns.size());
+        if (!added) {
+            flags[it->second].wordStart &= entry.wordStart;
+            flags[it->second].wordEnd &= entry.wordEnd;
+            continue;
+        }
+        patterns.emplace_back(pattern);
+        flags.push_back(entry);
+        entryIndices.push_back(index);
+    }
+    return patterns;
+}
+
+size_t ChatFilter::Apply(std::string& text, bool mask) const
+{
+    size_t matches = 0;
+    std::vector<std::pair<size_t, size_t>> spans; // Only allocates once something matches
+    Scan(text, [&](size_t begin, size_t end, size_t) {
+        ++matches;
+        if (mask) spans.emplace_back(begin, end);
+    });
+    if (spans.empty()) return matches;
+
+    // Matches arrive by end offset; overlapping ones are masked as one.
+    std::sort(spans.begin(), spans.end());
+    std::string masked;
+    masked.reserve(text.size());
+    size_t copied = 0;
+    for (const auto& [begin, end] : spans)
+    {
+        if (end <= copied) continue;
+        const size_t from = std::max(begin, copied);
+        masked.append(text, copied, from - copied);
+        for (size_t i = from; i < end; ++i)
+        {
+            // One '*' per character, not per byte.
+            if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) masked.push_back('*');
+        }
+        copied = end;
+    }
+    masked.append(text, copied, std::string::npos);
+    text = std::move(masked);
+    return matches;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "AhoCorasick.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Word list matcher for incoming chat, compiled once from a list of entries. Used
+ * for the word filter and for highlights.
+ *
+ * An entry matches whole words, case-insensitively: "spam" hides "Spam" but not
+ * "spammer". A '*' at either end lets it run on into the word ("spam*" also hides
+ * "spammer", "*spam*" hides it anywhere). All entries are matched in a single pass,
+ * so the cost per message does not grow with the list.
+ */
+class ChatFilter
+{
+public:
+    enum class Mode
+    {
+        Off,
+        Mask, // Matched characters are replaced with '*'
+        Drop, // Messages with a match are not shown at all
+    };
+
+    // Entries from a list separated by newlines or commas. Surrounding spaces are
+    // trimmed; lines starting with '#' are comments.
+    static std::vector<std::string> ParseList(std::string_view list);
+
+    explicit ChatFilter(const std::vector<std::string>& entries);
+
+    // Counts the matches in the text; with `mask`, also replaces every matched character with '*'.
+    size_t Apply(std::string& text, bool mask) const;
+
+    // Calls onMatch(begin, end, entry) for every match that respects word boundaries, in
+    // order of end offset. `entry` indexes the list the filter was built from; entries
+    // that fold to the same word report the first one's index.
+    template <typename OnMatch>
+    void Scan(std::string_view text, OnMatch&& onMatch) const;
+
+    size_t EntryCount() const { return entries_.size(); }
+    const AhoCorasick& Matcher() const { return matcher_; }
+
+private:
+    struct Entry
+    {
+        bool wordStart = true; // Must start at the beginning of a word
+        bool wordEnd = true; // Must end at the end of a word
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<size_t> entryIndices_; // Per pattern, the index of its first entry
+    AhoCorasick matcher_;
+
+    static std::vector<std::string> Patterns(const std::vector<std::string>& entries, std::vector<Entry>& flags,
+        std::vector<size_t>& entryIndices);
+
+    // Non-ASCII bytes count as letters, so a match inside a word of any script is not whole.
+    static bool IsWordByte(char c)
+    {
+        const auto byte = static_cast<unsigned char>(c);
+        return byte >= 0x80 || (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') || byte == '_';
+    }
+};
+
+template <typename OnMatch>
+void ChatFilter::Scan(std::string_view text, OnMatch&& onMatch) const
+{
+    matcher_.Scan(text, [&](const AhoCorasick::Match& match) {
+        const Entry& entry = entries_[match.pattern];
+        if (entry.wordStart && match.begin > 0 && IsWordByte(text[match.begin - 1])) return;
+        if (entry.wordEnd && match.end < text.size() && IsWordByte(text[match.end])) return;
+        onMatch(match.begin, match.end, entryIndices_[match.pattern]);
+    });
+}
@@ -0,0 +1,265 @@
+#include "ChatHistory.h"
+
+#include <algorithm>
+
+const ChatHistory::ChannelMessages* ChatHistory::Snapshot::GetChannel(std::string_view channel) const
+{
+    auto it = channels.find(channel);
+    return it != channels.end() ? it->second.get() : nullptr;
+}
+
+std::vector<ChatHistory::MessagePtr> ChatHistory::Snapshot::Search(std::string_view query, size_t maxHits) const
+{
+    std::vector<MessagePtr> results;
+    const std::vector<uint64_t> ids = search->Query(query, maxHits);
+    if (ids.empty()) return results;
+
+    // Hits are few and channels short, so one pass over the messages resolves them all.
+    std::unordered_map<uint64_t, size_t> rank;
+    rank.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) rank.emplace(ids[i], i);
+
+    results.resize(ids.size());
+    for (const auto& [name, messages] : channels)
+    {
+        if (!messages) continue;
+        for (const MessagePtr& message : *messages)
+        {
+            auto it = rank.find(message->id);
+            if (it != rank.end()) results[it->second] = message;
+        }
+    }
+    std::erase(results, nullptr);
+    return results;
+}
+
+ChatHistory::ChatHistory(size_t capacityPerChannel) : capacity_(capacityPerChannel)
+{
+    Publish();
+}
+
+void ChatHistory::Clear()
+{
+    state_.channels.clear();
+    state_.channelOrder.clear();
+    byId_.clear();
+    index_.Clear();
+    seenSeqs_.Clear();
+    ++state_.generation;
+    ++state_.channelOrderGeneration;
+    Publish();
+}
+
+void ChatHistory::SetChannelOrder(std::vector<std::string> channels)
+{
+    state_.channelOrder = std::move(channels);
+    ++state_.generation;
+    ++state_.channelOrderGeneration;
+    Publish();
+}
+
+void ChatHistory::AddChannel(const std::string& channel)
+{
+    if (std::find(state_.channelOrder.begin(), state_.channelOrder.end(), channel) != state_.channelOrder.end()) return;
+    state_.channelOrder.push_back(channel);
+    ++state_.generation;
+    ++state_.channelOrderGeneration;
+    Publish();
+}
+
+const ChatMessage* ChatHistory::Append(ChatMessage message)
+{
+    if (message.seq != 0 && !seenSeqs_.Insert(message.seq)) return nullptr;
+
+    static const ChannelMessages noMessages;
+    auto& slot = state_.channels[message.channel];
+    const ChannelMessages& current = slot ? *slot : noMessages;
+
+    // Late arrivals are rare and belong near the end, so scan backwards for their place.
+    size_t position = current.size();
+    if (message.seq != 0)
+    {
+        while (position > 0 && current[position - 1]->seq > message.seq) --position;
+    }
+
+    const bool full = current.size() >= capacity_;
+    if (full && position == 0) return nullptr; // Would be evicted straight away
+
+    size_t keepFrom = 0;
+    if (full)
+    {
+        const ChatMessage& oldest = *current.front();
+        index_.Remove(oldest);
+        byId_.erase(oldest.id);
+        keepFrom = 1;
+    }
+
+    message.id = nextId_++;
+    auto stored = std::make_shared<const ChatMessage>(std::move(message));
+    auto messages = std::make_shared<ChannelMessages>();
+    messages->reserve(current.size() - keepFrom + 1);
+    messages->insert(messages->end(), current.begin() + keepFrom, current.begin() + position);
+    messages->push_back(stored);
+    messages->insert(messages->end(), current.begin() + position, current.end());
+
+    index_.Add(*stored);
+    byId_[stored->id] = stored.get();
+
+    slot = std::move(messages);
+    ++state_.generation;
+    Publish();
+    return stored.get();
+}
+
+void ChatHistory::Prepend(const std::string& channel, std::vector<ChatMessage> olderMessages)
+{
+    auto& slot = state_.channels[channel];
+    auto messages = std::make_shared<ChannelMessages>();
+    messages->reserve(olderMessages.size() + (slot ? slot->size() : 0));
+
+    // Ids count down from the newest of the older messages, so each page ranks below
+    // everything already stored, and below the pages before it.
+    for (auto it = olderMessages.rbegin(); it != olderMessages.rend(); ++it)
+    {
+        it->id = nextOlderId_--;
+        it->channel = channel;
+        seenSeqs_.Insert(it->seq);
+    }
+    for (auto& older : olderMessages)
+    {
+        messages->push_back(std::make_shared<const ChatMessage>(std::move(older)));
+    }
+    for (auto it = messages->rbegin(); it != messages->rend(); ++it)
+    {
+        index_.Add(**it);
+        byId_[(*it)->id] = it->get();
+    }
+    if (slot) messages->insert(messages->end(), slot->begin(), slot->end());
+
+    slot = std::move(messages);
+    ++state_.generation;
+    Publish();
+}
+
+bool ChatHistory::Locate(uint64_t id, std::shared_ptr<const ChannelMessages>*& slot, size_t& position)
+{
+    const ChatMessage* message = Find(id);
+    if (!message) return false;
+
+    auto it = state_.channels.find(message->channel);
+    if (it == state_.channels.end() || !it->second) return false;
+
+    const ChannelMessages& messages = *it->second;
+    for (size_t i = messages.size(); i-- > 0;) // Usually one of the newest
+    {
+        if (messages[i].get() == message)
+        {
+            slot = &it->second;
+            position = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ChatHistory::SetDelivery(uint64_t id, DeliveryState delivery)
+{
+    std::shared_ptr<const ChannelMessages>* slot = nullptr;
+    size_t position = 0;
+    if (!Locate(id, slot, position)) return false;
+
+    // User and text are unchanged, so the search index entry stays valid.
+    ChatMessage updated = *(**slot)[position];
+    updated.delivery = delivery;
+
+    auto stored = std::make_shared<const ChatMessage>(std::move(updated));
+    auto messages = std::make_shared<ChannelMessages>(**slot);
+    (*messages)[position] = stored;
+    byId_[id] = stored.get();
+
+    *slot = std::move(messages);
+    ++state_.generation;
+    Publish();
+    return true;
+}
+
+bool ChatHistory::Remove(uint64_t id)
+{
+    std::shared_ptr<const ChannelMessages>* slot = nullptr;
+    size_t position = 0;
+    if (!Locate(id, slot, position)) return false;
+
+    index_.Remove(*(**slot)[position]);
+    byId_.erase(id);
+
+    auto messages = std::make_shared<ChannelMessages>(**slot);
+    messages->erase(messages->begin() + static_cast<std::ptrdiff_t>(position));
+
+    *slot = std::move(messages);
+    ++state_.generation;
+    Publish();
+    return true;
+}
+
+size_t ChatHistory::RemoveIf(const std::function<bool(const ChatMessage&)>& predicate)
+{
+    size_t removed = 0;
+    for (auto& [channel, slot] : state_.channels)
+    {
+        if (!slot) continue;
+        const ChannelMessages& current = *slot;
+        auto first = std::find_if(current.begin(), current.end(), [&](const MessagePtr& message) { return predicate(*message); });
+        if (first == current.end()) continue;
+
+        auto messages = std::make_shared<ChannelMessages>();
+        messages->reserve(current.size());
+        messages->insert(messages->end(), current.begin(), first);
+        for (auto it = first; it != current.end(); ++it)
+        {
+            if (it != first && !predicate(**it))
+            {
+                messages->push_back(*it);
+                continue;
+            }
+            // Sequence numbers stay in the dedup set, so a removed message is not stored again.
+            index_.Remove(**it);
+            byId_.erase((*it)->id);
+            ++removed;
+        }
+        slot = std::move(messages);
+    }
+
+    if (removed > 0)
+    {
+        ++state_.generation;
+        Publish();
+    }
+    return removed;
+}
+
+const ChatHistory::ChannelMessages* ChatHistory::GetChannel(const std::string& channel) const
+{
+    return state_.GetChannel(channel);
+}
+
+const ChatMessage* ChatHistory::Find(uint64_t id) const
+{
+    auto it = byId_.find(id);
+    return it != byId_.end() ? it->second : nullptr;
+}
+
+std::vector<const ChatMessage*> ChatHistory::Search(std::string_view query, size_t maxHits) const
+{
+    std::vector<const ChatMessage*> results;
+    for (uint64_t id : index_.Query(query, maxHits))
+    {
+        if (const ChatMessage* message = Find(id)) results.push_back(message);
+    }
+    return results;
+}
+
+void ChatHistory::Publish()
+{
+    state_.search = index_.Current();
+    published_.store(std::make_shared<const Snapshot>(state_), std::memory_order_release);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ChatMessage.h"
+#include "ChatSearchIndex.h"
+#include "RecentIdSet.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Per-channel message history with a bounded size and a search index
+ * that is kept in sync as messages are appended and evicted.
+ *
+ * Writers are not thread-safe; callers serialize them (see GlobalChat::historyMutex).
+ * Every change also publishes an immutable Snapshot that any thread can read without
+ * that lock, which is what the render thread draws from and searches.
+ */
+class ChatHistory
+{
+public:
+    using MessagePtr = std::shared_ptr<const ChatMessage>;
+    // A channel's messages, oldest first. Never modified once shared; changes copy the
+    // pointer vector and swap it in, so readers holding the old one are unaffected.
+    using ChannelMessages = std::vector<MessagePtr>;
+
+    struct Snapshot
+    {
+        std::vector<std::string> channelOrder;
+        std::map<std::string, std::shared_ptr<const ChannelMessages>, std::less<>> channels;
+        uint64_t generation = 0;
+        uint64_t channelOrderGeneration = 0; // Changes only with channelOrder
+        std::shared_ptr<const ChatSearchIndex::View> search; // Index over exactly these messages
+
+        const ChannelMessages* GetChannel(std::string_view channel) const;
+        // Searches all channels, newest hits first. Needs no lock, unlike ChatHistory::Search.
+        std::vector<MessagePtr> Search(std::string_view query, size_t maxHits) const;
+    };
+
+    explicit ChatHistory(size_t capacityPerChannel);
+
+    void Clear();
+
+    // Channels in display order. Messages may exist for channels not listed here.
+    void SetChannelOrder(std::vector<std::string> channels);
+    void AddChannel(const std::string& channel);
+    const std::vector<std::string>& ChannelOrder() const { return state_.channelOrder; }
+
+    // Stores a message, evicting the channel's oldest entry when full. A message with a
+    // server sequence number is placed in sequence order within its channel, so a late
+    // arrival lands where it belongs. Returns nullptr for a sequence number already seen,
+    // or for a late message older than everything a full channel still holds.
+    const ChatMessage* Append(ChatMessage message);
+
+    // Inserts older messages (oldest first) in front of a channel's buffer.
+    // Scrollback may grow a channel past its capacity; later appends still evict one entry each.
+    void Prepend(const std::string& channel, std::vector<ChatMessage> olderMessages);
+
+    // Updates a stored message's delivery state in place (a copy is swapped in for readers).
+    bool SetDelivery(uint64_t id, DeliveryState delivery);
+    bool Remove(uint64_t id);
+    // Removes every message the predicate matches, in a single pass over all channels.
+    // Only channels that lose a message are copied. Returns the number removed.
+    size_t RemoveIf(const std::function<bool(const ChatMessage&)>& predicate);
+
+    const ChannelMessages* GetChannel(const std::string& channel) const;
+    const ChatMessage* Find(uint64_t id) const;
+
+    // Searches all channels, newest hits first.
+    std::vector<const ChatMessage*> Search(std::string_view query, size_t maxHits) const;
+
+    // Bumped on every change so callers can cache derived data.
+    uint64_t Generation() const { return state_.generation; }
+    size_t Capacity() const { return capacity_; }
+
+    // Latest published state. Safe from any thread, lock-free for the caller.
+    std::shared_ptr<const Snapshot> GetSnapshot() const { return published_.load(std::memory_order_acquire); }
+
+private:
+    // Bounds the dedup memory; comfortably more than every channel's scrollback combined.
+    static constexpr size_t SEEN_SEQ_CAPACITY = 16384;
+
+    // Ids order search hits newest first, so appends count up from the middle of the range
+    // and pages of older messages count down from below it.
+    static constexpr uint64_t FIRST_APPENDED_ID = uint64_t{ 1 } << 48;
+
+    size_t capacity_;
+    uint64_t nextId_ = FIRST_APPENDED_ID;
+    uint64_t nextOlderId_ = FIRST_APPENDED_ID - 1;
+    RecentIdSet seenSeqs_{ SEEN_SEQ_CAPACITY };
+    Snapshot state_;
+    // Messages are heap-allocated and shared with snapshots, so these pointers stay valid until eviction.
+    std::unordered_map<uint64_t, const ChatMessage*> byId_;
+    ChatSearchIndex index_;
+    std::atomic<std::shared_ptr<const Snapshot>> published_;
+
+    void Publish();
+    // Locates a stored message by id: its channel slot and position in it.
+    bool Locate(uint64_t id, std::shared_ptr<const ChannelMessages>*& slot, size_t& position);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class DeliveryState : uint8_t
+{
+    Delivered, // Received from the server
+    Pending,   // Local echo of our own message, waiting for the server's copy
+    Failed,    // Local echo that could not be sent or was never acknowledged
+};
+
+/**
+ * @brief A highlighted byte range of a message's text.
+ */
+struct TextSpan
+{
+    uint16_t begin = 0;
+    uint16_t end = 0; // Exclusive
+    bool mention = false; // The player's own name, rather than a keyword
+};
+
+/**
+ * @brief A shortcode in a message's text that names an emote.
+ */
+struct EmoteSpan
+{
+    uint16_t begin = 0; // The opening ':'
+    uint16_t end = 0; // Exclusive, past the closing ':'
+    uint16_t emote = 0; // Index in the EmoteSet it was resolved against
+};
+
+/**
+ * @brief A single chat message as stored in the local history.
+ */
+struct ChatMessage
+{
+    uint64_t id = 0; // Local identity, assigned by ChatHistory; higher is newer (see ChatHistory::Prepend)
+    uint64_t seq = 0; // Server sequence number, unique across channels; 0 if the server sent none
+    std::string platform;
+    std::string channel;
+    std::string user;
+    std::string text;
+    int highestRank = -1;
+    DeliveryState delivery = DeliveryState::Delivered;
+    std::vector<TextSpan> highlights; // Sorted and disjoint; found once at ingest
+    std::vector<EmoteSpan> emotes; // Sorted and disjoint; resolved once at ingest
+};
@@ -0,0 +1,136 @@
+#include "ChatMetrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace
+{
+    constexpr auto RELAXED = std::memory_order_relaxed;
+
+    void StoreMax(std::atomic<uint64_t>& target, uint64_t value)
+    {
+        uint64_t current = target.load(RELAXED);
+        while (value > current && !target.compare_exchange_weak(current, value, RELAXED)) {}
+    }
+
+    std::string DescribeHistogram(const char* name, const LatencyHistogram& histogram)
+    {
+        const auto snapshot = histogram.Read();
+        char line[192];
+        std::snprintf(line, sizeof(line), "%s: n=%llu mean=%.1fus p50<%.0fus p99<%.0fus max=%.1fus",
+            name, static_cast<unsigned long long>(snapshot.count), snapshot.MeanUs(),
+            snapshot.PercentileUs(0.50), snapshot.PercentileUs(0.99), static_cast<double>(snapshot.maxNs) / 1000.0);
+        return line;
+    }
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds duration)
+{
+    const uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+    const uint64_t us = ns / 1000;
+    // bit_width(us) is 0 for <1us, 1 for [1,2)us, 2 for [2,4)us, ...
+    const size_t bucket = std::min<size_t>(us ? std::bit_width(us) - 1 : 0, BUCKETS - 1);
+
+    counts_[bucket].fetch_add(1, RELAXED);
+    count_.fetch_add(1, RELAXED);
+    sumNs_.fetch_add(ns, RELAXED);
+    StoreMax(maxNs_, ns);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Read() const
+{
+    Snapshot snapshot;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        snapshot.counts[i] = counts_[i].load(RELAXED);
+    }
+    snapshot.count = count_.load(RELAXED);
+    snapshot.sumNs = sumNs_.load(RELAXED);
+    snapshot.maxNs = maxNs_.load(RELAXED);
+    return snapshot;
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : counts_) bucket.store(0, RELAXED);
+    count_.store(0, RELAXED);
+    sumNs_.store(0, RELAXED);
+    maxNs_.store(0, RELAXED);
+}
+
+double LatencyHistogram::Snapshot::PercentileUs(double p) const
+{
+    uint64_t total = 0;
+    for (uint64_t c : counts) total += c;
+    if (total == 0) return 0.0;
+
+    const uint64_t target = static_cast<uint64_t>(p * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        seen += counts[i];
+        if (seen >= target) return static_cast<double>(uint64_t{ 2 } << i);
+    }
+    return static_cast<double>(uint64_t{ 2 } << (BUCKETS - 1));
+}
+
+void ChatMetrics::SetWriteQueueDepth(uint64_t depth)
+{
+    writeQueueDepth.store(depth, RELAXED);
+    StoreMax(writeQueuePeak, depth);
+}
+
+void ChatMetrics::Reset()
+{
+    for (auto* counter : { &messagesIn, &bytesIn, &messagesOut, &bytesOut, &parseErrors, &duplicateMessages, &reconnects, &writeQueuePeak, &outboxDropped, &rateLimited, &unsubscribedMessages, &glyphEvictions, &sanitizedMessages, &filteredMessages, &mutedMessages, &coalescedFrames, &typingFramesOut, &typingFramesIn })
+    {
+        counter->store(0, RELAXED);
+    }
+    for (auto* histogram : { &parseTime, &historyAppendTime, &historyLockWait, &roundTripTime, &renderTime, &glyphWait, &glyphUpload })
+    {
+        histogram->Reset();
+    }
+}
+
+std::vector<std::string> ChatMetrics::Describe() const
+{
+    auto counter = [](const char* name, const std::atomic<uint64_t>& value) {
+        return std::string(name) + ": " + std::to_string(value.load(RELAXED));
+    };
+
+    return {
+        counter("messages in", messagesIn),
+        counter("bytes in", bytesIn),
+        counter("messages out", messagesOut),
+        counter("bytes out", bytesOut),
+        counter("parse errors", parseErrors),
+        counter("duplicate messages", duplicateMessages),
+        counter("reconnects", reconnects),
+        counter("write queue depth", writeQueueDepth),
+        counter("write queue peak", writeQueuePeak),
+        counter("outbox dropped", outboxDropped),
+        counter("rate limited", rateLimited),
+        counter("unsubscribed messages", unsubscribedMessages),
+        counter("glyph evictions", glyphEvictions),
+        counter("sanitized messages", sanitizedMessages),
+        counter("filtered messages", filteredMessages),
+        counter("muted messages", mutedMessages),
+        counter("coalesced frames", coalescedFrames),
+        counter("typing frames out", typingFramesOut),
+        counter("typing frames in", typingFramesIn),
+        DescribeHistogram("parse", parseTime),
+        DescribeHistogram("history append", historyAppendTime),
+        DescribeHistogram("history lock wait", historyLockWait),
+        DescribeHistogram("round trip", roundTripTime),
+        DescribeHistogram("render", renderTime),
+        DescribeHistogram("glyph wait", glyphWait),
+        DescribeHistogram("glyph upload", glyphUpload),
+    };
+}
+
+ChatMetrics& GetMetrics()
+{
+    static ChatMetrics metrics;
+    return metrics;
+}
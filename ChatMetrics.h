@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Fixed-bucket latency histogram that can be recorded from any thread
+ * without locking. Bucket i counts samples below 2^(i+1) microseconds.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS = 22; // Last bucket also takes everything above ~2 s
+
+    struct Snapshot
+    {
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t count = 0;
+        uint64_t sumNs = 0;
+        uint64_t maxNs = 0;
+
+        double MeanUs() const { return count ? static_cast<double>(sumNs) / count / 1000.0 : 0.0; }
+        // Upper bound of the bucket holding the p-th percentile, in microseconds.
+        double PercentileUs(double p) const;
+    };
+
+    void Record(std::chrono::nanoseconds duration);
+    Snapshot Read() const;
+    void Reset();
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> sumNs_{ 0 };
+    std::atomic<uint64_t> maxNs_{ 0 };
+};
+
+/**
+ * @brief Records the time from construction to destruction into a histogram.
+ */
+class ScopedLatency
+{
+public:
+    explicit ScopedLatency(LatencyHistogram& histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() { histogram_.Record(std::chrono::steady_clock::now() - start_); }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Connection and pipeline counters, updated on the hot paths with relaxed
+ * atomics and read by the diagnostics tab and the globalchat_metrics command.
+ */
+struct ChatMetrics
+{
+    std::atomic<uint64_t> messagesIn{ 0 };
+    std::atomic<uint64_t> bytesIn{ 0 };
+    std::atomic<uint64_t> messagesOut{ 0 };
+    std::atomic<uint64_t> bytesOut{ 0 };
+    std::atomic<uint64_t> parseErrors{ 0 };
+    std::atomic<uint64_t> duplicateMessages{ 0 };
+    std::atomic<uint64_t> reconnects{ 0 };
+    std::atomic<uint64_t> writeQueueDepth{ 0 };
+    std::atomic<uint64_t> writeQueuePeak{ 0 };
+    std::atomic<uint64_t> outboxDropped{ 0 }; // Outbox full, or frames too old to send after a reconnect
+    std::atomic<uint64_t> rateLimited{ 0 }; // Frames refused by the client-side send limit
+    std::atomic<uint64_t> unsubscribedMessages{ 0 }; // Arrived for a channel after we left it
+    std::atomic<uint64_t> glyphEvictions{ 0 }; // Chat glyphs that gave up their cell to a newer one
+    std::atomic<uint64_t> sanitizedMessages{ 0 }; // Incoming messages rewritten to be drawable
+    std::atomic<uint64_t> filteredMessages{ 0 }; // Incoming messages masked or dropped by the chat filter
+    std::atomic<uint64_t> mutedMessages{ 0 }; // Incoming messages from muted users
+    std::atomic<uint64_t> coalescedFrames{ 0 }; // Queued frames replaced by a newer one for the same state
+    std::atomic<uint64_t> typingFramesOut{ 0 };
+    std::atomic<uint64_t> typingFramesIn{ 0 };
+
+    LatencyHistogram parseTime;
+    LatencyHistogram historyAppendTime;
+    LatencyHistogram historyLockWait; // Network thread waiting for historyMutex
+    LatencyHistogram roundTripTime;
+    LatencyHistogram renderTime;
+    LatencyHistogram glyphWait; // Glyph requested until drawable; the fallback character shows meanwhile
+    LatencyHistogram glyphUpload; // Render thread installing and uploading a frame's new glyphs
+
+    void SetWriteQueueDepth(uint64_t depth);
+    void Reset();
+
+    // One human-readable line per metric.
+    std::vector<std::string> Describe() const;
+};
+
+ChatMetrics& GetMetrics();
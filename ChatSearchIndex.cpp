@@ -0,0 +1,254 @@
+#include "ChatSearchIndex.h"
+
+#include <algorithm>
+
+ChatSearchIndex::ChatSearchIndex() : view_(std::make_shared<const View>())
+{
+}
+
+void ChatSearchIndex::Add(const ChatMessage& message)
+{
+    auto next = std::make_shared<View>(*view_);
+    next->Add(message);
+    view_ = std::move(next);
+}
+
+void ChatSearchIndex::Remove(const ChatMessage& message)
+{
+    auto next = std::make_shared<View>(*view_);
+    next->Remove(message.id);
+    view_ = std::move(next);
+}
+
+void ChatSearchIndex::Clear()
+{
+    view_ = std::make_shared<const View>();
+}
+
+std::vector<uint64_t> ChatSearchIndex::Query(std::string_view query, size_t maxHits) const
+{
+    return view_->Query(query, maxHits);
+}
+
+size_t ChatSearchIndex::Size() const
+{
+    return view_->Size();
+}
+
+std::string ChatSearchIndex::View::Fold(std::string_view text)
+{
+    std::string folded(text);
+    for (char& c : folded)
+    {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return folded;
+}
+
+void ChatSearchIndex::View::CollectTrigrams(std::string_view folded, std::vector<uint32_t>& out)
+{
+    out.clear();
+    if (folded.size() < 3) return;
+
+    out.reserve(folded.size() - 2);
+    for (size_t i = 0; i + 2 < folded.size(); ++i)
+    {
+        out.push_back((static_cast<uint32_t>(static_cast<uint8_t>(folded[i])) << 16) |
+                      (static_cast<uint32_t>(static_cast<uint8_t>(folded[i + 1])) << 8) |
+                       static_cast<uint32_t>(static_cast<uint8_t>(folded[i + 2])));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+ChatSearchIndex::View::Segment ChatSearchIndex::View::Build(std::vector<Document> documents)
+{
+    std::sort(documents.begin(), documents.end(), [](const Document& a, const Document& b) { return a.id < b.id; });
+
+    auto data = std::make_shared<SegmentData>();
+    std::vector<uint32_t> trigrams;
+    for (size_t i = 0; i < documents.size(); ++i)
+    {
+        CollectTrigrams(documents[i].folded, trigrams);
+        for (uint32_t trigram : trigrams) data->postings[trigram].push_back(static_cast<uint32_t>(i));
+    }
+    data->documents = std::move(documents);
+
+    Segment segment;
+    segment.liveCount = data->documents.size();
+    segment.data = std::move(data);
+    return segment;
+}
+
+void ChatSearchIndex::View::Add(const ChatMessage& message)
+{
+    std::string folded = Fold(message.user);
+    folded.push_back('\n');
+    folded += Fold(message.text);
+
+    recent_.push_back(std::make_shared<const Document>(Document{ message.id, std::move(folded) }));
+    ++liveCount_;
+    if (recent_.size() >= SEGMENT_SIZE) Seal();
+}
+
+void ChatSearchIndex::View::Seal()
+{
+    std::vector<Document> documents;
+    documents.reserve(recent_.size());
+    for (const auto& doc : recent_) documents.push_back(*doc);
+    recent_.clear();
+    segments_.push_back(Build(std::move(documents)));
+}
+
+void ChatSearchIndex::View::Remove(uint64_t id)
+{
+    auto recent = std::find_if(recent_.begin(), recent_.end(), [id](const auto& doc) { return doc->id == id; });
+    if (recent != recent_.end())
+    {
+        recent_.erase(recent);
+        --liveCount_;
+        return;
+    }
+
+    for (auto segment = segments_.begin(); segment != segments_.end(); ++segment)
+    {
+        const auto& documents = segment->data->documents;
+        auto doc = std::lower_bound(documents.begin(), documents.end(), id,
+            [](const Document& d, uint64_t value) { return d.id < value; });
+        if (doc == documents.end() || doc->id != id) continue;
+
+        const size_t position = static_cast<size_t>(doc - documents.begin());
+        if (!segment->IsLive(position)) return;
+
+        auto dead = segment->dead ? std::make_shared<std::vector<bool>>(*segment->dead)
+                                  : std::make_shared<std::vector<bool>>(documents.size(), false);
+        (*dead)[position] = true;
+        segment->dead = std::move(dead);
+        --segment->liveCount;
+        --liveCount_;
+
+        if (segment->liveCount == 0)
+        {
+            segments_.erase(segment);
+        }
+        else if (segment->liveCount * 4 < documents.size())
+        {
+            // Left mostly dead by removals out of age order (a quiet channel's old messages, or
+            // moderation). Rebuild it from what is left, together with the next segment if they fit.
+            auto next = std::next(segment);
+            const bool merge = next != segments_.end() && segment->liveCount + next->liveCount <= SEGMENT_SIZE;
+
+            std::vector<Document> live;
+            live.reserve(segment->liveCount + (merge ? next->liveCount : 0));
+            for (auto part = segment; part != (merge ? std::next(next) : next); ++part)
+            {
+                for (size_t i = 0; i < part->data->documents.size(); ++i)
+                {
+                    if (part->IsLive(i)) live.push_back(part->data->documents[i]);
+                }
+            }
+            *segment = Build(std::move(live));
+            if (merge) segments_.erase(next);
+        }
+        return;
+    }
+}
+
+void ChatSearchIndex::View::QuerySegment(const Segment& segment, std::string_view folded, const std::vector<uint32_t>& trigrams,
+                                         size_t maxHits, std::vector<uint64_t>& hits)
+{
+    const auto& documents = segment.data->documents;
+    size_t found = 0;
+
+    // Queries shorter than a trigram cannot use the postings; scan the documents newest-first instead.
+    if (trigrams.empty())
+    {
+        for (size_t i = documents.size(); i-- > 0 && found < maxHits;)
+        {
+            if (segment.IsLive(i) && documents[i].folded.find(folded) != std::string::npos)
+            {
+                hits.push_back(documents[i].id);
+                ++found;
+            }
+        }
+        return;
+    }
+
+    std::vector<const std::vector<uint32_t>*> lists;
+    lists.reserve(trigrams.size());
+    for (uint32_t trigram : trigrams)
+    {
+        auto posting = segment.data->postings.find(trigram);
+        if (posting == segment.data->postings.end()) return;
+        lists.push_back(&posting->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+    // Walk the shortest posting list newest-first while the other lists follow with
+    // backward cursors, so the intersection is a single merge pass. Candidates are
+    // then verified against the folded text since trigram order is not indexed.
+    std::vector<size_t> cursors;
+    cursors.reserve(lists.size());
+    for (const auto* positions : lists) cursors.push_back(positions->size());
+
+    const auto& shortest = *lists.front();
+    for (auto it = shortest.rbegin(); it != shortest.rend() && found < maxHits; ++it)
+    {
+        const uint32_t position = *it;
+        bool inAll = true;
+        for (size_t l = 1; l < lists.size() && inAll; ++l)
+        {
+            const auto& positions = *lists[l];
+            size_t& cursor = cursors[l];
+            while (cursor > 0 && positions[cursor - 1] > position) --cursor;
+            inAll = cursor > 0 && positions[cursor - 1] == position;
+        }
+        if (!inAll || !segment.IsLive(position)) continue;
+
+        if (documents[position].folded.find(folded) != std::string::npos)
+        {
+            hits.push_back(documents[position].id);
+            ++found;
+        }
+    }
+}
+
+std::vector<uint64_t> ChatSearchIndex::View::Query(std::string_view query, size_t maxHits) const
+{
+    std::vector<uint64_t> hits;
+    if (query.empty() || maxHits == 0) return hits;
+
+    const std::string folded = Fold(query);
+    std::vector<uint32_t> trigrams;
+    CollectTrigrams(folded, trigrams);
+
+    // Each part contributes its own newest hits; the newest of those overall are the answer.
+    for (const auto& doc : recent_)
+    {
+        if (doc->folded.find(folded) != std::string::npos) hits.push_back(doc->id);
+    }
+
+    // Segments are mostly in id order already (scrollback pages are the exception), so visiting
+    // the newest first lets the rest be skipped once they can no longer place a hit.
+    std::vector<const Segment*> order;
+    order.reserve(segments_.size());
+    for (const Segment& segment : segments_) order.push_back(&segment);
+    std::sort(order.begin(), order.end(), [](const Segment* a, const Segment* b) {
+        return a->data->documents.back().id > b->data->documents.back().id;
+    });
+
+    for (const Segment* segment : order)
+    {
+        if (hits.size() >= maxHits)
+        {
+            std::nth_element(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(maxHits - 1), hits.end(), std::greater<>());
+            hits.resize(maxHits);
+            if (segment->data->documents.back().id < hits.back()) break;
+        }
+        QuerySegment(*segment, folded, trigrams, maxHits, hits);
+    }
+
+    std::sort(hits.begin(), hits.end(), std::greater<>());
+    if (hits.size() > maxHits) hits.resize(maxHits);
+    return hits;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ChatMessage.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Incremental trigram index over message text and user names.
+ *
+ * Documents are added and removed as messages enter and leave the history,
+ * so queries never rescan the stored messages. Matching is a case-insensitive
+ * substring match (ASCII folding, other UTF-8 bytes compared as-is).
+ *
+ * The index is a chain of immutable Views: every change builds a new View that
+ * shares all untouched parts with the previous one, so a View can be handed to
+ * other threads and queried there without a lock while the writer moves on.
+ */
+class ChatSearchIndex
+{
+public:
+    class View;
+
+    ChatSearchIndex();
+
+    void Add(const ChatMessage& message);
+    void Remove(const ChatMessage& message);
+    void Clear();
+
+    // Returns the ids of matching messages, newest first.
+    std::vector<uint64_t> Query(std::string_view query, size_t maxHits) const;
+
+    size_t Size() const;
+
+    // Current state of the index. Never modified; safe to query from any thread.
+    const std::shared_ptr<const View>& Current() const { return view_; }
+
+private:
+    std::shared_ptr<const View> view_;
+};
+
+class ChatSearchIndex::View
+{
+public:
+    // Returns the ids of matching messages, newest first.
+    std::vector<uint64_t> Query(std::string_view query, size_t maxHits) const;
+
+    size_t Size() const { return liveCount_; }
+
+private:
+    friend class ChatSearchIndex;
+
+    struct Document
+    {
+        uint64_t id;
+        std::string folded; // "user\ntext", used to verify trigram candidates
+    };
+
+    // Documents sorted by id with their postings (trigram -> document positions, ascending).
+    // Shared between Views and never modified once built.
+    struct SegmentData
+    {
+        std::vector<Document> documents;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+    };
+
+    // Removal only marks a document dead in a copy of the segment's dead flags. History evicts
+    // oldest first, so old segments mostly die whole and are dropped without a rebuild.
+    struct Segment
+    {
+        std::shared_ptr<const SegmentData> data;
+        std::shared_ptr<const std::vector<bool>> dead; // nullptr while every document is live
+        size_t liveCount = 0;
+
+        bool IsLive(size_t position) const { return !dead || !(*dead)[position]; }
+    };
+
+    // Newest documents are kept unindexed until there are enough of them to seal a segment;
+    // a View copies only these pointers and the segment handles, never the postings.
+    static constexpr size_t SEGMENT_SIZE = 64;
+
+    std::vector<Segment> segments_;
+    std::vector<std::shared_ptr<const Document>> recent_;
+    size_t liveCount_ = 0;
+
+    static std::string Fold(std::string_view text);
+    static void CollectTrigrams(std::string_view folded, std::vector<uint32_t>& out);
+    static Segment Build(std::vector<Document> documents);
+    static void QuerySegment(const Segment& segment, std::string_view folded, const std::vector<uint32_t>& trigrams,
+                             size_t maxHits, std::vector<uint64_t>& hits);
+
+    void Add(const ChatMessage& message);
+    void Remove(uint64_t id);
+    void Seal();
+};
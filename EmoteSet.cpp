@@ -0,0 +1,472 @@
+#include "pch.h"
+#include "EmoteSet.h"
+#include "GlyphCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+// ImGui compiles stb_rect_pack privately into imgui_draw.cpp, so this file has its own copy.
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "IMGUI/imstb_rectpack.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <objbase.h>
+#include <wincodec.h>
+#include <wrl/client.h>
+
+// Parenthesized (std::min) below, in case windows.h was included without NOMINMAX.
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    constexpr int PADDING = 1; // Transparent pixels around each frame, so sampling never bleeds
+    constexpr UINT DEFAULT_DELAY_MS = 100; // For GIF frames that ask for none, as browsers do
+
+    struct DecodedFrame
+    {
+        std::vector<uint32_t> pixels; // width * height RGBA
+        UINT delayMs = 0;
+    };
+
+    UINT ReadMetadata(IWICMetadataQueryReader* reader, const wchar_t* name, UINT fallback)
+    {
+        if (!reader) return fallback;
+        PROPVARIANT value;
+        PropVariantInit(&value);
+        UINT result = fallback;
+        if (SUCCEEDED(reader->GetMetadataByName(name, &value)))
+        {
+            if (value.vt == VT_UI1) result = value.bVal;
+            else if (value.vt == VT_UI2) result = value.uiVal;
+        }
+        PropVariantClear(&value);
+        return result;
+    }
+
+    // Scales a straight-alpha canvas to width x height. Scaling is done premultiplied, so
+    // the colour of transparent pixels does not fringe the edges.
+    bool Scale(IWICImagingFactory* factory, std::vector<uint32_t>& canvas, UINT canvasWidth, UINT canvasHeight,
+        int width, int height, std::vector<uint32_t>& out)
+    {
+        for (uint32_t& pixel : canvas)
+        {
+            const uint32_t alpha = pixel >> 24;
+            if (alpha == 255) continue;
+            const uint32_t r = (pixel & 0xFF) * alpha / 255;
+            const uint32_t g = ((pixel >> 8) & 0xFF) * alpha / 255;
+            const uint32_t b = ((pixel >> 16) & 0xFF) * alpha / 255;
+            pixel = (alpha << 24) | (b << 16) | (g << 8) | r;
+        }
+
+        ComPtr<IWICBitmap> bitmap;
+        ComPtr<IWICBitmapScaler> scaler;
+        if (FAILED(factory->CreateBitmapFromMemory(canvasWidth, canvasHeight, GUID_WICPixelFormat32bppPRGBA, canvasWidth * 4,
+                static_cast<UINT>(canvas.size() * 4), reinterpret_cast<BYTE*>(canvas.data()), &bitmap)) ||
+            FAILED(factory->CreateBitmapScaler(&scaler)) ||
+            FAILED(scaler->Initialize(bitmap.Get(), static_cast<UINT>(width), static_cast<UINT>(height), WICBitmapInterpolationModeFant)))
+        {
+            return false;
+        }
+        out.resize(static_cast<size_t>(width) * height);
+        if (FAILED(scaler->CopyPixels(nullptr, static_cast<UINT>(width) * 4, static_cast<UINT>(out.size() * 4), reinterpret_cast<BYTE*>(out.data()))))
+        {
+            return false;
+        }
+
+        for (uint32_t& pixel : out)
+        {
+            const uint32_t alpha = pixel >> 24;
+            if (alpha == 255) continue;
+            if (alpha == 0)
+            {
+                pixel = 0x00FFFFFFu;
+                continue;
+            }
+            const uint32_t r = (std::min)(255u, (pixel & 0xFF) * 255 / alpha);
+            const uint32_t g = (std::min)(255u, ((pixel >> 8) & 0xFF) * 255 / alpha);
+            const uint32_t b = (std::min)(255u, ((pixel >> 16) & 0xFF) * 255 / alpha);
+            pixel = (alpha << 24) | (b << 16) | (g << 8) | r;
+        }
+        return true;
+    }
+
+    // Decodes an image, or each frame of an animated GIF composed onto its canvas, scaled to
+    // `height` pixels high. Returns the scaled width, or 0 if the file could not be read.
+    int Decode(IWICImagingFactory* factory, const std::filesystem::path& file, int height, std::vector<DecodedFrame>& frames)
+    {
+        ComPtr<IWICBitmapDecoder> decoder;
+        if (FAILED(factory->CreateDecoderFromFilename(file.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder))) return 0;
+
+        UINT frameCount = 0;
+        GUID container{};
+        if (FAILED(decoder->GetFrameCount(&frameCount)) || frameCount == 0) return 0;
+        decoder->GetContainerFormat(&container);
+        const bool animated = container == GUID_ContainerFormatGif && frameCount > 1;
+        frameCount = (std::min<UINT>)(frameCount, static_cast<UINT>(EmoteSet::MAX_FRAMES));
+
+        UINT canvasWidth = 0, canvasHeight = 0;
+        ComPtr<IWICBitmapFrameDecode> first;
+        if (FAILED(decoder->GetFrame(0, &first)) || FAILED(first->GetSize(&canvasWidth, &canvasHeight))) return 0;
+        if (animated)
+        {
+            ComPtr<IWICMetadataQueryReader> reader;
+            decoder->GetMetadataQueryReader(&reader);
+            canvasWidth = ReadMetadata(reader.Get(), L"/logscrdesc/Width", canvasWidth);
+            canvasHeight = ReadMetadata(reader.Get(), L"/logscrdesc/Height", canvasHeight);
+        }
+        if (canvasWidth == 0 || canvasHeight == 0) return 0;
+
+        const int width = std::clamp(static_cast<int>(std::lround(static_cast<double>(canvasWidth) * height / canvasHeight)), 1,
+            height * EmoteSet::MAX_ASPECT);
+
+        std::vector<uint32_t> canvas(static_cast<size_t>(canvasWidth) * canvasHeight, 0);
+        std::vector<uint32_t> previous;
+        std::vector<uint32_t> pixels;
+        for (UINT index = 0; index < frameCount; ++index)
+        {
+            ComPtr<IWICBitmapFrameDecode> frame;
+            ComPtr<IWICFormatConverter> converter;
+            UINT frameWidth = 0, frameHeight = 0;
+            if (FAILED(decoder->GetFrame(index, &frame)) || FAILED(frame->GetSize(&frameWidth, &frameHeight)) ||
+                FAILED(factory->CreateFormatConverter(&converter)) ||
+                FAILED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom)))
+            {
+                break;
+            }
+            pixels.resize(static_cast<size_t>(frameWidth) * frameHeight);
+            if (FAILED(converter->CopyPixels(nullptr, frameWidth * 4, static_cast<UINT>(pixels.size() * 4), reinterpret_cast<BYTE*>(pixels.data())))) break;
+
+            DecodedFrame decoded;
+            UINT disposal = 0, left = 0, top = 0;
+            if (animated)
+            {
+                ComPtr<IWICMetadataQueryReader> reader;
+                frame->GetMetadataQueryReader(&reader);
+                left = ReadMetadata(reader.Get(), L"/imgdesc/Left", 0);
+                top = ReadMetadata(reader.Get(), L"/imgdesc/Top", 0);
+                disposal = ReadMetadata(reader.Get(), L"/grctlext/Disposal", 0);
+                const UINT delay = ReadMetadata(reader.Get(), L"/grctlext/Delay", 0) * 10;
+                decoded.delayMs = delay >= 20 ? delay : DEFAULT_DELAY_MS;
+
+                // GIF frames only hold the part that changed; compose them the way a browser does.
+                if (disposal == 3) previous = canvas;
+                for (UINT y = 0; y < frameHeight && top + y < canvasHeight; ++y)
+                {
+                    for (UINT x = 0; x < frameWidth && left + x < canvasWidth; ++x)
+                    {
+                        const uint32_t pixel = pixels[static_cast<size_t>(y) * frameWidth + x];
+                        if (pixel >> 24) canvas[static_cast<size_t>(top + y) * canvasWidth + left + x] = pixel;
+                    }
+                }
+                pixels = canvas;
+            }
+            else if (frameWidth != canvasWidth || frameHeight != canvasHeight)
+            {
+                break;
+            }
+
+            const UINT pixelsWidth = animated ? canvasWidth : frameWidth;
+            const UINT pixelsHeight = animated ? canvasHeight : frameHeight;
+            if (!Scale(factory, pixels, pixelsWidth, pixelsHeight, width, height, decoded.pixels)) break;
+            frames.push_back(std::move(decoded));
+
+            if (disposal == 2 && left < canvasWidth)
+            {
+                for (UINT y = top; y < top + frameHeight && y < canvasHeight; ++y)
+                {
+                    std::fill_n(canvas.begin() + static_cast<size_t>(y) * canvasWidth + left, (std::min)(frameWidth, canvasWidth - left), 0u);
+                }
+            }
+            else if (disposal == 3)
+            {
+                canvas = std::move(previous);
+            }
+            if (!animated) break;
+        }
+        return frames.empty() ? 0 : width;
+    }
+}
+
+EmoteSet::EmoteSet(const std::filesystem::path& folder, int heightPixels, int atlasWidth, int atlasHeight) :
+    atlasWidth_(atlasWidth), atlasHeight_(atlasHeight)
+{
+    // Named by file; of two files with the same name the first in directory order wins.
+    std::vector<std::pair<std::string, std::filesystem::path>> found;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(folder, error))
+    {
+        if (!entry.is_regular_file(error)) continue;
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (extension != ".png" && extension != ".gif" && extension != ".jpg" && extension != ".jpeg" && extension != ".bmp") continue;
+
+        std::string name = entry.path().stem().string();
+        if (name.empty() || name.size() > MAX_NAME_LENGTH || !std::all_of(name.begin(), name.end(), IsNameByte))
+        {
+            WARNLOG("Skipping emote {}: names are up to {} letters, digits, '_' or '-'", entry.path().filename().string(), MAX_NAME_LENGTH);
+            continue;
+        }
+        found.emplace_back(std::move(name), entry.path());
+    }
+    std::stable_sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    found.erase(std::unique(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), found.end());
+    if (found.size() > MAX_EMOTES)
+    {
+        WARNLOG("Only the first {} of {} emotes are used", MAX_EMOTES, found.size());
+        found.resize(MAX_EMOTES);
+    }
+
+    std::vector<std::filesystem::path> files;
+    for (auto& [name, path] : found)
+    {
+        names_.push_back(std::move(name));
+        files.push_back(std::move(path));
+    }
+    Build(names_, 0, names_.size(), 0);
+
+    if (!files.empty()) {
+        worker_ = std::thread(&EmoteSet::Run, this, std::move(files), heightPixels);
+    }
+}
+
+EmoteSet::~EmoteSet()
+{
+    stopping_ = true;
+    if (worker_.joinable()) worker_.join();
+}
+
+bool EmoteSet::IsNameByte(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-';
+}
+
+uint32_t EmoteSet::Build(const std::vector<std::string>& sorted, size_t begin, size_t end, size_t depth)
+{
+    const uint32_t node = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    if (begin < end && sorted[begin].size() == depth) {
+        nodes_[node].emote = static_cast<int32_t>(begin++); // Sorts ahead of the names it prefixes
+    }
+
+    // The names sharing each next byte are a contiguous run, since the list is sorted.
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t i = begin; i < end;)
+    {
+        size_t j = i + 1;
+        while (j < end && sorted[j][depth] == sorted[i][depth]) ++j;
+        runs.emplace_back(i, j);
+        i = j;
+    }
+
+    const uint32_t firstEdge = static_cast<uint32_t>(edges_.size());
+    nodes_[node].firstEdge = firstEdge;
+    nodes_[node].edgeCount = static_cast<uint32_t>(runs.size());
+    edges_.resize(edges_.size() + runs.size());
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        edges_[firstEdge + i].byte = sorted[runs[i].first][depth];
+        const uint32_t child = Build(sorted, runs[i].first, runs[i].second, depth + 1);
+        edges_[firstEdge + i].node = child;
+    }
+    return node;
+}
+
+uint32_t EmoteSet::Child(uint32_t node, char byte) const
+{
+    const Node& parent = nodes_[node];
+    const auto begin = edges_.begin() + parent.firstEdge;
+    const auto end = begin + parent.edgeCount;
+    const auto it = std::lower_bound(begin, end, byte, [](const Edge& edge, char value) { return edge.byte < value; });
+    return it != end && it->byte == byte ? it->node : NO_NODE;
+}
+
+void EmoteSet::Resolve(std::string_view text, std::vector<EmoteSpan>& out) const
+{
+    if (names_.empty()) return;
+
+    // Spans are stored in 16 bits; sanitized messages are far shorter than that.
+    text = text.substr(0, UINT16_MAX);
+    size_t colon = text.find(':');
+    while (colon != std::string_view::npos)
+    {
+        uint32_t node = 0;
+        size_t i = colon + 1;
+        while (i < text.size() && text[i] != ':' && node != NO_NODE)
+        {
+            node = Child(node, text[i++]);
+        }
+        if (node != NO_NODE && i < text.size() && nodes_[node].emote >= 0)
+        {
+            out.push_back({ static_cast<uint16_t>(colon), static_cast<uint16_t>(i + 1), static_cast<uint16_t>(nodes_[node].emote) });
+            colon = text.find(':', i + 1);
+        }
+        else
+        {
+            // The closing colon of a failed match may open the next one: "ratio:smile:".
+            colon = text.find(':', colon + 1);
+        }
+    }
+}
+
+void EmoteSet::Run(std::vector<std::filesystem::path> files, int heightPixels)
+{
+    const auto started = std::chrono::steady_clock::now();
+    const bool com = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+    ComPtr<IWICImagingFactory> factory;
+    if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+    {
+        WARNLOG("Could not create the WIC imaging factory; emotes are shown as text.");
+        if (com) CoUninitialize();
+        return;
+    }
+
+    Decoded decoded;
+    decoded.images.resize(files.size());
+    std::vector<std::vector<DecodedFrame>> frames(files.size());
+    std::vector<stbrp_rect> rects;
+    for (size_t emote = 0; emote < files.size() && !stopping_; ++emote)
+    {
+        const int width = Decode(factory.Get(), files[emote], heightPixels, frames[emote]);
+        if (width == 0)
+        {
+            WARNLOG("Could not decode emote {}", files[emote].filename().string());
+            continue;
+        }
+        decoded.images[emote].width = width;
+        decoded.images[emote].height = heightPixels;
+        for (size_t frame = 0; frame < frames[emote].size(); ++frame)
+        {
+            stbrp_rect rect{};
+            rect.id = static_cast<int>(rects.size());
+            rect.w = static_cast<stbrp_coord>(width + 2 * PADDING);
+            rect.h = static_cast<stbrp_coord>(heightPixels + 2 * PADDING);
+            rects.push_back(rect);
+        }
+    }
+    factory.Reset();
+    if (com) CoUninitialize();
+    if (stopping_) return;
+
+    std::vector<stbrp_node> nodes(static_cast<size_t>(atlasWidth_));
+    stbrp_context context{};
+    stbrp_init_target(&context, atlasWidth_, atlasHeight_, nodes.data(), static_cast<int>(nodes.size()));
+    if (!rects.empty()) stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+    std::sort(rects.begin(), rects.end(), [](const stbrp_rect& a, const stbrp_rect& b) { return a.id < b.id; });
+
+    // An emote is only usable with every one of its frames placed.
+    decoded.atlas.assign(static_cast<size_t>(atlasWidth_) * atlasHeight_, 0x00FFFFFFu);
+    size_t next = 0;
+    for (size_t emote = 0; emote < files.size(); ++emote)
+    {
+        Image& image = decoded.images[emote];
+        const size_t count = frames[emote].size();
+        const bool placed = std::all_of(rects.begin() + next, rects.begin() + next + count, [](const stbrp_rect& rect) { return rect.was_packed != 0; });
+        if (count > 0 && !placed) {
+            WARNLOG("Emote {} does not fit in the emote atlas", names_[emote]);
+        }
+
+        uint32_t elapsedMs = 0;
+        for (size_t frame = 0; placed && frame < count; ++frame)
+        {
+            const stbrp_rect& rect = rects[next + frame];
+            const DecodedFrame& source = frames[emote][frame];
+            const int x = rect.x + PADDING;
+            const int y = rect.y + PADDING;
+            for (int row = 0; row < image.height; ++row)
+            {
+                std::copy_n(source.pixels.begin() + static_cast<size_t>(row) * image.width, image.width,
+                    decoded.atlas.begin() + static_cast<size_t>(y + row) * atlasWidth_ + x);
+            }
+            elapsedMs += source.delayMs;
+            image.frames.push_back({ x, y, elapsedMs });
+        }
+        next += count;
+    }
+
+    size_t placed = 0;
+    for (const Image& image : decoded.images) placed += image.frames.empty() ? 0 : 1;
+    LOG("Emotes: {} of {} ready in {} ms", placed, files.size(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    result_ = std::move(decoded);
+    decoded_.store(true, std::memory_order_release);
+}
+
+void EmoteSet::BeginFrame(GlyphCache& glyphs, double time)
+{
+    if (!uploaded_)
+    {
+        if (!decoded_.load(std::memory_order_acquire)) return;
+        Decoded decoded;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decoded = std::move(result_);
+        }
+        uploaded_ = true;
+        if (!glyphs.UploadImage(0, 0, atlasWidth_, atlasHeight_, decoded.atlas.data()))
+        {
+            WARNLOG("Could not upload the emote atlas; emotes are shown as text.");
+            return;
+        }
+
+        images_ = std::move(decoded.images);
+        sprites_.resize(images_.size());
+        for (size_t emote = 0; emote < images_.size(); ++emote)
+        {
+            const Image& image = images_[emote];
+            if (image.frames.empty()) continue;
+            sprites_[emote].size = ImVec2(static_cast<float>(image.width), static_cast<float>(image.height));
+            SetFrame(glyphs, emote, image.frames.front());
+            if (image.frames.size() > 1) animated_.push_back(static_cast<uint16_t>(emote));
+        }
+    }
+
+    // One clock for every animated emote, whichever messages show it.
+    const uint64_t nowMs = static_cast<uint64_t>(time * 1000.0);
+    for (uint16_t emote : animated_)
+    {
+        const std::vector<Frame>& frames = images_[emote].frames;
+        const uint32_t offset = static_cast<uint32_t>(nowMs % frames.back().endMs);
+        const auto frame = std::upper_bound(frames.begin(), frames.end(), offset, [](uint32_t value, const Frame& f) { return value < f.endMs; });
+        SetFrame(glyphs, emote, frame != frames.end() ? *frame : frames.back());
+    }
+}
+
+void EmoteSet::SetFrame(GlyphCache& glyphs, size_t emote, const Frame& frame)
+{
+    Sprite& sprite = sprites_[emote];
+    sprite.uv0 = glyphs.ImageUv(static_cast<float>(frame.x), static_cast<float>(frame.y));
+    sprite.uv1 = glyphs.ImageUv(frame.x + sprite.size.x, frame.y + sprite.size.y);
+}
+
+const EmoteSet::Sprite* EmoteSet::Get(uint16_t emote) const
+{
+    if (emote >= images_.size() || images_[emote].frames.empty()) return nullptr;
+    return &sprites_[emote];
+}
+
+EmoteSet::Stats EmoteSet::GetStats() const
+{
+    Stats stats;
+    stats.emotes = names_.size();
+    stats.ready = !images_.empty();
+    stats.animated = animated_.size();
+    for (const Image& image : images_)
+    {
+        stats.frames += image.frames.size();
+        stats.missing += image.frames.empty() ? 1 : 0;
+    }
+    return stats;
+}
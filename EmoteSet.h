@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ChatMessage.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class GlyphCache;
+
+/**
+ * @brief Chat emotes: the images in a folder, each written in messages as :filename:.
+ *
+ * Shortcodes are resolved once per message at ingest, against a trie of the names built
+ * when the set is created and read-only after that, so any thread can resolve. The images
+ * are decoded on a worker thread with WIC (animated GIFs frame by frame), scaled to the
+ * chat line height and packed with stb_rect_pack into the glyph cache's image region. An
+ * emote is then just a quad in the texture the chat font draws from, and joins the draw
+ * call of the text around it.
+ *
+ * Animated emotes share one clock: BeginFrame picks the current frame of each once per
+ * frame, and every copy on screen draws that frame.
+ */
+class EmoteSet
+{
+public:
+    static constexpr size_t MAX_EMOTES = 1024;
+    static constexpr size_t MAX_NAME_LENGTH = 32;
+    static constexpr size_t MAX_FRAMES = 64; // Per emote; longer animations are cut short
+    static constexpr int MAX_ASPECT = 3; // Wider images are squeezed to this many line heights
+
+    struct Sprite
+    {
+        ImVec2 size; // Pixels
+        ImVec2 uv0, uv1; // Of the frame drawn this frame
+    };
+
+    struct Stats
+    {
+        size_t emotes = 0;
+        size_t animated = 0;
+        size_t frames = 0;
+        size_t missing = 0; // Could not be decoded, or did not fit in the atlas
+        bool ready = false;
+    };
+
+    // Lists the folder's images; decoding starts right away on the worker.
+    EmoteSet(const std::filesystem::path& folder, int heightPixels, int atlasWidth, int atlasHeight);
+    ~EmoteSet();
+
+    EmoteSet(const EmoteSet&) = delete;
+    EmoteSet& operator=(const EmoteSet&) = delete;
+
+    // Any thread: appends the shortcodes in the text that name an emote, in order.
+    void Resolve(std::string_view text, std::vector<EmoteSpan>& out) const;
+
+    size_t Count() const { return names_.size(); }
+    const std::vector<std::string>& Names() const { return names_; }
+
+    // Render thread, once per frame after the glyph cache has its texture: uploads the
+    // atlas once decoding is done, and advances animations to `time` (seconds).
+    void BeginFrame(GlyphCache& glyphs, double time);
+
+    // Render thread: the emote as drawn this frame, or nullptr while it has no image.
+    const Sprite* Get(uint16_t emote) const;
+
+    // Render thread.
+    Stats GetStats() const;
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    struct Node
+    {
+        uint32_t firstEdge = 0;
+        uint32_t edgeCount = 0;
+        int32_t emote = -1; // Set when a name ends here
+    };
+
+    struct Edge
+    {
+        char byte = 0;
+        uint32_t node = NO_NODE;
+    };
+
+    struct Frame
+    {
+        int x = 0, y = 0; // In the atlas
+        uint32_t endMs = 0; // Offset of the frame's end from the start of the animation
+    };
+
+    struct Image
+    {
+        int width = 0, height = 0;
+        std::vector<Frame> frames; // Empty when it could not be placed
+    };
+
+    // What the worker hands to the render thread.
+    struct Decoded
+    {
+        std::vector<Image> images;
+        std::vector<uint32_t> atlas; // atlasWidth_ * atlasHeight_ RGBA
+    };
+
+    static bool IsNameByte(char c);
+    uint32_t Build(const std::vector<std::string>& sorted, size_t begin, size_t end, size_t depth);
+    uint32_t Child(uint32_t node, char byte) const;
+
+    void Run(std::vector<std::filesystem::path> files, int heightPixels);
+    void SetFrame(GlyphCache& glyphs, size_t emote, const Frame& frame);
+
+    std::vector<std::string> names_; // Indexed by emote
+    std::vector<Node> nodes_; // Root first
+    std::vector<Edge> edges_; // Each node's sorted by byte
+    int atlasWidth_ = 0;
+    int atlasHeight_ = 0;
+
+    // Shared with the worker.
+    std::mutex mutex_;
+    std::atomic<bool> stopping_{ false };
+    std::atomic<bool> decoded_{ false };
+    Decoded result_;
+    std::thread worker_;
+
+    // Render thread only.
+    bool uploaded_ = false;
+    std::vector<Image> images_;
+    std::vector<Sprite> sprites_;
+    std::vector<uint16_t> animated_;
+};
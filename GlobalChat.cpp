@@ -1,13 +1,88 @@
 #include "pch.h"
 #include "GlobalChat.h"
+#include "Benchmarks.h"
+#include "TextSanitizer.h"
+#include "WireFormat.h"
 #include "bakkesmod/wrappers/GameEvent/ServerWrapper.h"
 #include "bakkesmod/wrappers/MMRWrapper.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <random>
+
 BAKKESMOD_PLUGIN(GlobalChat, "Global Chat", plugin_version, PLUGINTYPE_FREEPLAY)
 
 std::shared_ptr<CVarManagerWrapper> _globalCvarManager;
 HMODULE g_BM_ModuleHandle;
 
+namespace
+{
+    bool SameMessage(const ChatMessage& a, const ChatMessage& b)
+    {
+        return a.user == b.user && a.text == b.text && a.platform == b.platform;
+    }
+
+    /**
+     * @brief Makes the displayed fields of a message from the server safe to draw as
+     * they are. Channel names are left alone: they are keys the server matches on.
+     */
+    void SanitizeIncoming(ChatMessage& message)
+    {
+        bool changed = TextSanitizer::Sanitize(message.text, TextSanitizer::MAX_TEXT_CODEPOINTS);
+        changed |= TextSanitizer::Sanitize(message.user, TextSanitizer::MAX_NAME_CODEPOINTS);
+        changed |= TextSanitizer::Sanitize(message.platform, TextSanitizer::MAX_NAME_CODEPOINTS);
+        if (changed) {
+            GetMetrics().sanitizedMessages.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Reads the messages of one channel from a history frame. Text frames carry
+     * each message as an embedded JSON string, binary frames as a map.
+     */
+    std::vector<ChatMessage> ParseHistoryEntries(json& entries, const std::string& channel)
+    {
+        std::vector<ChatMessage> messages;
+        messages.reserve(entries.size());
+        for (auto& entry : entries)
+        {
+            if (entry.is_string()) {
+                entry = json::parse(entry.get<std::string>());
+            }
+            else {
+                WireFormat::ExpandKeys(entry);
+            }
+            ChatMessage message = WireFormat::ParseChatMessage(entry);
+            message.channel = channel;
+            SanitizeIncoming(message);
+            messages.push_back(std::move(message));
+        }
+        return messages;
+    }
+
+    /**
+     * @brief Splits "host[:port][/path]" into its parts; missing parts keep their values.
+     */
+    void ParseEndpoint(const std::string& endpoint, std::string& host, std::string& port, std::string& target)
+    {
+        std::string authority = endpoint;
+        const auto slash = authority.find('/');
+        if (slash != std::string::npos) {
+            target = authority.substr(slash);
+            authority.resize(slash);
+        }
+        const auto colon = authority.find(':');
+        if (colon != std::string::npos) {
+            port = authority.substr(colon + 1);
+            authority.resize(colon);
+        }
+        if (!authority.empty()) host = authority;
+    }
+}
+
 // DLL Entry Point
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved)
 {
@@ -22,29 +97,174 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserv
  */
 void GlobalChat::onLoad()
 {
+    loadStartTime = std::chrono::steady_clock::now();
     _globalCvarManager = cvarManager;
     moduleHandle_ = g_BM_ModuleHandle;
     LOG("GlobalChat Plugin Loaded!");
 
-    lastMessageTime = std::chrono::steady_clock::now() - std::chrono::seconds(2);
+    Benchmarks::Register(cvarManager);
+
+    cvarManager->registerCvar("globalchat_binary_log", "0", "Also write log records, unformatted, to globalchat/logs/globalchat.gclog", true, true, 0, true, 1, true);
+    if (cvarManager->getCvar("globalchat_binary_log").getBoolValue()) {
+        OpenBinaryLog(gameWrapper->GetDataFolder() / "globalchat" / "logs" / "globalchat.gclog");
+    }
+    cvarManager->registerCvar("globalchat_binary_protocol", "1", "Offer the MessagePack wire format to the server (applies on next load)", true, true, 0, true, 1, true);
+    const bool offerBinaryProtocol = cvarManager->getCvar("globalchat_binary_protocol").getBoolValue();
+
+    // LOG only queues records; they are formatted and printed in batches on the game thread.
+    gameWrapper->HookEvent("Function Engine.GameViewportClient.Tick", [this](std::string) {
+        RefreshPlayerInfo();
+        UpdateSubscriptions();
+        ExpirePendingSends();
+        FlushLog();
+    });
+
+    std::random_device random;
+    char prefix[17];
+    std::snprintf(prefix, sizeof(prefix), "%08x%08x", random(), random());
+    clientIdPrefix = prefix;
+
+    cvarManager->registerNotifier("globalchat_metrics", [](std::vector<std::string> args) {
+        if (args.size() > 1 && args[1] == "reset") {
+            GetMetrics().Reset();
+            LOG("Global Chat metrics reset.");
+            return;
+        }
+        for (const auto& line : GetMetrics().Describe()) {
+            CONSOLELOG("[metrics] {}", line);
+        }
+    }, "Print Global Chat connection metrics (globalchat_metrics [reset])", PERMISSION_ALL);
+
+    cvarManager->registerNotifier("globalchat_stress", [this](std::vector<std::string> args) {
+        if (args.size() > 1 && args[1] == "stop") {
+            if (stressTest) stressTest->Stop();
+            return;
+        }
+        if (args.size() < 2 || args[1] != "start") {
+            LOG("Usage: globalchat_stress start [rate=200] [channels=8] [text=80] [malformed=1] [errors=0.1] [drop=60] [minutes=10] [binary=0] [filter=0] [typists=0] | stop");
+            return;
+        }
+        if (stressTest && stressTest->IsRunning()) {
+            LOG("A stress run is already in progress; globalchat_stress stop ends it.");
+            return;
+        }
+        if (hasHistoryLog) {
+            LOG("Set globalchat_persist_history 0 and reload first, or the stress messages are written to disk.");
+            return;
+        }
+
+        StressTest::Options options;
+        std::string error;
+        if (!StressTest::Options::Parse(args, 2, options, error)) {
+            LOG("globalchat_stress: {}", error);
+            return;
+        }
+
+        StressTest::Hooks hooks;
+        hooks.post = [this](std::function<void()> task) { return wsManager && wsManager->Post(std::move(task)); };
+        hooks.deliver = [this](std::string_view frame, bool binary) { OnWSMessage(frame, binary); };
+        hooks.disconnect = [this]() { OnWSDisconnect(); };
+        hooks.subscribed = [this](const std::string& channel) { return IsSubscribed(channel); };
+        hooks.typists = [this](const std::string& channel) {
+            std::lock_guard<std::mutex> lock(typingMutex);
+            typists.Expire(std::chrono::steady_clock::now());
+            return typists.Count(channel);
+        };
+        stressTest.reset(); // Joins a finished run before its hooks go away
+        stressTest = std::make_unique<StressTest>(options, std::move(hooks), chatHistory);
+        stressTest->Start();
+    }, "Feed generated server traffic through the message pipeline: globalchat_stress start [key=value...] | stop", PERMISSION_ALL);
+
+    cvarManager->registerCvar("globalchat_pinned_channels", "", "Channels that stay subscribed while not shown, comma-separated", false, false, 0, false, 0, true);
+    cvarManager->registerCvar("globalchat_focused_in_match", "1", "During a match, only receive the channel that is open", true, true, 0, true, 1, true);
+    {
+        const std::string pinned = cvarManager->getCvar("globalchat_pinned_channels").getStringValue();
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        size_t start = 0;
+        while (start < pinned.size()) {
+            size_t end = pinned.find(',', start);
+            if (end == std::string::npos) end = pinned.size();
+            if (end > start) pinnedChannels.insert(pinned.substr(start, end - start));
+            start = end + 1;
+        }
+        ++pinnedGeneration;
+    }
+
+    cvarManager->registerCvar("globalchat_persist_history", "1", "Keep chat history on disk between sessions", true, true, 0, true, 1, true);
+    const bool persistHistory = cvarManager->getCvar("globalchat_persist_history").getBoolValue();
+    const std::filesystem::path historyDirectory = gameWrapper->GetDataFolder() / "globalchat" / "history";
+
+    cvarManager->registerCvar("globalchat_filter", "1", "Filtered words in incoming chat: 0 shows them, 1 masks them, 2 hides the whole message", true, true, 0, true, 2, true);
+    cvarManager->registerCvar("globalchat_filter_words", "", "Filtered words, comma-separated, on top of those in globalchat/filter.txt; '*' at either end also matches inside words", false, false, 0, false, 0, true);
+    chatFilterFile = gameWrapper->GetDataFolder() / "globalchat" / "filter.txt";
+    chatFilterMode = static_cast<ChatFilter::Mode>(cvarManager->getCvar("globalchat_filter").getIntValue());
+    LoadChatFilter();
+    cvarManager->getCvar("globalchat_filter").addOnValueChanged([this](std::string, CVarWrapper cvar) {
+        chatFilterMode = static_cast<ChatFilter::Mode>(cvar.getIntValue());
+    });
+    cvarManager->getCvar("globalchat_filter_words").addOnValueChanged([this](std::string, CVarWrapper) {
+        LoadChatFilter();
+    });
+    cvarManager->registerCvar("globalchat_highlight_words", "", "Words to highlight in chat besides your name, comma-separated; '*' at either end also matches inside words", false, false, 0, false, 0, true);
+    LoadHighlighter();
+    cvarManager->getCvar("globalchat_highlight_words").addOnValueChanged([this](std::string, CVarWrapper) {
+        LoadHighlighter();
+    });
+    cvarManager->registerNotifier("globalchat_filter_reload", [this](std::vector<std::string>) {
+        LoadChatFilter();
+    }, "Reload the filtered words from globalchat/filter.txt", PERMISSION_ALL);
+
+    muteListFile = gameWrapper->GetDataFolder() / "globalchat" / "muted.bin";
+    if (!muteList.Load(muteListFile)) {
+        WARNLOG("Could not read all of the mute list at {}", muteListFile.string());
+    }
+    ++muteGeneration;
+
+    cvarManager->registerCvar("globalchat_fonts", "", "Fonts for chat text, ';'-separated, tried in order for each character; empty uses the Windows defaults (applies on next load)", true, false, 0, false, 0, true);
+    cvarManager->registerCvar("globalchat_font_size", "16", "Chat text size in pixels (applies on next load)", true, true, 8, true, 48, true);
+    glyphCache = std::make_unique<GlyphCache>(FontSet::ResolveFiles(cvarManager->getCvar("globalchat_fonts").getStringValue()),
+        cvarManager->getCvar("globalchat_font_size").getFloatValue());
+    emoteSet = std::make_unique<EmoteSet>(gameWrapper->GetDataFolder() / "globalchat" / "emotes",
+        static_cast<int>(cvarManager->getCvar("globalchat_font_size").getFloatValue() + 0.5f),
+        glyphCache->ImageRegionWidth(), GlyphCache::IMAGE_REGION_HEIGHT);
 
     // Bind the F3 key to toggle the chat window.
     cvarManager->executeCommand("bind " + TOGGLE_KEY + " \"togglemenu \\\"" + GetMenuName() + "\\\"\"");
 
-    // Initialize WebSocket manager and define callbacks
+    // Initialize WebSocket manager and define callbacks. Everything slow (disk warm start,
+    // TLS setup, DNS, handshakes) runs on the network thread so plugin load returns immediately.
     wsManager = std::make_unique<WSManager>();
     WSManager::Callbacks cbs;
+    if (persistHistory) {
+        cbs.on_startup = [this, historyDirectory]() { WarmStartFromDisk(historyDirectory); };
+    }
     cbs.on_connect = [this]() { OnWSConnect(); };
-    cbs.on_message = [this](std::string_view msg) { OnWSMessage(msg); };
+    cbs.on_message = [this](std::string_view msg, bool binary) { OnWSMessage(msg, binary); };
     cbs.on_error = [this](std::string_view err) { OnWSError(err); };
     cbs.on_disconnect = [this]() { OnWSDisconnect(); };
 
-    const std::string host = "purple-oasis-rocket-league-websocket.onrender.com";
-    const std::string port = "443";
-    const std::string target = "/";
+    std::string host = "purple-oasis-rocket-league-websocket.onrender.com";
+    std::string port = "443";
+    std::string target = "/";
+    cvarManager->registerCvar("globalchat_server", "", "Server to use instead of the public one, as host[:port][/path] (applies on next load)", true, false, 0, false, 0, true);
+    const std::string endpoint = cvarManager->getCvar("globalchat_server").getStringValue();
+    if (!endpoint.empty()) {
+        ParseEndpoint(endpoint, host, port, target);
+    }
+    // Only a small window of recent history per channel up front; older pages load on scroll.
+    target += (target.find('?') == std::string::npos ? "?history=" : "&history=") + std::to_string(BOOTSTRAP_HISTORY_PER_CHANNEL);
+
+    if (offerBinaryProtocol) {
+        wsManager->SetSubprotocols({
+            { std::string(WireFormat::JSON_PROTOCOL), false },
+            { std::string(WireFormat::MSGPACK_PROTOCOL), true },
+        });
+    }
 
-    LOG("Connecting to WebSocket server at {}", host);
+    LOG("Connecting to WebSocket server at {}:{}{}", host, port, target);
     wsManager->Connect(host, port, target, moduleHandle_, cbs);
+
+    LOG("onLoad finished in {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStartTime).count());
 }
 
 /**
@@ -54,12 +274,19 @@ void GlobalChat::onUnload()
 {
     cvarManager->executeCommand("unbind " + TOGGLE_KEY);
 
+    // Its frames run on the network thread, so it has to finish before the connection goes.
+    stressTest.reset();
+
     if (wsManager)
     {
         LOG("Disconnecting from WebSocket server...");
         wsManager->Disconnect();
         wsManager.reset();
     }
+    glyphCache.reset(); // After the network thread, which prefetches into it
+    emoteSet.reset(); // Likewise; it resolves shortcodes
+    FlushLog();
+    CloseBinaryLog();
 }
 
 /**
@@ -67,25 +294,78 @@ void GlobalChat::onUnload()
  */
 void GlobalChat::RenderWindow()
 {
+    ScopedLatency renderTimer(GetMetrics().renderTime);
+
+    // Drawn from the published snapshot without taking historyMutex, so the network
+    // thread never waits for a frame to finish.
+    const auto history = chatHistory.GetSnapshot();
+    chatFont = glyphCache ? glyphCache->BeginFrame() : nullptr;
+    if (chatFont && emoteSet) {
+        emoteSet->BeginFrame(*glyphCache, ImGui::GetTime());
+    }
+    if (currentChannel.empty() && !history->channelOrder.empty())
+    {
+        SelectChannel(history->channelOrder[0]);
+    }
+
     ImGui::Columns(2, "ChatLayout", false);
     ImGui::SetColumnWidth(0, 120.0f);
 
     // Left column: Channel list
     ImGui::BeginChild("Channels", ImVec2(0, -ImGui::GetFrameHeightWithSpacing() * 1.5f), true);
-    ImGui::Text("Channels");
+    {
+        const auto& channels = history->channelOrder;
+        int current = static_cast<int>(std::find(channels.begin(), channels.end(), currentChannel) - channels.begin());
+        ImGui::PushItemWidth(-1);
+        if (ImGui::SearchableCombo("##ChannelPicker", &current, &channelPicker, channels.data(), static_cast<int>(channels.size()),
+            static_cast<unsigned int>(history->channelOrderGeneration), "Channels", "Find a channel"))
+        {
+            SelectChannel(channels[current]);
+        }
+        ImGui::PopItemWidth();
+    }
     ImGui::Separator();
-    if (channels.empty())
+    if (history->channelOrder.empty())
     {
         ImGui::Text("Connecting...");
     }
     else
     {
-        for (const auto& channel : channels)
+        // Copied only when they change, so most frames take neither lock.
+        if (const uint64_t generation = pinnedGeneration.load(std::memory_order_acquire); generation != pinnedViewGeneration)
+        {
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            pinnedView = pinnedChannels;
+            pinnedViewGeneration = generation;
+        }
+        if (const uint64_t generation = mentionGeneration.load(std::memory_order_acquire); generation != mentionViewGeneration)
         {
-            if (ImGui::Selectable(channel.c_str(), currentChannel == channel))
+            std::lock_guard<std::mutex> lock(mentionMutex);
+            mentionView = unreadMentions;
+            mentionViewGeneration = generation;
+        }
+        for (const auto& channel : history->channelOrder)
+        {
+            const bool isPinned = pinnedView.count(channel) != 0;
+            std::string label = isPinned ? "* " + channel : channel;
+            const auto mentioned = mentionView.find(channel);
+            if (mentioned != mentionView.end()) {
+                label += " (" + std::to_string(mentioned->second) + ")";
+            }
+            ImGui::PushID(channel.c_str());
+            if (ImGui::Selectable(label.c_str(), currentChannel == channel))
+            {
+                SelectChannel(channel);
+            }
+            if (ImGui::BeginPopupContextItem("ChannelMenu"))
             {
-                currentChannel = channel;
+                if (ImGui::MenuItem(isPinned ? "Unpin (stop receiving while closed)" : "Pin (keep receiving while closed)"))
+                {
+                    SetChannelPinned(channel, !isPinned);
+                }
+                ImGui::EndPopup();
             }
+            ImGui::PopID();
         }
     }
     ImGui::EndChild();
@@ -96,62 +376,82 @@ void GlobalChat::RenderWindow()
     if (!currentChannel.empty())
     {
         ImGui::Text("Channel: %s", currentChannel.c_str());
+        ImGui::SameLine();
+        ImGui::PushItemWidth(-1);
+        ImGui::InputTextWithHint("##Search", "Search all channels", searchBuffer, sizeof(searchBuffer));
+        ImGui::PopItemWidth();
 
-        ImGui::BeginChild("Messages", ImVec2(0, -ImGui::GetFrameHeightWithSpacing() * 1.5f), true);
+        // The typing line is always laid out, so the messages do not jump when it appears.
+        ImGui::BeginChild("Messages", ImVec2(0, -(ImGui::GetFrameHeightWithSpacing() * 1.5f + ImGui::GetTextLineHeightWithSpacing())), true);
+        if (searchBuffer[0] != '\0')
+        {
+            RenderSearchResults();
+        }
+        else
         {
-            std::lock_guard<std::mutex> lock(historyMutex);
-            if (chatHistory.count(currentChannel))
+            const auto* messages = history->GetChannel(currentChannel);
+
+            // Reaching the top fetches the next older page. Right after a channel switch the
+            // scroll position is still the previous channel's, so that frame is skipped.
+            const bool sameChannel = scrollAnchorChannel == currentChannel;
+            const bool atTop = ImGui::GetScrollY() <= 0.0f;
+            bool olderAvailable = true;
+            if (messages && !messages->empty() && sameChannel && atTop && ImGui::IsWindowHovered())
+            {
+                olderAvailable = LoadOlderMessages(currentChannel);
+            }
+            ImGui::TextDisabled(!olderAvailable ? "No older messages" : atTop ? "Loading older messages..." : "Scroll up for older messages");
+
+            float anchorOffset = 0.0f; // How far last frame's first message moved down
+            if (messages)
             {
-                const auto& messages = chatHistory.at(currentChannel);
-                for (const auto& msgJson : messages)
+                const float top = ImGui::GetCursorPosY();
+                for (const auto& message : *messages)
                 {
-                    try
+                    if (sameChannel && message->id == scrollAnchorId && message != messages->front())
                     {
-                        std::string user = msgJson.value("user", "???");
-                        std::string text = msgJson.value("text", "");
-                        int rankTierId = msgJson.value("highest_rank", -1);
-
-                        RankDisplayInfo displayInfo = GetRankDisplayInfo(rankTierId);
-
-                        // Render the colored rank tag
-                        std::string tag = "[" + displayInfo.tag + "]";
-                        ImGui::TextColored(displayInfo.color, "%s", tag.c_str());
-                        ImGui::SameLine();
-
-                        // Render the user's name and message
-                        ImGui::TextColored(displayInfo.color, "%s:", user.c_str());
-                        ImGui::SameLine();
-                        ImGui::TextWrapped("%s", text.c_str());
-                    }
-                    catch (const std::exception& e) {
-                        LOG("Error rendering message: {}", e.what());
+                        anchorOffset = ImGui::GetCursorPosY() - top;
                     }
+                    RenderMessage(*message, false);
                 }
+                scrollAnchorId = messages->empty() ? 0 : messages->front()->id;
             }
+            scrollAnchorChannel = currentChannel;
 
-            if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - 5.0f)
+            if (anchorOffset > 0.0f)
+            {
+                // A page was inserted above; scroll by its height so the same messages stay in view.
+                ImGui::SetScrollY(ImGui::GetScrollY() + anchorOffset);
+            }
+            else if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY() - 5.0f)
             {
                 ImGui::SetScrollHereY(1.0f);
             }
         }
         ImGui::EndChild();
+        RenderTypingIndicator();
 
         // Message input and send button
         size_t messageLen = strlen(inputTextBuffer);
-        auto now = std::chrono::steady_clock::now();
-        auto timeSinceLastMessage = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastMessageTime);
-        bool isOnCooldown = timeSinceLastMessage.count() < 1000;
+        auto cooldown = sendLimiter.TimeUntilNext();
+        bool isOnCooldown = cooldown > std::chrono::steady_clock::duration::zero();
         bool canSendMessage = !isOnCooldown && messageLen > 0;
 
         ImGui::PushItemWidth(-1);
-        if (ImGui::InputText("##MessageInput", inputTextBuffer, sizeof(inputTextBuffer), ImGuiInputTextFlags_EnterReturnsTrue) && canSendMessage)
+        if (chatFont)
+        {
+            ImGui::PushFont(chatFont);
+            glyphCache->Touch(inputTextBuffer);
+        }
+        if (ImGui::InputText("##MessageInput", inputTextBuffer, sizeof(inputTextBuffer), ImGuiInputTextFlags_EnterReturnsTrue) && canSendMessage
+            && SendChatMessage(currentChannel, inputTextBuffer))
         {
-            gameWrapper->Execute([this, channel = currentChannel, message = std::string(inputTextBuffer)](GameWrapper*) {
-                this->SendChatMessage(channel, message);
-                });
             memset(inputTextBuffer, 0, sizeof(inputTextBuffer));
             ImGui::SetKeyboardFocusHere(-2);
         }
+        // A draft left in an unfocused box does not count as typing.
+        UpdateTyping(ImGui::IsItemActive() && inputTextBuffer[0] != '\0');
+        if (chatFont) ImGui::PopFont();
         ImGui::PopItemWidth();
         ImGui::SameLine();
 
@@ -161,17 +461,16 @@ void GlobalChat::RenderWindow()
             ImGui::PushStyleColor(ImGuiCol_ButtonActive, ImVec4(0.5f, 0.5f, 0.5f, 1.0f));
         }
 
-        std::string buttonText = "Send";
+        // "###" keeps the button's id stable while the label counts down.
         if (isOnCooldown) {
-            float remaining = 1.0f - (static_cast<float>(timeSinceLastMessage.count()) / 1000.0f);
-            buttonText = std::to_string(remaining).substr(0, 3) + "s";
+            std::snprintf(sendButtonLabel, sizeof(sendButtonLabel), "%.1fs###Send", std::chrono::duration<float>(cooldown).count());
+        }
+        else {
+            std::snprintf(sendButtonLabel, sizeof(sendButtonLabel), "Send###Send");
         }
 
-        if (ImGui::Button(buttonText.c_str()) && canSendMessage)
+        if (ImGui::Button(sendButtonLabel) && canSendMessage && SendChatMessage(currentChannel, inputTextBuffer))
         {
-            gameWrapper->Execute([this, channel = currentChannel, message = std::string(inputTextBuffer)](GameWrapper*) {
-                this->SendChatMessage(channel, message);
-                });
             memset(inputTextBuffer, 0, sizeof(inputTextBuffer));
             ImGui::SetKeyboardFocusHere(-2);
         }
@@ -192,208 +491,1513 @@ void GlobalChat::RenderWindow()
 }
 
 /**
- * @brief Renders the plugin's settings window in the F2 menu.
+ * @brief Renders a single chat line: rank tag, user name and wrapped text.
+ * @param message The message to render.
+ * @param showChannel Prefix the line with its channel (used for search results).
  */
-void GlobalChat::RenderSettings()
+void GlobalChat::RenderMessage(const ChatMessage& message, bool showChannel)
 {
-    ImGui::TextUnformatted("Global Chat Settings");
-    ImGui::Separator();
-    ImGui::Spacing();
+    RankDisplayInfo displayInfo = GetRankDisplayInfo(message.highestRank);
+    if (chatFont) ImGui::PushFont(chatFont);
 
-    if (ImGui::Button("Toggle Chat Window"))
+    if (showChannel)
     {
-        gameWrapper->Execute([this](GameWrapper* gw) {
-            cvarManager->executeCommand("togglemenu \"" + GetMenuName() + "\"");
-        });
+        ImGui::TextDisabled("#%s", message.channel.c_str());
+        ImGui::SameLine();
     }
 
-    ImGui::Spacing();
+    // Render the colored rank tag
+    ImGui::TextColored(displayInfo.color, "[%s]", displayInfo.tag.c_str());
+    ImGui::SameLine();
 
-    ImGui::Text("Toggle Hotkey:");
+    // Render the user's name and message
+    ImGui::TextColored(displayInfo.color, "%s:", message.user.c_str());
+    if (chatFont && ImGui::IsItemVisible()) glyphCache->Touch(message.user);
+    if (message.delivery == DeliveryState::Delivered)
+    {
+        ImGui::PushID(static_cast<int>(message.id));
+        if (ImGui::BeginPopupContextItem("user"))
+        {
+            if (ImGui::MenuItem("Mute")) {
+                MuteUser(message.platform, message.user);
+            }
+            ImGui::EndPopup();
+        }
+        ImGui::PopID();
+    }
     ImGui::SameLine();
-    ImGui::TextColored(ImVec4(0.4f, 0.9f, 0.9f, 1.0f), "%s", TOGGLE_KEY.c_str());
+    if (message.delivery == DeliveryState::Pending) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_TextDisabled]);
+    }
+    if (!message.highlights.empty() || (chatFont && !message.emotes.empty()))
+    {
+        RenderRichText(message);
+    }
+    else
+    {
+        ImGui::TextWrapped("%s", message.text.c_str());
+    }
+    if (message.delivery == DeliveryState::Pending) {
+        ImGui::PopStyleColor();
+    }
+    if (chatFont && ImGui::IsItemVisible()) glyphCache->Touch(message.text);
+
+    if (message.delivery == DeliveryState::Failed)
+    {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "(not sent)");
+    }
+
+    if (chatFont) ImGui::PopFont();
 }
 
 /**
- * @brief Constructs and sends a chat message payload to the WebSocket server.
- * @param channel The channel to send the message to.
- * @param text The content of the message.
+ * @brief Draws a message's text with its highlight spans colored and its emotes inline.
+ * ImGui wraps a single text item only, so the text is laid out a word at a time,
+ * continuing lines at the column where the text started.
  */
-void GlobalChat::SendChatMessage(const std::string& channel, const std::string& text)
+void GlobalChat::RenderRichText(const ChatMessage& message)
 {
-    if (!wsManager || !wsManager->IsConnected()) {
-        LOG("Cannot send message, not connected.");
-        return;
-    }
+    static const ImVec4 MENTION_COLOR(1.0f, 0.82f, 0.3f, 1.0f);
+    static const ImVec4 KEYWORD_COLOR(0.45f, 0.85f, 1.0f, 1.0f);
 
-    if (!gameWrapper->IsInOnlineGame()) {
-        auto playerController = gameWrapper->GetPlayerController();
-        if (!playerController) {
-            LOG("Cannot send message, player controller is null.");
+    const std::string& text = message.text;
+    const auto& highlights = message.highlights;
+    const auto& emotes = message.emotes;
+    const float startX = ImGui::GetCursorPosX();
+    const float wrapX = ImGui::GetContentRegionMax().x;
+    bool firstItem = true;
+    // Continues the line, or starts the next one if an item this wide would run past the edge.
+    auto place = [&](float width) {
+        if (firstItem) {
+            firstItem = false;
             return;
         }
-    }
-
-    std::string playerName = gameWrapper->GetPlayerName().ToString();
-    if (playerName.empty()) {
-        LOG("Cannot send message, failed to get player name.");
-        return;
-    }
-
-    std::string platform = gameWrapper->IsUsingEpicVersion() ? "epic" : "steam";
-
-    int highestTier = -1;
-    auto mmrWrapper = gameWrapper->GetMMRWrapper();
-    auto uniqueId = gameWrapper->GetUniqueID();
+        ImGui::SameLine(0.0f, 0.0f);
+        if (ImGui::GetCursorPosX() + width > wrapX)
+        {
+            ImGui::NewLine();
+            ImGui::SetCursorPosX(startX);
+        }
+    };
 
-    if (uniqueId.GetPlatform() != OnlinePlatform_Unknown)
+    ImGui::PushTextWrapPos(0.0f); // A word longer than a whole line still wraps
+    size_t span = 0;
+    size_t emote = 0;
+    size_t position = 0;
+    while (position < text.size())
     {
-        const std::vector<int> playlists = { 10, 11, 13 }; // 1v1, 2v2, 3v3
-        for (const auto& playlistId : playlists)
+        if (emote < emotes.size() && position == emotes[emote].begin)
         {
-            SkillRank playerRank = mmrWrapper.GetPlayerRank(uniqueId, playlistId);
-            if (playerRank.Tier > highestTier)
+            const EmoteSpan& code = emotes[emote++];
+            if (const EmoteSet::Sprite* sprite = chatFont && emoteSet ? emoteSet->Get(code.emote) : nullptr)
             {
-                highestTier = playerRank.Tier;
+                place(sprite->size.x);
+                const float lineHeight = ImGui::GetTextLineHeight();
+                const ImVec2 cursor = ImGui::GetCursorScreenPos();
+                const ImVec2 min(cursor.x, cursor.y + (lineHeight - sprite->size.y) * 0.5f);
+                ImGui::Dummy(ImVec2(sprite->size.x, lineHeight));
+                // Same texture as the chat font, so the quad joins the text's draw command.
+                ImGui::GetWindowDrawList()->AddImage(glyphCache->TextureId(), min,
+                    ImVec2(min.x + sprite->size.x, min.y + sprite->size.y), sprite->uv0, sprite->uv1);
+                position = code.end;
+                continue;
             }
+            // No image (yet): the shortcode is drawn as text.
         }
-    }
 
-    json messagePayload = {
-        {"platform", platform},
-        {"channel", channel},
-        {"highest_rank", highestTier},
-        {"user", playerName},
-        {"text", text}
-    };
+        while (span < highlights.size() && highlights[span].end <= position) ++span;
+        const bool highlighted = span < highlights.size() && position >= highlights[span].begin;
+        size_t segmentEnd = highlighted ? highlights[span].end : span < highlights.size() ? highlights[span].begin : text.size();
+        if (emote < emotes.size()) {
+            segmentEnd = std::min<size_t>(segmentEnd, emotes[emote].begin);
+        }
+        if (highlighted) {
+            ImGui::PushStyleColor(ImGuiCol_Text, highlights[span].mention ? MENTION_COLOR : KEYWORD_COLOR);
+        }
+
+        while (position < segmentEnd)
+        {
+            // A word with its trailing spaces, cut at the end of the segment.
+            size_t wordEnd = text.find(' ', position);
+            wordEnd = wordEnd == std::string::npos ? segmentEnd : std::min(text.find_first_not_of(' ', wordEnd), segmentEnd);
+            const char* begin = text.c_str() + position;
+            const char* end = text.c_str() + wordEnd;
+            place(ImGui::CalcTextSize(begin, end).x);
+            ImGui::TextUnformatted(begin, end);
+            position = wordEnd;
+        }
 
-    wsManager->Send(messagePayload.dump());
-    LOG("Sent message to channel {}: {}", channel, text);
-    lastMessageTime = std::chrono::steady_clock::now();
+        if (highlighted) {
+            ImGui::PopStyleColor();
+        }
+    }
+    ImGui::PopTextWrapPos();
 }
 
 /**
- * @brief Converts a numeric rank tier ID into a displayable string and color.
- * @param tier The integer ID of the rank tier.
- * @return A struct containing the display tag (e.g., "GC1") and its associated color.
+ * @brief Renders search hits across all channels. The query only runs again when
+ * the search text or the history changes, not every frame.
  */
-GlobalChat::RankDisplayInfo GlobalChat::GetRankDisplayInfo(int tier)
+void GlobalChat::RenderSearchResults()
 {
-    const ImVec4 sslColor = { 1.0f, 1.0f, 1.0f, 1.0f };
-    const ImVec4 gcColor = { 1.0f, 0.4f, 0.4f, 1.0f };
-    const ImVec4 cColor = { 0.8f, 0.4f, 1.0f, 1.0f };
-    const ImVec4 dColor = { 0.4f, 0.6f, 1.0f, 1.0f };
-    const ImVec4 pColor = { 0.4f, 0.9f, 0.9f, 1.0f };
-    const ImVec4 gColor = { 1.0f, 0.8f, 0.4f, 1.0f };
-    const ImVec4 sColor = { 0.7f, 0.7f, 0.8f, 1.0f };
-    const ImVec4 bColor = { 0.8f, 0.6f, 0.4f, 1.0f };
-    const ImVec4 unrColor = { 0.5f, 0.5f, 0.5f, 1.0f };
+    // The snapshot carries the search index for its own messages, so the query runs on the
+    // render thread without historyMutex.
+    const auto snapshot = chatHistory.GetSnapshot();
+    if (lastSearchQuery != searchBuffer || lastSearchGeneration != snapshot->generation)
+    {
+        lastSearchQuery = searchBuffer;
+        lastSearchGeneration = snapshot->generation;
+        searchResults = snapshot->Search(lastSearchQuery, MAX_SEARCH_HITS);
+    }
 
-    switch (tier)
+    if (searchResults.empty())
     {
-    case 22: case 23: case 24: case 25: return { "SSL", sslColor };
-    case 21: return { "GC3", gcColor };
-    case 20: return { "GC2", gcColor };
-    case 19: return { "GC1", gcColor };
-    case 18: return { "C3", cColor };
-    case 17: return { "C2", cColor };
-    case 16: return { "C1", cColor };
-    case 15: return { "D3", dColor };
-    case 14: return { "D2", dColor };
-    case 13: return { "D1", dColor };
-    case 12: return { "P3", pColor };
-    case 11: return { "P2", pColor };
-    case 10: return { "P1", pColor };
-    case 9:  return { "G3", gColor };
-    case 8:  return { "G2", gColor };
-    case 7:  return { "G1", gColor };
-    case 6:  return { "S3", sColor };
-    case 5:  return { "S2", sColor };
-    case 4:  return { "S1", sColor };
-    case 3:  return { "B3", bColor };
-    case 2:  return { "B2", bColor };
-    case 1:  return { "B1", bColor };
-    default: return { "UNR", unrColor };
+        ImGui::TextDisabled("No messages match \"%s\".", lastSearchQuery.c_str());
+        return;
+    }
+
+    for (const auto& message : searchResults)
+    {
+        ImGui::PushID(static_cast<int>(message->id));
+        ImGui::BeginGroup();
+        RenderMessage(*message, true);
+        ImGui::EndGroup();
+        if (ImGui::IsItemClicked())
+        {
+            SelectChannel(message->channel);
+            searchBuffer[0] = '\0';
+        }
+        ImGui::PopID();
     }
 }
 
 /**
- * @brief Callback executed on successful WebSocket connection.
+ * @brief Renders the plugin's settings window in the F2 menu.
  */
-void GlobalChat::OnWSConnect()
+void GlobalChat::RenderSettings()
 {
-    LOG("Successfully connected to WebSocket server!");
-    cvarManager->executeCommand("togglemenu \"" + GetMenuName() + "\"");
+    ImGui::TextUnformatted("Global Chat Settings");
+    ImGui::Separator();
+    ImGui::Spacing();
 
-}
+    if (!ImGui::BeginTabBar("GlobalChatSettingsTabs"))
+    {
+        return;
+    }
 
-/**
- * @brief Callback executed on WebSocket error.
- * @param error A string view of the error message.
- */
-void GlobalChat::OnWSError(std::string_view error)
-{
-    LOG("WebSocket Error: {}", error);
-}
+    if (ImGui::BeginTabItem("General"))
+    {
+        RenderGeneralSettings();
+        ImGui::EndTabItem();
+    }
 
-/**
- * @brief Callback executed on WebSocket disconnection.
- */
-void GlobalChat::OnWSDisconnect()
-{
-    LOG("Disconnected from WebSocket server.");
-    channels.clear();
-    chatHistory.clear();
+    if (ImGui::BeginTabItem("Diagnostics"))
+    {
+        RenderDiagnostics();
+        ImGui::EndTabItem();
+    }
+
+    ImGui::EndTabBar();
 }
 
 /**
- * @brief Callback executed when a message is received from the WebSocket server.
- * @param message A string view of the incoming message payload.
+ * @brief Renders the general settings tab: window toggle, hotkey and persistence.
  */
-void GlobalChat::OnWSMessage(std::string_view message)
+void GlobalChat::RenderGeneralSettings()
 {
-    std::lock_guard<std::mutex> lock(historyMutex);
-    try
+    if (ImGui::Button("Toggle Chat Window"))
     {
-        json receivedJson = json::parse(message);
+        gameWrapper->Execute([this](GameWrapper* gw) {
+            cvarManager->executeCommand("togglemenu \"" + GetMenuName() + "\"");
+        });
+    }
 
-        if (receivedJson.contains("error")) {
-            LOG("Server returned an error: {}", receivedJson["error"].get<std::string>());
-            return;
-        }
+    ImGui::Spacing();
 
-        if (receivedJson.contains("type") && receivedJson["type"] == "all_histories")
+    ImGui::Text("Toggle Hotkey:");
+    ImGui::SameLine();
+    ImGui::TextColored(ImVec4(0.4f, 0.9f, 0.9f, 1.0f), "%s", TOGGLE_KEY.c_str());
+
+    ImGui::Spacing();
+
+    CVarWrapper persistCvar = cvarManager->getCvar("globalchat_persist_history");
+    if (persistCvar)
+    {
+        bool persistHistory = persistCvar.getBoolValue();
+        if (ImGui::Checkbox("Keep chat history on disk", &persistHistory))
         {
-            LOG("Received all channel histories.");
-            chatHistory.clear();
-            channels.clear();
-            json histories = receivedJson["data"];
-            for (auto& [channel, messages] : histories.items())
-            {
-                channels.push_back(channel);
-                for (const auto& msgStr : messages)
-                {
-                    chatHistory[channel].push_back(json::parse(msgStr.get<std::string>()));
-                }
-            }
-            if (!channels.empty() && currentChannel.empty()) {
-                currentChannel = channels[0];
-            }
-            return;
+            persistCvar.setValue(persistHistory);
+        }
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Takes effect the next time the plugin loads.");
+        }
+    }
+
+    CVarWrapper filterCvar = cvarManager->getCvar("globalchat_filter");
+    if (filterCvar)
+    {
+        static const char* filterModes[] = { "Show filtered words", "Mask filtered words", "Hide messages with filtered words" };
+        int filterMode = std::clamp(filterCvar.getIntValue(), 0, 2);
+        if (ImGui::Combo("Chat filter", &filterMode, filterModes, IM_ARRAYSIZE(filterModes)))
+        {
+            filterCvar.setValue(filterMode);
+        }
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Words come from globalchat/filter.txt and globalchat_filter_words.\nApplies to messages that arrive from now on.");
+        }
+    }
+
+    if (const uint64_t generation = muteGeneration.load(std::memory_order_acquire); generation != mutedViewGeneration)
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        mutedView = muteList.Entries();
+        mutedViewGeneration = generation;
+    }
+    const auto& muted = mutedView;
+    if (ImGui::CollapsingHeader(("Muted users (" + std::to_string(muted.size()) + ")").c_str()))
+    {
+        // The senders list is only gathered while the picker is open.
+        if (mutePicker.Open) {
+            RefreshRecentSenders(*chatHistory.GetSnapshot());
+        }
+        int picked = -1;
+        if (ImGui::SearchableCombo("##MutePicker", &picked, &mutePicker, recentSenderLabels.data(), static_cast<int>(recentSenderLabels.size()),
+            static_cast<unsigned int>(recentSendersGeneration), "Mute a recent sender...", "Find a user"))
+        {
+            MuteUser(recentSenders[picked].first, recentSenders[picked].second);
+        }
+        if (muted.empty()) {
+            ImGui::TextDisabled("Or right-click a name in chat to mute it.");
+        }
+        for (const auto& entry : muted)
+        {
+            ImGui::PushID((entry.platform + '/' + entry.user).c_str());
+            if (ImGui::SmallButton("Unmute")) {
+                UnmuteUser(entry.platform, entry.user);
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s (%s)", entry.user.c_str(), entry.platform.c_str());
+            ImGui::PopID();
+        }
+    }
+
+    CVarWrapper focusedCvar = cvarManager->getCvar("globalchat_focused_in_match");
+    if (focusedCvar)
+    {
+        bool focusedInMatch = focusedCvar.getBoolValue();
+        if (ImGui::Checkbox("Only receive the open channel during matches", &focusedInMatch))
+        {
+            focusedCvar.setValue(focusedInMatch);
+        }
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Pinned channels catch up after the match.");
+        }
+    }
+}
+
+/**
+ * @brief Renders the live connection and pipeline metrics.
+ */
+void GlobalChat::RenderDiagnostics()
+{
+    ImGui::Text("Connection: %s", wsManager && wsManager->IsConnected() ? "connected" : "disconnected");
+    ImGui::Spacing();
+
+    for (const auto& line : GetMetrics().Describe())
+    {
+        ImGui::TextUnformatted(line.c_str());
+    }
+    if (glyphCache)
+    {
+        const auto glyphs = glyphCache->GetStats();
+        ImGui::Text("chat glyphs: %zu of %zu cached, %zu not in any font, texture %.1f MB, fonts %.1f MB mapped",
+            glyphs.resident, glyphs.capacity, static_cast<size_t>(glyphs.unavailable),
+            glyphs.textureBytes / 1048576.0, glyphs.fontBytes / 1048576.0);
+    }
+    if (emoteSet && emoteSet->Count() > 0)
+    {
+        const auto emotes = emoteSet->GetStats();
+        ImGui::Text("emotes: %zu, %zu animated, %zu frames packed, %zu unusable%s", emotes.emotes, emotes.animated,
+            emotes.frames, emotes.missing, emotes.ready ? "" : " (loading)");
+    }
+
+    ImGui::Spacing();
+    if (ImGui::Button("Reset Metrics"))
+    {
+        GetMetrics().Reset();
+    }
+}
+
+/**
+ * @brief Re-reads the sender details that need the game wrapper: player name,
+ * platform and highest ranked tier. Runs on the game thread tick, at most every
+ * PLAYER_INFO_REFRESH, so sending never has to hop onto the game thread.
+ */
+void GlobalChat::RefreshPlayerInfo()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now < nextPlayerInfoRefresh) return;
+    nextPlayerInfoRefresh = now + PLAYER_INFO_REFRESH;
+
+    std::optional<PlayerInfo> info;
+    const bool hasController = gameWrapper->IsInOnlineGame() || gameWrapper->GetPlayerController();
+    std::string playerName = hasController ? gameWrapper->GetPlayerName().ToString() : std::string();
+    if (!playerName.empty())
+    {
+        info.emplace();
+        info->name = std::move(playerName);
+        info->platform = gameWrapper->IsUsingEpicVersion() ? "epic" : "steam";
+
+        auto mmrWrapper = gameWrapper->GetMMRWrapper();
+        auto uniqueId = gameWrapper->GetUniqueID();
+        if (uniqueId.GetPlatform() != OnlinePlatform_Unknown)
+        {
+            const std::vector<int> playlists = { 10, 11, 13 }; // 1v1, 2v2, 3v3
+            for (const auto& playlistId : playlists)
+            {
+                SkillRank playerRank = mmrWrapper.GetPlayerRank(uniqueId, playlistId);
+                if (playerRank.Tier > info->highestRank)
+                {
+                    info->highestRank = playerRank.Tier;
+                }
+            }
+        }
+    }
+
+    bool nameChanged = false;
+    {
+        std::lock_guard<std::mutex> lock(playerInfoMutex);
+        nameChanged = (playerInfo ? playerInfo->name : std::string()) != (info ? info->name : std::string());
+        playerInfo = std::move(info);
+    }
+    if (nameChanged) {
+        LoadHighlighter();
+    }
+}
+
+/**
+ * @brief Queues an outbound frame if the send rate limit allows it. Every frame
+ * type goes through here so they all count against the same budget.
+ * @param serialize Builds the frame for the negotiated subprotocol; runs on the network thread.
+ * @return False if the frame was rate limited or the outbox is full.
+ */
+bool GlobalChat::SendFrame(WSManager::Serializer serialize)
+{
+    if (!wsManager) return false;
+    if (!sendLimiter.TryAcquire()) {
+        GetMetrics().rateLimited.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return wsManager->Send(std::move(serialize));
+}
+
+/**
+ * @brief Shows a chat message locally and queues it for the server. Called from
+ * the render thread; the JSON payload is built on the network thread, and the
+ * outbox keeps it across a brief disconnect.
+ * @param channel The channel to send the message to.
+ * @param text The content of the message.
+ * @return False if the message was not sent and the input should be kept.
+ */
+bool GlobalChat::SendChatMessage(const std::string& channel, const std::string& text)
+{
+    PlayerInfo sender;
+    {
+        std::lock_guard<std::mutex> lock(playerInfoMutex);
+        if (!playerInfo) {
+            LOG("Cannot send message, player name is not available yet.");
+            return false;
+        }
+        sender = *playerInfo;
+    }
+    if (sendLimiter.TimeUntilNext() > std::chrono::steady_clock::duration::zero()) return false;
+
+    char clientIdBuffer[48];
+    std::snprintf(clientIdBuffer, sizeof(clientIdBuffer), "%s-%08llx", clientIdPrefix.c_str(), static_cast<unsigned long long>(++nextClientId));
+    const std::string clientId = clientIdBuffer;
+
+    // Show the message right away; it is registered before the send so the echo cannot outrun it.
+    ChatMessage echo;
+    echo.platform = sender.platform;
+    echo.channel = channel;
+    echo.user = sender.name;
+    echo.text = text;
+    echo.highestRank = sender.highestRank;
+    AddLocalEcho(clientId, std::move(echo));
+
+    const bool queued = SendFrame([sender, channel, text, clientId](std::string_view protocol) {
+        json messagePayload = {
+            {"platform", sender.platform},
+            {"channel", channel},
+            {"highest_rank", sender.highestRank},
+            {"user", sender.name},
+            {"text", text},
+            {"client_id", clientId}
+        };
+        return WireFormat::Encode(messagePayload, protocol);
+    });
+    if (!queued) {
+        LOG("Cannot send message, the outbox is full or the send rate limit was hit.");
+        WithdrawLocalEcho(clientId);
+        return false;
+    }
+
+    // Receivers drop us from the channel's typists when the message arrives.
+    if (const auto sent = typingSent.find(channel); sent != typingSent.end()) {
+        sent->second.typing = false;
+    }
+
+    LOG("Queued message to channel {}: {}", channel, text);
+    return true;
+}
+
+/**
+ * @brief Sends typing start and stop frames as the input box changes. Each channel
+ * gets at most one frame per TYPING_FRAME_INTERVAL; a change within it goes out when
+ * the interval is up, so a burst of keystrokes costs one frame. While typing continues,
+ * the start is repeated every TYPING_REFRESH_INTERVAL to keep receivers from expiring it.
+ * Render thread, every frame.
+ * @param typing Whether the player is typing in currentChannel right now.
+ */
+void GlobalChat::UpdateTyping(bool typing)
+{
+    if (typing && !currentChannel.empty()) typingSent.try_emplace(currentChannel);
+
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = typingSent.begin(); it != typingSent.end();)
+    {
+        TypingSent& sent = it->second;
+        const bool wanted = typing && it->first == currentChannel;
+        const bool due = wanted ? !sent.typing || now - sent.lastFrame >= TYPING_REFRESH_INTERVAL : sent.typing;
+        if (due && now - sent.lastFrame >= TYPING_FRAME_INTERVAL && SendTyping(it->first, wanted))
+        {
+            sent.typing = wanted;
+            sent.lastFrame = now;
+        }
+
+        // Once idle past the interval a channel needs no state: its next frame may go at once.
+        if (!sent.typing && now - sent.lastFrame >= TYPING_FRAME_INTERVAL) it = typingSent.erase(it);
+        else ++it;
+    }
+}
+
+/**
+ * @brief Queues a typing frame for a channel, replacing one still waiting in the outbox.
+ * The server counts every frame, so it takes a token from sendLimiter like a chat message,
+ * but only when another is left for chat, and it never waits: UpdateTyping tries again on a
+ * later frame.
+ * @param channel The channel typed in.
+ * @param typing True to start (or refresh), false to stop.
+ * @return False if it could not be sent: offline, rate limited, or no player name yet.
+ */
+bool GlobalChat::SendTyping(const std::string& channel, bool typing)
+{
+    if (!wsManager || !wsManager->IsConnected()) return false;
+    PlayerInfo sender;
+    {
+        std::lock_guard<std::mutex> lock(playerInfoMutex);
+        if (!playerInfo) return false;
+        sender = *playerInfo;
+    }
+    // Not counted in rateLimited; a typing frame waiting for a token asks every render frame.
+    // The token kept back means pressing Enter right after typing is never refused.
+    if (!sendLimiter.TryAcquireKeeping(1)) return false;
+
+    const bool queued = wsManager->SendCoalesced("typing:" + channel, [sender, channel, typing](std::string_view protocol) {
+        json payload = {
+            {"type", "typing"},
+            {"platform", sender.platform},
+            {"channel", channel},
+            {"user", sender.name},
+            {"typing", typing}
+        };
+        return WireFormat::Encode(payload, protocol);
+    });
+    if (queued) {
+        GetMetrics().typingFramesOut.fetch_add(1, std::memory_order_relaxed);
+    }
+    return queued;
+}
+
+/**
+ * @brief Applies another user's typing frame. Network thread, under historyMutex.
+ * @param payload The decoded frame.
+ */
+void GlobalChat::OnTypingFrame(const json& payload)
+{
+    GetMetrics().typingFramesIn.fetch_add(1, std::memory_order_relaxed);
+
+    ChatMessage typist;
+    typist.platform = payload.value("platform", "");
+    typist.channel = payload.value("channel", "");
+    typist.user = payload.value("user", "");
+    SanitizeIncoming(typist);
+    if (typist.channel.empty() || typist.user.empty()) return;
+    if (muteList.Contains(typist.platform, typist.user)) return;
+    {
+        std::lock_guard<std::mutex> lock(playerInfoMutex);
+        if (playerInfo && playerInfo->platform == typist.platform && playerInfo->name == typist.user) return;
+    }
+
+    std::lock_guard<std::mutex> lock(typingMutex);
+    if (payload.value("typing", false)) {
+        typists.Start(typist.channel, typist.platform, typist.user, std::chrono::steady_clock::now());
+    }
+    else {
+        typists.Stop(typist.channel, typist.platform, typist.user);
+    }
+}
+
+/**
+ * @brief Draws the "... is typing" line for the open channel, or an empty line.
+ * Also expires typists whose stop never came. Render thread.
+ */
+void GlobalChat::RenderTypingIndicator()
+{
+    {
+        std::lock_guard<std::mutex> lock(typingMutex);
+        typists.Expire(std::chrono::steady_clock::now());
+
+        // The newest two by name, the rest as a count; the names stay valid under the lock.
+        std::string_view names[2];
+        size_t named = 0;
+        const size_t count = typists.Count(currentChannel);
+        typists.ForEach(currentChannel, [&](std::string_view, std::string_view user) {
+            names[named++] = user;
+            return named < std::size(names);
+        });
+
+        const auto length = [](std::string_view name) { return static_cast<int>(name.size()); };
+        if (count == 0) {
+            typingLabel[0] = '\0';
+        }
+        else if (count == 1) {
+            std::snprintf(typingLabel, sizeof(typingLabel), "%.*s is typing...", length(names[0]), names[0].data());
+        }
+        else if (count == 2) {
+            std::snprintf(typingLabel, sizeof(typingLabel), "%.*s and %.*s are typing...",
+                length(names[0]), names[0].data(), length(names[1]), names[1].data());
+        }
+        else {
+            std::snprintf(typingLabel, sizeof(typingLabel), "%.*s, %.*s and %zu other%s are typing...",
+                length(names[0]), names[0].data(), length(names[1]), names[1].data(), count - 2, count == 3 ? "" : "s");
+        }
+    }
+
+    if (chatFont)
+    {
+        ImGui::PushFont(chatFont);
+        glyphCache->Touch(typingLabel);
+    }
+    ImGui::TextDisabled("%s", typingLabel);
+    if (chatFont) ImGui::PopFont();
+}
+
+/**
+ * @brief Opens a channel in the window and makes it the focused subscription.
+ * Render thread.
+ * @param channel The channel to show.
+ */
+void GlobalChat::SelectChannel(const std::string& channel)
+{
+    currentChannel = channel;
+    {
+        std::lock_guard<std::mutex> lock(mentionMutex);
+        if (unreadMentions.erase(channel)) ++mentionGeneration;
+    }
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    focusedChannel = channel;
+}
+
+/**
+ * @brief Pins or unpins a channel. Pinned channels stay subscribed while another
+ * channel is open, and are remembered in globalchat_pinned_channels.
+ * @param channel The channel to change.
+ * @param pinned Whether it should be pinned.
+ */
+void GlobalChat::SetChannelPinned(const std::string& channel, bool pinned)
+{
+    std::string saved;
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        if (pinned) pinnedChannels.insert(channel);
+        else pinnedChannels.erase(channel);
+        ++pinnedGeneration;
+
+        for (const auto& name : pinnedChannels) {
+            if (!saved.empty()) saved += ',';
+            saved += name;
+        }
+    }
+
+    CVarWrapper pinnedCvar = cvarManager->getCvar("globalchat_pinned_channels");
+    if (pinnedCvar) {
+        pinnedCvar.setValue(saved);
+    }
+}
+
+/**
+ * @brief Whether the server was told to send this channel on the current connection.
+ */
+bool GlobalChat::IsSubscribed(const std::string& channel)
+{
+    std::lock_guard<std::mutex> lock(subscriptionMutex);
+    return subscribedChannels.count(channel) != 0;
+}
+
+/**
+ * @brief Brings the server's subscriptions in line with what is shown: the open
+ * channel plus pinned ones, or only the open one during a match in focused-only
+ * mode. The first frame of a connection carries the full set; later ones only
+ * the changes. Frames refused by the send limit are retried on a later tick.
+ * Runs on the game thread tick.
+ */
+void GlobalChat::UpdateSubscriptions()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now < nextSubscriptionCheck) return;
+    nextSubscriptionCheck = now + SUBSCRIPTION_CHECK_INTERVAL;
+    if (!wsManager || !wsManager->IsConnected()) return;
+
+    CVarWrapper focusedCvar = cvarManager->getCvar("globalchat_focused_in_match");
+    const bool focusedOnly = focusedCvar && focusedCvar.getBoolValue() && gameWrapper->IsInOnlineGame();
+
+    std::set<std::string> desired;
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    bool fullSet = false;
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        if (!focusedChannel.empty()) desired.insert(focusedChannel);
+        if (!focusedOnly) desired.insert(pinnedChannels.begin(), pinnedChannels.end());
+
+        if (subscriptionsSent && desired == subscribedChannels) return;
+        fullSet = !subscriptionsSent;
+        std::set_difference(desired.begin(), desired.end(), subscribedChannels.begin(), subscribedChannels.end(), std::back_inserter(added));
+        std::set_difference(subscribedChannels.begin(), subscribedChannels.end(), desired.begin(), desired.end(), std::back_inserter(removed));
+    }
+
+    auto subscriptionFrame = [](const char* type, std::vector<std::string> channels, bool replace) {
+        return [type, channels = std::move(channels), replace](std::string_view protocol) {
+            json frame = { {"type", type}, {"channels", channels} };
+            if (replace) frame["replace"] = true;
+            return WireFormat::Encode(frame, protocol);
+        };
+    };
+
+    if (fullSet)
+    {
+        // Until this arrives the server sends every channel.
+        if (!SendFrame(subscriptionFrame("subscribe", std::vector<std::string>(desired.begin(), desired.end()), true))) return;
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        subscribedChannels = std::move(desired);
+        subscriptionsSent = true;
+        return;
+    }
+
+    if (!added.empty() && SendFrame(subscriptionFrame("subscribe", added, false)))
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        subscribedChannels.insert(added.begin(), added.end());
+    }
+    if (!removed.empty() && SendFrame(subscriptionFrame("unsubscribe", removed, false)))
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        for (const auto& channel : removed) subscribedChannels.erase(channel);
+    }
+}
+
+/**
+ * @brief Converts a numeric rank tier ID into a displayable string and color.
+ * @param tier The integer ID of the rank tier.
+ * @return A struct containing the display tag (e.g., "GC1") and its associated color.
+ */
+GlobalChat::RankDisplayInfo GlobalChat::GetRankDisplayInfo(int tier)
+{
+    const ImVec4 sslColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    const ImVec4 gcColor = { 1.0f, 0.4f, 0.4f, 1.0f };
+    const ImVec4 cColor = { 0.8f, 0.4f, 1.0f, 1.0f };
+    const ImVec4 dColor = { 0.4f, 0.6f, 1.0f, 1.0f };
+    const ImVec4 pColor = { 0.4f, 0.9f, 0.9f, 1.0f };
+    const ImVec4 gColor = { 1.0f, 0.8f, 0.4f, 1.0f };
+    const ImVec4 sColor = { 0.7f, 0.7f, 0.8f, 1.0f };
+    const ImVec4 bColor = { 0.8f, 0.6f, 0.4f, 1.0f };
+    const ImVec4 unrColor = { 0.5f, 0.5f, 0.5f, 1.0f };
+
+    switch (tier)
+    {
+    case 22: case 23: case 24: case 25: return { "SSL", sslColor };
+    case 21: return { "GC3", gcColor };
+    case 20: return { "GC2", gcColor };
+    case 19: return { "GC1", gcColor };
+    case 18: return { "C3", cColor };
+    case 17: return { "C2", cColor };
+    case 16: return { "C1", cColor };
+    case 15: return { "D3", dColor };
+    case 14: return { "D2", dColor };
+    case 13: return { "D1", dColor };
+    case 12: return { "P3", pColor };
+    case 11: return { "P2", pColor };
+    case 10: return { "P1", pColor };
+    case 9:  return { "G3", gColor };
+    case 8:  return { "G2", gColor };
+    case 7:  return { "G1", gColor };
+    case 6:  return { "S3", sColor };
+    case 5:  return { "S2", sColor };
+    case 4:  return { "S1", sColor };
+    case 3:  return { "B3", bColor };
+    case 2:  return { "B2", bColor };
+    case 1:  return { "B1", bColor };
+    default: return { "UNR", unrColor };
+    }
+}
+
+/**
+ * @brief Callback executed on successful WebSocket connection.
+ */
+void GlobalChat::OnWSConnect()
+{
+    const auto& timing = wsManager->GetConnectTiming();
+    auto ms = [](auto from, auto to) { return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count(); };
+    LOG("Successfully connected to WebSocket server! (attempt {}, {} ms: dns {} ms{}, tcp {} ms, tls {} ms{}, websocket {} ms)",
+        timing.attempt, ms(timing.attempt_started, timing.ws_handshake),
+        ms(timing.attempt_started, timing.resolved), timing.used_cached_endpoints ? " cached" : "",
+        ms(timing.resolved, timing.tcp_connected),
+        ms(timing.tcp_connected, timing.tls_handshake), timing.tls_session_resumed ? " resumed" : "",
+        ms(timing.tls_handshake, timing.ws_handshake));
+    LOG("Wire format: {}", wsManager->Protocol().empty() ? std::string("json (no subprotocol)") : wsManager->Protocol());
+
+    // Subscriptions are per connection; the next game tick sends the full set again.
+    {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        subscribedChannels.clear();
+        subscriptionsSent = false;
+    }
+    serverFiltersChannels = false;
+
+    // Answers to page requests from the last connection won't come; allow new ones.
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        for (auto& [channel, paging] : scrollbackPages) paging.retryAt = {};
+    }
+
+    // Only pop the window open for the first connection, not for every reconnect.
+    if (!hasConnected) {
+        hasConnected = true;
+        cvarManager->executeCommand("togglemenu \"" + GetMenuName() + "\"");
+    }
+}
+
+/**
+ * @brief Logs how long each startup phase took, from plugin load to the first
+ * server message. Called once, on the network thread.
+ */
+void GlobalChat::LogStartupTrace()
+{
+    startupTraceLogged = true;
+
+    const auto& timing = wsManager->GetConnectTiming();
+    auto sinceLoad = [this](std::chrono::steady_clock::time_point point) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(point - loadStartTime).count();
+    };
+
+    // Milliseconds since load, as structured fields so the binary log keeps the raw numbers.
+    LOGEVENT<LogLevel::Info>("startup_trace",
+        Field("connect_requested_ms", sinceLoad(timing.requested)), Field("thread_ms", sinceLoad(timing.thread_started)),
+        Field("tls_context_ms", sinceLoad(timing.context_ready)), Field("resolved_ms", sinceLoad(timing.resolved)),
+        Field("tcp_ms", sinceLoad(timing.tcp_connected)), Field("tls_ms", sinceLoad(timing.tls_handshake)),
+        Field("websocket_ms", sinceLoad(timing.ws_handshake)), Field("first_message_ms", sinceLoad(std::chrono::steady_clock::now())));
+}
+
+/**
+ * @brief Callback executed on WebSocket error.
+ * @param error A string view of the error message.
+ */
+void GlobalChat::OnWSError(std::string_view error)
+{
+    WARNLOG("WebSocket Error: {}", error);
+}
+
+/**
+ * @brief Callback executed on WebSocket disconnection.
+ */
+void GlobalChat::OnWSDisconnect()
+{
+    LOG("Disconnected from WebSocket server.");
+
+    // Stops sent while we were away never reach us; typists resend their starts anyway.
+    {
+        std::lock_guard<std::mutex> lock(typingMutex);
+        typists.Clear();
+    }
+
+    // The history stays readable while offline; the server's dump on the next connect
+    // is merged into it rather than replacing it (see MergeServerHistory).
+}
+
+/**
+ * @brief Compacts the on-disk logs and fills the history from them before the
+ * server connection is up, so the window has content immediately. Runs on the
+ * network thread ahead of the first connection attempt.
+ * @param directory The folder holding the per-channel logs.
+ */
+void GlobalChat::WarmStartFromDisk(const std::filesystem::path& directory)
+{
+    auto log = std::make_unique<HistoryLog>(directory);
+    log->Compact(MAX_PERSISTED_PER_CHANNEL);
+
+    std::lock_guard<std::mutex> lock(historyMutex);
+    historyLog = std::move(log);
+    hasHistoryLog = true;
+    for (const auto& channel : historyLog->Channels())
+    {
+        for (auto& message : historyLog->ReadBefore(channel, 0, MAX_HISTORY_PER_CHANNEL))
+        {
+            AnnotateMessage(message);
+            chatHistory.Append(std::move(message));
+        }
+        chatHistory.AddChannel(channel);
+    }
+    LOG("Loaded {} channels from the local history log.", chatHistory.ChannelOrder().size());
+}
+
+/**
+ * @brief Merges a channel's server history dump into the local history. Only the
+ * messages not already known are stored and logged, so a warm start or reconnect
+ * does not duplicate or rewrite what is already there. Sequenced messages are
+ * deduplicated by ChatHistory; for a server without sequence numbers the overlap
+ * is found by content.
+ * @param channel The channel the dump belongs to.
+ * @param serverMessages The server's messages for the channel, oldest first.
+ */
+void GlobalChat::MergeServerHistory(const std::string& channel, std::vector<ChatMessage> serverMessages)
+{
+    const bool sequenced = !serverMessages.empty() && serverMessages.back().seq != 0;
+
+    size_t firstNew = 0;
+    const auto* local = chatHistory.GetChannel(channel);
+    if (!sequenced && local && !local->empty())
+    {
+        // Find the newest local message in the dump; require the one before it to match
+        // as well so a repeated short message ("gg") does not anchor the overlap.
+        for (size_t i = serverMessages.size(); i-- > 0;)
+        {
+            if (!SameMessage(serverMessages[i], *local->back())) continue;
+            if (i > 0 && local->size() > 1 && !SameMessage(serverMessages[i - 1], *(*local)[local->size() - 2])) continue;
+            firstNew = i + 1;
+            break;
+        }
+    }
+
+    for (size_t i = firstNew; i < serverMessages.size(); ++i)
+    {
+        const ChatMessage* stored = chatHistory.Append(std::move(serverMessages[i]));
+        if (!stored) continue;
+        if (historyLog) historyLog->Append(*stored);
+        if (glyphCache) {
+            glyphCache->Prefetch(stored->user);
+            glyphCache->Prefetch(stored->text);
+        }
+    }
+}
+
+/**
+ * @brief Prepends a page of older messages from the disk log to a channel. Runs on the
+ * network thread, the only one that writes the log, so nothing is appended between
+ * counting what is in memory and reading the page; the read itself is done without
+ * historyMutex.
+ * @param channel The channel to extend.
+ */
+void GlobalChat::LoadOlderFromDisk(const std::string& channel)
+{
+    // Set on this thread before the first page can be asked for.
+    if (!historyLog) return;
+
+    // The log holds exactly the delivered messages; local echoes live only in memory. The
+    // in-memory delivered messages mirror the tail of the log, so their count is the offset
+    // of the next page from the end.
+    size_t loaded = 0;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (const auto* messages = chatHistory.GetChannel(channel)) {
+            loaded = std::count_if(messages->begin(), messages->end(), [](const auto& message) {
+                return message->delivery == DeliveryState::Delivered;
+            });
+        }
+    }
+
+    auto older = historyLog->ReadBefore(channel, loaded, SCROLLBACK_PAGE_SIZE);
+    for (auto& message : older) {
+        AnnotateMessage(message);
+    }
+
+    std::lock_guard<std::mutex> lock(historyMutex);
+    scrollbackPages[channel].retryAt = {};
+    if (older.size() < SCROLLBACK_PAGE_SIZE) {
+        diskExhaustedChannels.insert(channel);
+    }
+    if (!older.empty()) {
+        chatHistory.Prepend(channel, std::move(older));
+    }
+}
+
+/**
+ * @brief Fetches the next page of older messages for a channel: from the disk log
+ * while it has some, then from the server. Either page arrives later, a disk page
+ * through LoadOlderFromDisk on the network thread and a server page through
+ * AddOlderPage; at most one request per channel is outstanding. Render thread.
+ * @param channel The channel scrolled to its top.
+ * @return False once there is nothing older to load.
+ */
+bool GlobalChat::LoadOlderMessages(const std::string& channel)
+{
+    bool fromDisk = false;
+    uint64_t before = 0;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        auto& paging = scrollbackPages[channel];
+        const auto* messages = chatHistory.GetChannel(channel);
+        if (!messages || messages->empty() || messages->size() >= MAX_SCROLLBACK_PER_CHANNEL) return false;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now < paging.retryAt) return true;
+
+        fromDisk = historyLog && !diskExhaustedChannels.count(channel);
+        if (!fromDisk)
+        {
+            if (paging.exhausted) return false;
+
+            // Pages are keyed by sequence number; a channel whose oldest message has none can't be paged.
+            before = messages->front()->seq;
+            if (before == 0)
+            {
+                paging.exhausted = true;
+                return false;
+            }
+        }
+        paging.retryAt = now + SCROLLBACK_REQUEST_TIMEOUT;
+    }
+
+    bool sent = false;
+    if (fromDisk)
+    {
+        sent = wsManager && wsManager->Post([this, channel]() { LoadOlderFromDisk(channel); });
+    }
+    else
+    {
+        sent = SendFrame([channel, before](std::string_view protocol) {
+            return WireFormat::Encode({ {"type", "history_request"}, {"channel", channel}, {"before", before}, {"limit", SCROLLBACK_PAGE_SIZE} }, protocol);
+        });
+    }
+    if (!sent)
+    {
+        // Rate limited or offline; try again on a later frame.
+        std::lock_guard<std::mutex> lock(historyMutex);
+        scrollbackPages[channel].retryAt = {};
+    }
+    return true;
+}
+
+/**
+ * @brief Inserts a page of older messages from the server in front of a channel,
+ * keeping only those older than what the channel already holds. Called with
+ * historyMutex held.
+ * @param channel The channel the page belongs to.
+ * @param older The page, oldest first.
+ * @param more Whether the server has messages older than this page.
+ */
+void GlobalChat::AddOlderPage(const std::string& channel, std::vector<ChatMessage> older, bool more)
+{
+    auto& paging = scrollbackPages[channel];
+    paging.retryAt = {};
+    paging.exhausted = !more;
+
+    const auto* messages = chatHistory.GetChannel(channel);
+    const uint64_t oldest = messages && !messages->empty() ? messages->front()->seq : 0;
+    older.erase(std::remove_if(older.begin(), older.end(), [oldest](const ChatMessage& message) {
+        return message.seq == 0 || (oldest != 0 && message.seq >= oldest);
+    }), older.end());
+
+    if (!older.empty())
+    {
+        chatHistory.Prepend(channel, std::move(older));
+    }
+}
+
+/**
+ * @brief Callback executed when a message is received from the WebSocket server.
+ * @param message A string view of the incoming message payload.
+ * @param binary True for a MessagePack frame, false for JSON text.
+ */
+void GlobalChat::OnWSMessage(std::string_view message, bool binary)
+{
+    if (!startupTraceLogged) {
+        LogStartupTrace();
+    }
+
+    const auto lockRequested = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(historyMutex);
+    GetMetrics().historyLockWait.Record(std::chrono::steady_clock::now() - lockRequested);
+    try
+    {
+        // Plain chat messages are the bulk of the traffic and skip the generic DOM.
+        ChatMessage incoming;
+        std::string clientId;
+        json receivedJson;
+        bool isChatMessage = false;
+        {
+            ScopedLatency parseTimer(GetMetrics().parseTime);
+            isChatMessage = WireFormat::DecodeChatMessage(message, binary, incoming, clientId);
+            if (isChatMessage) {
+                SanitizeIncoming(incoming);
+            }
+            else {
+                receivedJson = WireFormat::Decode(message, binary);
+            }
+        }
+
+        if (isChatMessage) {
+            AddServerMessage(clientId, std::move(incoming));
+            return;
+        }
+
+        if (receivedJson.contains("error")) {
+            LOG("Server returned an error: {}", receivedJson["error"].get<std::string>());
+            return;
+        }
+
+        if (receivedJson.contains("type") && receivedJson["type"] == "rate_limit")
+        {
+            // Clamped here as well as in Configure, so the log shows what is in effect.
+            const double rate = std::clamp(receivedJson.value("rate", DEFAULT_SEND_RATE), TokenBucket::MIN_RATE, TokenBucket::MAX_RATE);
+            const uint32_t burst = std::clamp(receivedJson.value("burst", DEFAULT_SEND_BURST), uint32_t{ 1 }, TokenBucket::MAX_BURST);
+            sendLimiter.Configure(rate, burst);
+            LOG("Server send limit: {} per second, burst of {}.", rate, burst);
+            return;
+        }
+
+        if (receivedJson.contains("type") && receivedJson["type"] == "typing")
+        {
+            OnTypingFrame(receivedJson);
+            return;
+        }
+
+        if (receivedJson.contains("type") && receivedJson["type"] == "subscribed")
+        {
+            serverFiltersChannels = true;
+            return;
+        }
+
+        if (receivedJson.contains("type") && receivedJson["type"] == "channel_history")
+        {
+            const std::string channel = receivedJson.value("channel", "");
+            if (receivedJson.contains("before"))
+            {
+                // A scrollback page we asked for. Without "more", a short page means the end.
+                auto older = ParseHistoryEntries(receivedJson["data"], channel);
+                const bool more = receivedJson.value("more", older.size() >= SCROLLBACK_PAGE_SIZE);
+                PrepareIncoming(older);
+                AddOlderPage(channel, std::move(older), more);
+                return;
+            }
+
+            // Catch-up for a channel we just subscribed to.
+            auto messages = ParseHistoryEntries(receivedJson["data"], channel);
+            PrepareIncoming(messages);
+            MergeServerHistory(channel, std::move(messages));
+            chatHistory.AddChannel(channel);
+            return;
+        }
+
+        if (receivedJson.contains("type") && receivedJson["type"] == "all_histories")
+        {
+            LOG("Received all channel histories.");
+            std::vector<std::string> channelOrder;
+            json histories = receivedJson["data"];
+            for (auto& [channel, messages] : histories.items())
+            {
+                channelOrder.push_back(channel);
+                auto parsed = ParseHistoryEntries(messages, channel);
+                PrepareIncoming(parsed);
+                MergeServerHistory(channel, std::move(parsed));
+            }
+            chatHistory.SetChannelOrder(std::move(channelOrder));
+            return;
         }
 
         if (receivedJson.contains("channel") && receivedJson.contains("user"))
         {
-            std::string channel = receivedJson["channel"];
-            chatHistory[channel].push_back(receivedJson);
-            if (chatHistory[channel].size() > 150) {
-                chatHistory[channel].erase(chatHistory[channel].begin());
+            ChatMessage incomingMessage = WireFormat::ParseChatMessage(receivedJson);
+            SanitizeIncoming(incomingMessage);
+            AddServerMessage(receivedJson.value("client_id", ""), std::move(incomingMessage));
+        }
+    }
+    catch (const json::exception& e)
+    {
+        GetMetrics().parseErrors.fetch_add(1, std::memory_order_relaxed);
+        // One line with an excerpt, so a burst of malformed frames stays cheap to log.
+        constexpr size_t EXCERPT_LENGTH = 200;
+        if (binary) {
+            WARNLOG("Failed to parse incoming MessagePack message: {} ({} bytes)", e.what(), message.size());
+        }
+        else {
+            WARNLOG("Failed to parse incoming JSON message: {} (message: {}{})", e.what(), message.substr(0, EXCERPT_LENGTH),
+                message.size() > EXCERPT_LENGTH ? "..." : "");
+        }
+    }
+}
+
+/**
+ * @brief Compiles the filtered words from globalchat/filter.txt (one per line) and the
+ * globalchat_filter_words cvar, and swaps the result in for incoming messages.
+ */
+void GlobalChat::LoadChatFilter()
+{
+    std::string list = cvarManager->getCvar("globalchat_filter_words").getStringValue();
+    std::ifstream file(chatFilterFile, std::ios::binary);
+    if (file)
+    {
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        list += "\n" + contents.str();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto filter = std::make_shared<const ChatFilter>(ChatFilter::ParseList(list));
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    if (filter->EntryCount() > 0) {
+        LOG("Chat filter: {} entries, {} states, {} KB, compiled in {} us", filter->EntryCount(),
+            filter->Matcher().StateCount(), filter->Matcher().MemoryBytes() / 1024, elapsed.count());
+    }
+    chatFilter.store(filter->EntryCount() > 0 ? std::move(filter) : nullptr, std::memory_order_release);
+}
+
+/**
+ * @brief Readies an incoming message for storage: drops it if the user is muted, applies
+ * the chat filter to its text and user name, and finds its highlights. Called with
+ * historyMutex held.
+ * @return False if the message is to be dropped.
+ */
+bool GlobalChat::PrepareIncoming(ChatMessage& message)
+{
+    if (muteList.Contains(message.platform, message.user)) {
+        GetMetrics().mutedMessages.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const ChatFilter::Mode mode = chatFilterMode.load(std::memory_order_relaxed);
+    const auto filter = mode != ChatFilter::Mode::Off ? chatFilter.load(std::memory_order_acquire) : nullptr;
+    if (filter)
+    {
+        const bool mask = mode == ChatFilter::Mode::Mask;
+        const size_t matches = filter->Apply(message.text, mask) + filter->Apply(message.user, mask);
+        if (matches > 0) {
+            GetMetrics().filteredMessages.fetch_add(1, std::memory_order_relaxed);
+            if (!mask) return false;
+        }
+    }
+
+    // After masking, so the spans index the text as stored.
+    AnnotateMessage(message);
+    return true;
+}
+
+/**
+ * @brief Readies a batch of history for storage, removing dropped messages.
+ */
+void GlobalChat::PrepareIncoming(std::vector<ChatMessage>& messages)
+{
+    std::erase_if(messages, [this](ChatMessage& message) { return !PrepareIncoming(message); });
+}
+
+/**
+ * @brief Compiles the highlighter from the player's name and the
+ * globalchat_highlight_words cvar, and swaps it in for incoming messages.
+ */
+void GlobalChat::LoadHighlighter()
+{
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(playerInfoMutex);
+        if (playerInfo) name = playerInfo->name;
+    }
+
+    std::vector<std::string> entries = ChatFilter::ParseList(cvarManager->getCvar("globalchat_highlight_words").getStringValue());
+    if (!name.empty()) {
+        entries.insert(entries.begin(), name);
+    }
+    highlighter.store(entries.empty() ? nullptr : std::make_shared<const Highlighter>(Highlighter{ ChatFilter(entries), std::move(name) }),
+        std::memory_order_release);
+}
+
+/**
+ * @brief Finds what the renderer marks up in a message's text, highlights and emotes,
+ * so drawing it only walks the stored spans.
+ */
+void GlobalChat::AnnotateMessage(ChatMessage& message)
+{
+    HighlightIncoming(message);
+    message.emotes.clear();
+    if (emoteSet) {
+        emoteSet->Resolve(message.text, message.emotes);
+    }
+}
+
+/**
+ * @brief Stores where a message's text mentions the player or one of their keywords.
+ * The player's own messages are left plain.
+ */
+void GlobalChat::HighlightIncoming(ChatMessage& message)
+{
+    message.highlights.clear();
+    const auto current = highlighter.load(std::memory_order_acquire);
+    if (!current || (!current->name.empty() && message.user == current->name)) return;
+
+    current->words.Scan(message.text, [&](size_t begin, size_t end, size_t entry) {
+        const bool mention = entry == 0 && !current->name.empty();
+        message.highlights.push_back({ static_cast<uint16_t>(begin), static_cast<uint16_t>(end), mention });
+    });
+    if (message.highlights.size() < 2) return;
+
+    // Matches arrive by end offset; overlapping ones become one span, a mention if either is.
+    auto& spans = message.highlights;
+    std::sort(spans.begin(), spans.end(), [](const TextSpan& a, const TextSpan& b) { return a.begin < b.begin; });
+    size_t merged = 0;
+    for (size_t i = 1; i < spans.size(); ++i)
+    {
+        if (spans[i].begin < spans[merged].end) {
+            spans[merged].end = std::max(spans[merged].end, spans[i].end);
+            spans[merged].mention |= spans[i].mention;
+        }
+        else {
+            spans[++merged] = spans[i];
+        }
+    }
+    spans.resize(merged + 1);
+}
+
+/**
+ * @brief Gathers who sent the messages in the history, for the mute picker. Only runs
+ * again once the history has changed.
+ */
+void GlobalChat::RefreshRecentSenders(const ChatHistory::Snapshot& history)
+{
+    if (history.generation == recentSendersGeneration) return;
+    recentSendersGeneration = history.generation;
+
+    std::set<std::pair<std::string_view, std::string_view>> senders; // User, platform
+    for (const auto& [channel, messages] : history.channels)
+    {
+        if (!messages) continue;
+        for (const auto& message : *messages)
+        {
+            if (message->delivery == DeliveryState::Delivered) {
+                senders.emplace(message->user, message->platform);
             }
         }
     }
-    catch (const json::parse_error& e)
+
+    recentSenders.clear();
+    recentSenderLabels.clear();
+    for (const auto& [user, platform] : senders)
+    {
+        recentSenders.emplace_back(std::string(platform), std::string(user));
+        recentSenderLabels.push_back(std::string(user) + " (" + std::string(platform) + ")");
+    }
+}
+
+/**
+ * @brief Mutes a user and removes their stored messages: one pass over the in-memory
+ * history, and a rewrite of the disk logs that hold any, so scrollback never brings
+ * them back. The disk work runs on the network thread when it is up.
+ * @param platform The user's platform, as sent with their messages.
+ * @param user The user's name.
+ */
+void GlobalChat::MuteUser(const std::string& platform, const std::string& user)
+{
+    auto mute = [this, platform, user]() {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (!muteList.Add(platform, user)) return;
+        ++muteGeneration;
+        if (!muteList.Save(muteListFile)) {
+            WARNLOG("Could not save the mute list to {}", muteListFile.string());
+        }
+
+        // Our own unconfirmed messages are never the muted user's, and are not on disk.
+        auto fromUser = [&](const ChatMessage& message) {
+            return message.delivery == DeliveryState::Delivered && message.user == user && message.platform == platform;
+        };
+        const size_t hidden = chatHistory.RemoveIf(fromUser);
+        const size_t erased = historyLog ? historyLog->RemoveIf(fromUser) : 0;
+        LOG("Muted {} ({}): removed {} stored messages, {} from the disk log.", user, platform, hidden, erased);
+    };
+    if (!wsManager || !wsManager->Post(mute)) {
+        mute();
+    }
+}
+
+/**
+ * @brief Unmutes a user. Messages removed while they were muted do not come back.
+ */
+void GlobalChat::UnmuteUser(const std::string& platform, const std::string& user)
+{
+    std::lock_guard<std::mutex> lock(historyMutex);
+    if (!muteList.Remove(platform, user)) return;
+    ++muteGeneration;
+    if (!muteList.Save(muteListFile)) {
+        WARNLOG("Could not save the mute list to {}", muteListFile.string());
+    }
+}
+
+/**
+ * @brief Stores a chat message received from the server, replacing its local echo if
+ * it is one of ours. Called with historyMutex held.
+ * @param clientId The message's client_id, empty if the server sent none.
+ * @param incoming The decoded message.
+ */
+void GlobalChat::AddServerMessage(const std::string& clientId, ChatMessage incoming)
+{
+    // Stragglers for a channel we just left, sent before the server saw the unsubscribe.
+    if (serverFiltersChannels && !IsSubscribed(incoming.channel)) {
+        GetMetrics().unsubscribedMessages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ScopedLatency appendTimer(GetMetrics().historyAppendTime);
+    ReconcileLocalEcho(clientId, incoming);
+    // After reconciling, so a filtered message of our own still clears its local echo.
+    if (!PrepareIncoming(incoming)) return;
+    const ChatMessage* stored = chatHistory.Append(std::move(incoming));
+    if (!stored) {
+        GetMetrics().duplicateMessages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (historyLog) {
+        historyLog->Append(*stored);
+    }
+    {
+        // A message ends its sender's typing without waiting for their stop frame.
+        std::lock_guard<std::mutex> lock(typingMutex);
+        typists.Stop(stored->channel, stored->platform, stored->user);
+    }
+    if (!stored->highlights.empty())
+    {
+        bool open = false;
+        {
+            std::lock_guard<std::mutex> lock(subscriptionMutex);
+            open = focusedChannel == stored->channel;
+        }
+        if (!open) {
+            std::lock_guard<std::mutex> lock(mentionMutex);
+            ++unreadMentions[stored->channel];
+            ++mentionGeneration;
+        }
+    }
+    // Rasterize any new glyphs now, so they are usually ready by the time the message is drawn.
+    if (glyphCache) {
+        glyphCache->Prefetch(stored->user);
+        glyphCache->Prefetch(stored->text);
+    }
+}
+
+/**
+ * @brief Shows one of our own messages in the history before the server has it.
+ * @param clientId The id sent along with the message, echoed back by the server.
+ * @param message The message as sent.
+ */
+void GlobalChat::AddLocalEcho(const std::string& clientId, ChatMessage message)
+{
+    message.delivery = DeliveryState::Pending;
+    AnnotateMessage(message);
+
+    std::lock_guard<std::mutex> lock(historyMutex);
+    const ChatMessage* stored = chatHistory.Append(std::move(message));
+    if (!stored) return;
+
+    pendingSends[clientId] = PendingSend{ stored->id, std::chrono::steady_clock::now() + SEND_ACK_DEADLINE };
+    pendingSendCount = pendingSends.size();
+}
+
+/**
+ * @brief Removes the local echo of a message that never made it into the outbox. Its
+ * text stays in the input box to be sent again.
+ * @param clientId The id the message was registered under.
+ */
+void GlobalChat::WithdrawLocalEcho(const std::string& clientId)
+{
+    std::lock_guard<std::mutex> lock(historyMutex);
+    auto it = pendingSends.find(clientId);
+    if (it == pendingSends.end()) return;
+
+    chatHistory.Remove(it->second.localId);
+    pendingSends.erase(it);
+    pendingSendCount = pendingSends.size();
+}
+
+/**
+ * @brief Drops the local echo that a server message confirms, so the server's copy
+ * takes its place. Matches on the echoed client id; for a server that does not echo
+ * it, on the oldest pending message with the same channel and content. Called with
+ * historyMutex held.
+ * @param clientId The message's client_id, empty if the server sent none.
+ * @param confirmed The message as received from the server.
+ */
+void GlobalChat::ReconcileLocalEcho(const std::string& clientId, const ChatMessage& confirmed)
+{
+    if (pendingSends.empty()) return;
+
+    auto it = pendingSends.end();
+    if (!clientId.empty())
+    {
+        it = pendingSends.find(clientId);
+    }
+    else
+    {
+        // Client ids end in a zero-padded counter, so map order is send order.
+        it = std::find_if(pendingSends.begin(), pendingSends.end(), [&](const auto& entry) {
+            const ChatMessage* local = chatHistory.Find(entry.second.localId);
+            return local && local->channel == confirmed.channel && SameMessage(*local, confirmed);
+        });
+    }
+    if (it == pendingSends.end()) return;
+
+    chatHistory.Remove(it->second.localId);
+    pendingSends.erase(it);
+    pendingSendCount = pendingSends.size();
+}
+
+/**
+ * @brief Marks local echoes that were not acknowledged in time as failed, and removes
+ * failed ones from the history after a while. Runs on the game thread tick.
+ */
+void GlobalChat::ExpirePendingSends()
+{
+    if (pendingSendCount == 0) return;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now < nextPendingCheck) return;
+    nextPendingCheck = now + PENDING_CHECK_INTERVAL;
+
+    std::lock_guard<std::mutex> lock(historyMutex);
+    for (auto it = pendingSends.begin(); it != pendingSends.end();)
     {
-        LOG("Failed to parse incoming JSON message: {}", e.what());
-        LOG("Original message: {}", message);
+        PendingSend& pending = it->second;
+        if (!pending.failed && now >= pending.deadline)
+        {
+            pending.failed = true;
+            chatHistory.SetDelivery(pending.localId, DeliveryState::Failed);
+        }
+        if (pending.failed && now >= pending.deadline + FAILED_SEND_RETENTION)
+        {
+            chatHistory.Remove(pending.localId);
+            it = pendingSends.erase(it);
+            continue;
+        }
+        ++it;
     }
-}
\ No newline at end of file
+    pendingSendCount = pendingSends.size();
+}
@@ -6,12 +6,26 @@
 #include "bakkesmod/plugin/PluginSettingsWindow.h"
 #include "version.h"
 #include "WSManager.h"
+#include "ChatHistory.h"
+#include "TokenBucket.h"
+#include "StressTest.h"
+#include "HistoryLog.h"
+#include "ChatMetrics.h"
+#include "GlyphCache.h"
+#include "ChatFilter.h"
+#include "MuteList.h"
+#include "EmoteSet.h"
+#include "TypingTracker.h"
 
 #include "json.hpp"
+#include <atomic>
 #include <chrono>
+#include <filesystem>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -37,11 +51,30 @@ public:
 private:
     // WebSocket Communication
     void OnWSConnect();
-    void OnWSMessage(std::string_view message);
+    void OnWSMessage(std::string_view message, bool binary);
+    void AddServerMessage(const std::string& clientId, ChatMessage incoming);
     void OnWSError(std::string_view error);
     void OnWSDisconnect();
-    void SendChatMessage(const std::string& channel, const std::string& text);
+    bool SendChatMessage(const std::string& channel, const std::string& text);
+    bool SendFrame(WSManager::Serializer serialize);
     std::unique_ptr<WSManager> wsManager;
+    std::unique_ptr<StressTest> stressTest; // globalchat_stress; joined before wsManager goes away
+    // Shared by every outbound frame so the server's flood protection is never tripped.
+    // The server may replace these defaults with a "rate_limit" message. Typing frames only
+    // take a token when one is left for chat, so a burst of 1 leaves typing indicators off.
+    static constexpr double DEFAULT_SEND_RATE = 1.0; // Frames per second
+    static constexpr uint32_t DEFAULT_SEND_BURST = 2;
+    TokenBucket sendLimiter{ DEFAULT_SEND_RATE, DEFAULT_SEND_BURST };
+    bool hasConnected = false;
+
+    // Startup Trace
+    void LogStartupTrace();
+    std::chrono::steady_clock::time_point loadStartTime;
+    bool startupTraceLogged = false;
+
+    // Settings Tabs
+    void RenderGeneralSettings();
+    void RenderDiagnostics();
 
     // Rank Display
     struct RankDisplayInfo {
@@ -50,14 +83,183 @@ private:
     };
     RankDisplayInfo GetRankDisplayInfo(int tier);
 
+    // Message Rendering
+    void RenderMessage(const ChatMessage& message, bool showChannel);
+    void RenderSearchResults();
+
     // UI State & Data
+    static constexpr size_t MAX_HISTORY_PER_CHANNEL = 150;
     std::string currentChannel;
-    std::vector<std::string> channels;
-    std::map<std::string, std::vector<json>> chatHistory;
+    ChatHistory chatHistory{ MAX_HISTORY_PER_CHANNEL };
     std::mutex historyMutex;
     char inputTextBuffer[256]{};
-    std::chrono::steady_clock::time_point lastMessageTime;
+    char sendButtonLabel[32]{};
     HMODULE moduleHandle_ = nullptr;
 
+    // Search
+    static constexpr size_t MAX_SEARCH_HITS = 100;
+    char searchBuffer[64]{};
+    std::string lastSearchQuery;
+    uint64_t lastSearchGeneration = 0;
+    std::vector<ChatHistory::MessagePtr> searchResults;
+
+    // Persistent History
+    static constexpr size_t MAX_PERSISTED_PER_CHANNEL = 2000;
+    static constexpr size_t MAX_SCROLLBACK_PER_CHANNEL = 1000;
+    static constexpr size_t SCROLLBACK_PAGE_SIZE = 50;
+    void WarmStartFromDisk(const std::filesystem::path& directory);
+    void MergeServerHistory(const std::string& channel, std::vector<ChatMessage> serverMessages);
+    void LoadOlderFromDisk(const std::string& channel);
+    std::unique_ptr<HistoryLog> historyLog;
+    std::atomic<bool> hasHistoryLog{ false }; // Lets the render thread check historyLog without the lock
+    std::set<std::string> diskExhaustedChannels; // Guarded by historyMutex
+
+    // Scrollback Paging
+    // The server's bootstrap carries only the newest few messages of each channel; older
+    // pages are read from the disk log, then requested from the server, when the message
+    // list is scrolled to the top. scrollbackPages is guarded by historyMutex.
+    static constexpr size_t BOOTSTRAP_HISTORY_PER_CHANNEL = 30;
+    static constexpr auto SCROLLBACK_REQUEST_TIMEOUT = std::chrono::seconds(5);
+    struct ScrollbackPaging {
+        std::chrono::steady_clock::time_point retryAt; // Until then a disk read or server request is outstanding
+        bool exhausted = false; // The server has nothing older
+    };
+    std::map<std::string, ScrollbackPaging> scrollbackPages;
+    std::string scrollAnchorChannel; // Render thread
+    uint64_t scrollAnchorId = 0; // Id of the first message drawn last frame; render thread
+    bool LoadOlderMessages(const std::string& channel);
+    void AddOlderPage(const std::string& channel, std::vector<ChatMessage> older, bool more);
+
+    // Local Echo
+    // Our own messages are shown at once as pending and swapped for the server's copy when
+    // it arrives. pendingSends is guarded by historyMutex.
+    static constexpr auto SEND_ACK_DEADLINE = std::chrono::seconds(10);
+    static constexpr auto FAILED_SEND_RETENTION = std::chrono::minutes(1); // Shown as failed this long; late acks still reconcile
+    static constexpr auto PENDING_CHECK_INTERVAL = std::chrono::milliseconds(250);
+    struct PendingSend {
+        uint64_t localId = 0;
+        std::chrono::steady_clock::time_point deadline;
+        bool failed = false;
+    };
+    std::map<std::string, PendingSend> pendingSends; // By client id
+    std::atomic<size_t> pendingSendCount{ 0 }; // Lets the game tick skip the lock when idle
+    std::string clientIdPrefix; // Random per session
+    uint64_t nextClientId = 0; // Render thread
+    std::chrono::steady_clock::time_point nextPendingCheck; // Game thread
+    void AddLocalEcho(const std::string& clientId, ChatMessage message);
+    void WithdrawLocalEcho(const std::string& clientId);
+    void ReconcileLocalEcho(const std::string& clientId, const ChatMessage& confirmed);
+    void ExpirePendingSends();
+
+    // Channel Subscriptions
+    // The server only sends the channels we subscribe to; see UpdateSubscriptions.
+    static constexpr auto SUBSCRIPTION_CHECK_INTERVAL = std::chrono::milliseconds(250);
+    std::mutex subscriptionMutex;
+    std::string focusedChannel; // currentChannel, for the game thread
+    std::set<std::string> pinnedChannels;
+    std::atomic<uint64_t> pinnedGeneration{ 0 }; // Bumped with every change to pinnedChannels
+    std::set<std::string> pinnedView; // Render thread copy, as of pinnedViewGeneration
+    uint64_t pinnedViewGeneration = 0;
+    std::set<std::string> subscribedChannels; // As told to the server on this connection
+    bool subscriptionsSent = false; // Whether this connection got its full set yet
+    std::atomic<bool> serverFiltersChannels{ false }; // The server acknowledged a subscription
+    std::chrono::steady_clock::time_point nextSubscriptionCheck; // Game thread
+    void SelectChannel(const std::string& channel);
+    void SetChannelPinned(const std::string& channel, bool pinned);
+    bool IsSubscribed(const std::string& channel);
+    void UpdateSubscriptions();
+
+    // Chat Filter
+    // Compiled whenever the word list changes and swapped in whole; the network thread
+    // applies it to every incoming message before it is stored.
+    std::atomic<std::shared_ptr<const ChatFilter>> chatFilter;
+    std::atomic<ChatFilter::Mode> chatFilterMode{ ChatFilter::Mode::Off };
+    std::filesystem::path chatFilterFile;
+    void LoadChatFilter();
+    bool PrepareIncoming(ChatMessage& message);
+    void PrepareIncoming(std::vector<ChatMessage>& messages);
+
+    // Highlights
+    // The player's name and globalchat_highlight_words are matched once per message at
+    // ingest; the renderer only colors the stored spans.
+    struct Highlighter {
+        ChatFilter words; // Entry 0 is the player's name, if known
+        std::string name;
+    };
+    std::atomic<std::shared_ptr<const Highlighter>> highlighter;
+    std::mutex mentionMutex;
+    std::map<std::string, size_t> unreadMentions; // Highlighted messages per channel since it was last open
+    std::atomic<uint64_t> mentionGeneration{ 0 }; // Bumped with every change to unreadMentions
+    std::map<std::string, size_t> mentionView; // Render thread copy, as of mentionViewGeneration
+    uint64_t mentionViewGeneration = 0;
+    void LoadHighlighter();
+    void HighlightIncoming(ChatMessage& message);
+    void AnnotateMessage(ChatMessage& message);
+    void RenderRichText(const ChatMessage& message);
+
+    // Muted Users
+    // Checked at ingest. Muting also removes the user's stored messages, in memory and in
+    // the disk log, so nothing is checked per frame. muteList is guarded by historyMutex.
+    MuteList muteList;
+    std::atomic<uint64_t> muteGeneration{ 0 }; // Bumped with every change to muteList
+    std::vector<MuteList::Entry> mutedView; // Render thread copy, as of mutedViewGeneration
+    uint64_t mutedViewGeneration = 0;
+    std::filesystem::path muteListFile;
+    void MuteUser(const std::string& platform, const std::string& user);
+    void UnmuteUser(const std::string& platform, const std::string& user);
+
+    // Pickers
+    // Searchable combos over the channels and over recent senders (to mute). They read the
+    // items in place; render thread only.
+    ImGui::SearchableComboState channelPicker;
+    ImGui::SearchableComboState mutePicker;
+    std::vector<std::pair<std::string, std::string>> recentSenders; // Platform, user
+    std::vector<std::string> recentSenderLabels;
+    uint64_t recentSendersGeneration = 0; // Of the history snapshot they were gathered from
+    void RefreshRecentSenders(const ChatHistory::Snapshot& history);
+
+    // Typing Indicators
+    // Our typing state goes out as "typing" frames, at most one per channel per
+    // TYPING_FRAME_INTERVAL, each taking a token from sendLimiter when one is left over for
+    // chat (or waiting for a later render frame when there is none). A frame still waiting in the outbox is replaced by
+    // the next one for its channel. Other users' arrive in typists.
+    static constexpr auto TYPING_FRAME_INTERVAL = std::chrono::seconds(2);
+    static constexpr auto TYPING_REFRESH_INTERVAL = std::chrono::seconds(4); // Well under TypingTracker::TTL
+    struct TypingSent {
+        bool typing = false;
+        std::chrono::steady_clock::time_point lastFrame;
+    };
+    std::map<std::string, TypingSent> typingSent; // By channel; render thread
+    std::mutex typingMutex;
+    TypingTracker typists; // Guarded by typingMutex
+    char typingLabel[160]{}; // Render thread
+    void UpdateTyping(bool typing);
+    bool SendTyping(const std::string& channel, bool typing);
+    void OnTypingFrame(const json& payload);
+    void RenderTypingIndicator();
+
+    // Chat Font
+    // Messages and the input box draw with a font whose non-ASCII glyphs load on demand.
+    std::unique_ptr<GlyphCache> glyphCache;
+    ImFont* chatFont = nullptr; // This frame's, or nullptr for the default font; render thread
+
+    // Emotes
+    // :shortcode: images from globalchat/emotes, resolved at ingest and drawn from the
+    // chat font's texture. Read once at load.
+    std::unique_ptr<EmoteSet> emoteSet;
+
+    // Sender Identity
+    // Game-wrapper reads needed to send, cached on the game thread.
+    static constexpr auto PLAYER_INFO_REFRESH = std::chrono::seconds(5);
+    struct PlayerInfo {
+        std::string name;
+        std::string platform;
+        int highestRank = -1;
+    };
+    std::optional<PlayerInfo> playerInfo; // Empty until a player name could be read
+    std::mutex playerInfoMutex;
+    std::chrono::steady_clock::time_point nextPlayerInfoRefresh; // Game thread
+    void RefreshPlayerInfo();
+
     const std::string TOGGLE_KEY = "F3";
 };
\ No newline at end of file
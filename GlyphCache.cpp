@@ -0,0 +1,532 @@
+#include "pch.h"
+#include "GlyphCache.h"
+#include "ChatMetrics.h"
+#include "MappedFile.h"
+
+#include "IMGUI/imgui_internal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// ImGui compiles stb_truetype privately into imgui_draw.cpp, so this file has its own copy.
+// It keeps stb's malloc/free rather than ImGui's allocator, which is not for other threads.
+#ifdef _MSC_VER
+#pragma warning (push)
+#pragma warning (disable: 4456) // declaration of 'xx' hides previous local declaration
+#endif
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "IMGUI/imstb_truetype.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#ifdef _MSC_VER
+#pragma warning (pop)
+#endif
+
+#include <d3d11.h>
+
+struct FontSet::Font
+{
+    explicit Font(const std::filesystem::path& path) : file(path) {}
+
+    MappedFile file;
+    stbtt_fontinfo info{};
+    float scale = 1.0f;
+};
+
+FontSet::FontSet() = default;
+FontSet::~FontSet() = default;
+
+bool FontSet::Load(const std::vector<std::filesystem::path>& files, float sizePixels)
+{
+    sizePixels_ = sizePixels;
+    for (const auto& path : files)
+    {
+        auto font = std::make_unique<Font>(path);
+        const unsigned char* data = font->file.Data();
+        if (!data) continue;
+
+        // Collections (.ttc) use their first face.
+        const int offset = stbtt_GetFontOffsetForIndex(data, 0);
+        if (offset < 0 || !stbtt_InitFont(&font->info, data, offset))
+        {
+            WARNLOG("Skipping chat font {}: not a font file stb_truetype can read", path.string());
+            continue;
+        }
+        font->scale = stbtt_ScaleForPixelHeight(&font->info, sizePixels);
+
+        if (fonts_.empty())
+        {
+            int ascent = 0, descent = 0, lineGap = 0;
+            stbtt_GetFontVMetrics(&font->info, &ascent, &descent, &lineGap);
+            ascent_ = std::floor(ascent * font->scale + (ascent > 0 ? 1.0f : -1.0f));
+            descent_ = std::floor(descent * font->scale + (descent > 0 ? 1.0f : -1.0f));
+        }
+        fonts_.push_back(std::move(font));
+    }
+    return !fonts_.empty();
+}
+
+void FontSet::Rasterize(ImWchar codepoint, int maxSize, Glyph& glyph) const
+{
+    glyph = Glyph{};
+    glyph.codepoint = codepoint;
+    for (const auto& font : fonts_)
+    {
+        const int index = stbtt_FindGlyphIndex(&font->info, codepoint);
+        if (index == 0) continue;
+
+        int advance = 0, leftBearing = 0;
+        stbtt_GetGlyphHMetrics(&font->info, index, &advance, &leftBearing);
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        stbtt_GetGlyphBitmapBox(&font->info, index, font->scale, font->scale, &x0, &y0, &x1, &y1);
+
+        glyph.found = true;
+        glyph.x0 = x0;
+        glyph.y0 = y0;
+        glyph.width = std::clamp(x1 - x0, 0, maxSize);
+        glyph.height = std::clamp(y1 - y0, 0, maxSize);
+        glyph.advance = std::round(advance * font->scale);
+        glyph.alpha.resize(static_cast<size_t>(glyph.width) * glyph.height);
+        if (!glyph.alpha.empty())
+        {
+            stbtt_MakeGlyphBitmap(&font->info, glyph.alpha.data(), glyph.width, glyph.height, glyph.width, font->scale, font->scale, index);
+        }
+        return;
+    }
+}
+
+size_t FontSet::MappedBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& font : fonts_) bytes += font->file.Size();
+    return bytes;
+}
+
+std::vector<std::filesystem::path> FontSet::ResolveFiles(const std::string& list)
+{
+    // Latin, Greek and Cyrillic; Chinese; Japanese; Korean; symbols; emoji outlines.
+    static const char* defaults = "segoeui.ttf;msyh.ttc;YuGothM.ttc;malgun.ttf;seguisym.ttf;seguiemj.ttf";
+
+    const char* windows = std::getenv("WINDIR");
+    const std::filesystem::path fontsFolder = std::filesystem::path(windows ? windows : "C:\\Windows") / "Fonts";
+
+    std::vector<std::filesystem::path> files;
+    const std::string_view names = list.empty() ? std::string_view(defaults) : std::string_view(list);
+    size_t start = 0;
+    while (start <= names.size())
+    {
+        size_t end = names.find(';', start);
+        if (end == std::string_view::npos) end = names.size();
+
+        std::string_view name = names.substr(start, end - start);
+        while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+        if (!name.empty())
+        {
+            const std::filesystem::path path(name);
+            files.push_back(path.is_absolute() ? path : fontsFolder / path);
+        }
+        start = end + 1;
+    }
+    return files;
+}
+
+GlyphCache::GlyphCache(std::vector<std::filesystem::path> fontFiles, float sizePixels)
+{
+    cellSize_ = CellSize(sizePixels);
+    textureWidth_ = static_cast<int>(COLUMNS) * cellSize_;
+    imageTop_ = static_cast<int>((CAPACITY + 1 + COLUMNS - 1) / COLUMNS) * cellSize_; // +1 for the white cell
+    textureHeight_ = imageTop_ + IMAGE_REGION_HEIGHT;
+    worker_ = std::thread(&GlyphCache::Run, this, std::move(fontFiles), sizePixels);
+}
+
+GlyphCache::~GlyphCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (worker_.joinable()) worker_.join();
+
+    atlas_.reset();
+    if (view_) view_->Release();
+    if (texture_) texture_->Release();
+    if (context_) context_->Release();
+}
+
+int GlyphCache::CellSize(float sizePixels)
+{
+    // Wide CJK and emoji glyphs can overhang the em box a little; one pixel of padding per side.
+    return static_cast<int>(std::ceil(sizePixels * 1.25f)) + 2;
+}
+
+size_t GlyphCache::TextureBytes(float sizePixels)
+{
+    const size_t cell = static_cast<size_t>(CellSize(sizePixels));
+    return COLUMNS * cell * (((CAPACITY + 1 + COLUMNS - 1) / COLUMNS) * cell + IMAGE_REGION_HEIGHT) * 4;
+}
+
+GlyphCache::Stats GlyphCache::GetStats() const
+{
+    Stats stats;
+    stats.resident = resident_.load(std::memory_order_relaxed);
+    stats.textureBytes = static_cast<size_t>(textureWidth_) * textureHeight_ * 4;
+    stats.fontBytes = fontsLoaded_ ? fonts_.MappedBytes() : 0;
+    stats.unavailable = unavailable_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void GlyphCache::CollectCodepoints(std::string_view utf8, std::vector<ImWchar>& out)
+{
+    const char* text = utf8.data();
+    const char* end = text + utf8.size();
+    while (text < end)
+    {
+        if (static_cast<unsigned char>(*text) < 0x80)
+        {
+            ++text;
+            continue;
+        }
+        unsigned int codepoint = 0;
+        text += ImTextCharFromUtf8(&codepoint, text, end);
+        // ImWchar is 16 bits in this ImGui, so glyphs past the BMP can't be drawn anyway.
+        if (codepoint != 0 && codepoint <= IM_UNICODE_CODEPOINT_MAX)
+        {
+            out.push_back(static_cast<ImWchar>(codepoint));
+        }
+    }
+}
+
+void GlyphCache::Prefetch(std::string_view utf8)
+{
+    std::vector<ImWchar> codepoints;
+    CollectCodepoints(utf8, codepoints);
+    if (!codepoints.empty()) Enqueue(codepoints, false);
+}
+
+void GlyphCache::Enqueue(const std::vector<ImWchar>& codepoints, bool front)
+{
+    const auto now = std::chrono::steady_clock::now();
+    bool added = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ImWchar codepoint : codepoints)
+        {
+            if (!known_.insert(codepoint).second) continue;
+            if (front) queue_.push_front({ codepoint, now });
+            else queue_.push_back({ codepoint, now });
+            added = true;
+        }
+    }
+    if (added) wake_.notify_one();
+}
+
+void GlyphCache::Run(std::vector<std::filesystem::path> fontFiles, float sizePixels)
+{
+    const auto started = std::chrono::steady_clock::now();
+    if (!fonts_.Load(fontFiles, sizePixels))
+    {
+        WARNLOG("No chat font could be loaded (globalchat_fonts); chat text uses the default font.");
+        return;
+    }
+    LOG("Chat fonts: {} of {} loaded in {} ms", fonts_.Count(), fontFiles.size(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+
+    // The pinned set goes ahead of anything requested while loading.
+    std::vector<ImWchar> pinned;
+    for (ImWchar codepoint = LAST_PINNED; codepoint >= FIRST_PINNED; --codepoint) pinned.push_back(codepoint);
+    Enqueue(pinned, true);
+    fontsLoaded_.store(true, std::memory_order_release);
+
+    const int maxSize = cellSize_ - 2;
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            request = queue_.front();
+            queue_.pop_front();
+        }
+
+        ReadyGlyph ready;
+        fonts_.Rasterize(request.codepoint, maxSize, ready.glyph);
+        ready.requestedAt = request.requestedAt;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(std::move(ready));
+    }
+}
+
+ImFont* GlyphCache::BeginFrame()
+{
+    if (!fontsLoaded_.load(std::memory_order_acquire) || textureFailed_) return nullptr;
+    if (!font_ && !CreateTexture())
+    {
+        textureFailed_ = true;
+        WARNLOG("Could not create the chat glyph texture; chat text uses the default font.");
+        return nullptr;
+    }
+
+    ++frame_;
+    InstallReady();
+    return pinnedRemaining_ == 0 ? font_ : nullptr;
+}
+
+bool GlyphCache::CreateTexture()
+{
+    auto* sharedView = static_cast<ID3D11ShaderResourceView*>(ImGui::GetIO().Fonts->TexID);
+    if (!sharedView) return false;
+
+    ID3D11Device* device = nullptr;
+    sharedView->GetDevice(&device);
+    if (!device) return false;
+
+    // Transparent white everywhere except the solid white cell.
+    std::vector<uint32_t> pixels(static_cast<size_t>(textureWidth_) * textureHeight_, 0x00FFFFFFu);
+    for (int y = 0; y < cellSize_; ++y)
+    {
+        std::fill_n(pixels.begin() + static_cast<size_t>(y) * textureWidth_, cellSize_, 0xFFFFFFFFu);
+    }
+
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = static_cast<UINT>(textureWidth_);
+    desc.Height = static_cast<UINT>(textureHeight_);
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA initial{};
+    initial.pSysMem = pixels.data();
+    initial.SysMemPitch = static_cast<UINT>(textureWidth_) * 4;
+
+    const bool created = SUCCEEDED(device->CreateTexture2D(&desc, &initial, &texture_)) &&
+        SUCCEEDED(device->CreateShaderResourceView(texture_, nullptr, &view_));
+    if (created) device->GetImmediateContext(&context_);
+    device->Release();
+    if (!created) return false;
+
+    // An atlas that is never built: it only carries the texture and white pixel for the font.
+    atlas_ = std::make_unique<ImFontAtlas>();
+    atlas_->TexID = view_;
+    atlas_->TexWidth = textureWidth_;
+    atlas_->TexHeight = textureHeight_;
+    atlas_->TexUvScale = ImVec2(1.0f / textureWidth_, 1.0f / textureHeight_);
+    atlas_->TexUvWhitePixel = ImVec2(0.5f * cellSize_ / textureWidth_, 0.5f * cellSize_ / textureHeight_);
+
+    font_ = IM_NEW(ImFont);
+    font_->FontSize = fonts_.SizePixels();
+    font_->Ascent = fonts_.Ascent();
+    font_->Descent = fonts_.Descent();
+    font_->ContainerAtlas = atlas_.get();
+    atlas_->Fonts.push_back(font_);
+
+    cells_.resize(CAPACITY + 1);
+    for (size_t cell = CAPACITY; cell > WHITE_CELL; --cell) freeCells_.push_back(static_cast<uint16_t>(cell));
+    uploadBuffer_.resize(static_cast<size_t>(cellSize_ - 2) * (cellSize_ - 2));
+    return true;
+}
+
+void GlyphCache::InstallReady()
+{
+    std::vector<ReadyGlyph> batch = std::move(deferred_);
+    deferred_.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Pinned glyphs always go in; the rest a frame's worth at a time.
+        size_t taken = 0;
+        auto it = ready_.begin();
+        for (; it != ready_.end() && (taken < MAX_INSTALLS_PER_FRAME || pinnedRemaining_ > 0); ++it, ++taken)
+        {
+            batch.push_back(std::move(*it));
+        }
+        ready_.erase(ready_.begin(), it);
+    }
+    if (batch.empty()) return;
+
+    ScopedLatency timer(GetMetrics().glyphUpload);
+    const auto now = std::chrono::steady_clock::now();
+
+    // BuildLookupTable appends a tab glyph after the last one; drop it so cell glyph indices stay put.
+    if (!font_->Glyphs.empty() && font_->Glyphs.back().Codepoint == '\t') font_->Glyphs.pop_back();
+
+    for (auto& ready : batch)
+    {
+        const FontSet::Glyph& glyph = ready.glyph;
+        const bool pinned = IsPinned(glyph.codepoint);
+        if (residentCells_.count(glyph.codepoint)) continue;
+        if (!glyph.found)
+        {
+            requested_.erase(glyph.codepoint);
+            missing_.insert(glyph.codepoint);
+            unavailable_.fetch_add(1, std::memory_order_relaxed);
+            if (pinned) --pinnedRemaining_;
+            continue;
+        }
+
+        const int cell = AllocateCell(pinned);
+        if (cell < 0)
+        {
+            deferred_.push_back(std::move(ready));
+            continue;
+        }
+
+        UploadCell(cell, glyph);
+        SetGlyph(cell, glyph);
+        residentCells_[glyph.codepoint] = static_cast<uint16_t>(cell);
+        requested_.erase(glyph.codepoint);
+        if (pinned) --pinnedRemaining_;
+        else GetMetrics().glyphWait.Record(now - ready.requestedAt);
+    }
+
+    resident_.store(residentCells_.size(), std::memory_order_relaxed);
+    font_->BuildLookupTable();
+}
+
+int GlyphCache::AllocateCell(bool pinned)
+{
+    uint16_t cell = 0;
+    if (!freeCells_.empty())
+    {
+        cell = freeCells_.back();
+        freeCells_.pop_back();
+    }
+    else
+    {
+        if (lru_.empty()) return -1;
+        cell = lru_.back();
+        Cell& victim = cells_[cell];
+        if (victim.lastUsedFrame == frame_) return -1; // Everything evictable is on screen
+
+        lru_.pop_back();
+        residentCells_.erase(victim.codepoint);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            known_.erase(victim.codepoint);
+        }
+        GetMetrics().glyphEvictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Cell& slot = cells_[cell];
+    slot.pinned = pinned;
+    slot.lastUsedFrame = frame_;
+    if (!pinned)
+    {
+        lru_.push_front(cell);
+        slot.lruPosition = lru_.begin();
+    }
+    return cell;
+}
+
+void GlyphCache::UploadCell(int cell, const FontSet::Glyph& glyph)
+{
+    // The whole inside of the cell, so nothing of the previous glyph bleeds in when sampled.
+    const int inner = cellSize_ - 2;
+    std::fill(uploadBuffer_.begin(), uploadBuffer_.end(), 0x00FFFFFFu);
+    for (int y = 0; y < glyph.height; ++y)
+    {
+        for (int x = 0; x < glyph.width; ++x)
+        {
+            const uint32_t alpha = glyph.alpha[static_cast<size_t>(y) * glyph.width + x];
+            uploadBuffer_[static_cast<size_t>(y) * inner + x] = (alpha << 24) | 0x00FFFFFFu;
+        }
+    }
+
+    const UINT left = static_cast<UINT>((cell % COLUMNS) * cellSize_ + 1);
+    const UINT top = static_cast<UINT>((cell / COLUMNS) * cellSize_ + 1);
+    const D3D11_BOX box{ left, top, 0, left + inner, top + inner, 1 };
+    context_->UpdateSubresource(texture_, 0, &box, uploadBuffer_.data(), static_cast<UINT>(inner) * 4, 0);
+}
+
+bool GlyphCache::UploadImage(int x, int y, int width, int height, const uint32_t* pixels)
+{
+    if (!context_ || x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > textureWidth_ || y + height > IMAGE_REGION_HEIGHT) return false;
+
+    const UINT left = static_cast<UINT>(x);
+    const UINT top = static_cast<UINT>(imageTop_ + y);
+    const D3D11_BOX box{ left, top, 0, left + static_cast<UINT>(width), top + static_cast<UINT>(height), 1 };
+    context_->UpdateSubresource(texture_, 0, &box, pixels, static_cast<UINT>(width) * 4, 0);
+    return true;
+}
+
+ImVec2 GlyphCache::ImageUv(float x, float y) const
+{
+    return ImVec2(x / textureWidth_, (imageTop_ + y) / textureHeight_);
+}
+
+void GlyphCache::SetGlyph(int cell, const FontSet::Glyph& glyph)
+{
+    const float left = static_cast<float>((cell % COLUMNS) * cellSize_ + 1);
+    const float top = static_cast<float>((cell / COLUMNS) * cellSize_ + 1);
+
+    ImFontGlyph entry{};
+    entry.Codepoint = glyph.codepoint;
+    entry.AdvanceX = glyph.advance;
+    entry.X0 = static_cast<float>(glyph.x0);
+    entry.Y0 = static_cast<float>(glyph.y0) + font_->Ascent;
+    entry.X1 = entry.X0 + glyph.width;
+    entry.Y1 = entry.Y0 + glyph.height;
+    entry.U0 = left / textureWidth_;
+    entry.V0 = top / textureHeight_;
+    entry.U1 = (left + glyph.width) / textureWidth_;
+    entry.V1 = (top + glyph.height) / textureHeight_;
+
+    Cell& slot = cells_[cell];
+    slot.codepoint = glyph.codepoint;
+    if (slot.glyphIndex < 0)
+    {
+        slot.glyphIndex = font_->Glyphs.Size;
+        font_->Glyphs.push_back(entry);
+    }
+    else
+    {
+        font_->Glyphs[slot.glyphIndex] = entry;
+    }
+}
+
+void GlyphCache::MarkUsed(uint16_t cell)
+{
+    Cell& slot = cells_[cell];
+    if (slot.lastUsedFrame == frame_) return;
+    slot.lastUsedFrame = frame_;
+    if (!slot.pinned) lru_.splice(lru_.begin(), lru_, slot.lruPosition);
+}
+
+void GlyphCache::Touch(std::string_view utf8)
+{
+    if (!font_) return;
+
+    scratch_.clear();
+    CollectCodepoints(utf8, scratch_);
+    size_t missing = 0;
+    for (ImWchar codepoint : scratch_)
+    {
+        auto it = residentCells_.find(codepoint);
+        if (it != residentCells_.end())
+        {
+            MarkUsed(it->second);
+        }
+        else if (!missing_.count(codepoint) && requested_.insert(codepoint).second)
+        {
+            scratch_[missing++] = codepoint;
+        }
+    }
+    if (missing > 0)
+    {
+        scratch_.resize(missing);
+        Enqueue(scratch_, true); // On screen now, so ahead of prefetches
+    }
+}
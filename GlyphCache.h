@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ID3D11Texture2D;
+struct ID3D11ShaderResourceView;
+struct ID3D11DeviceContext;
+
+/**
+ * @brief The font files chat text is drawn from, tried in order for each codepoint.
+ * Files are memory-mapped, so only the pages of glyphs actually used are read.
+ * Read-only once loaded, so any thread can rasterize from it.
+ */
+class FontSet
+{
+public:
+    struct Glyph
+    {
+        ImWchar codepoint = 0;
+        bool found = false; // False when no font has it; drawn as the fallback character
+        int x0 = 0, y0 = 0; // Bitmap offset from the pen position on the baseline
+        int width = 0, height = 0;
+        float advance = 0.0f;
+        std::vector<unsigned char> alpha; // width * height coverage values
+    };
+
+    FontSet();
+    ~FontSet();
+
+    FontSet(const FontSet&) = delete;
+    FontSet& operator=(const FontSet&) = delete;
+
+    // Maps the files that exist and hold a usable font; false if none do.
+    bool Load(const std::vector<std::filesystem::path>& files, float sizePixels);
+    // Rasterizes a codepoint from the first font that has it, clipped to maxSize pixels square.
+    void Rasterize(ImWchar codepoint, int maxSize, Glyph& glyph) const;
+
+    size_t Count() const { return fonts_.size(); }
+    size_t MappedBytes() const;
+    float SizePixels() const { return sizePixels_; }
+    // Vertical metrics of the first font, in pixels, rounded the way ImGui rounds its own.
+    float Ascent() const { return ascent_; }
+    float Descent() const { return descent_; }
+
+    // Parses a globalchat_fonts value: files separated by ';', relative names taken from the
+    // Windows fonts folder. Empty gives a chain covering Latin, Cyrillic, CJK and symbols.
+    static std::vector<std::filesystem::path> ResolveFiles(const std::string& list);
+
+private:
+    struct Font;
+
+    std::vector<std::unique_ptr<Font>> fonts_;
+    float sizePixels_ = 0.0f;
+    float ascent_ = 0.0f;
+    float descent_ = 0.0f;
+};
+
+/**
+ * @brief On-demand glyph cache for chat text.
+ *
+ * Instead of baking large Unicode ranges into the shared ImGui atlas at startup, chat
+ * text gets its own font and texture. The texture is a grid of fixed-size cells; printable
+ * ASCII is pinned, every other glyph is rasterized on a worker thread the first time it
+ * is needed (when a message is ingested, or when it is drawn) and uploaded into a single
+ * cell. When the grid is full the least recently drawn glyph gives up its cell.
+ *
+ * Font and texture changes happen in BeginFrame on the render thread, between frames.
+ * Until a glyph is ready ImGui draws the fallback character in its place.
+ *
+ * Below the cells the texture keeps a region for other images drawn inline with chat text
+ * (emotes), so they batch into the same draw call as the text around them.
+ *
+ * Assumes the renderer is Direct3D 11 with ImTextureID being a shader resource view,
+ * which is what BakkesMod uses; the device is taken from the shared atlas texture.
+ */
+class GlyphCache
+{
+public:
+    static constexpr size_t CAPACITY = 1024; // Glyph cells, pinned ones included
+    static constexpr size_t MAX_INSTALLS_PER_FRAME = 32; // Bounds the upload work in a single frame
+    static constexpr int IMAGE_REGION_HEIGHT = 512; // Pixels below the glyph cells
+
+    struct Stats
+    {
+        size_t resident = 0;
+        size_t capacity = CAPACITY;
+        size_t textureBytes = 0;
+        size_t fontBytes = 0; // Mapped, mostly not resident
+        uint64_t unavailable = 0; // Codepoints no font has
+    };
+
+    GlyphCache(std::vector<std::filesystem::path> fontFiles, float sizePixels);
+    ~GlyphCache();
+
+    GlyphCache(const GlyphCache&) = delete;
+    GlyphCache& operator=(const GlyphCache&) = delete;
+
+    // Any thread: queues rasterization of the text's glyphs that are not cached yet.
+    void Prefetch(std::string_view utf8);
+
+    // Render thread, once per frame before chat text is drawn. Installs the glyphs the
+    // worker has finished and uploads their cells. Returns the font to push for chat text,
+    // or nullptr while the fonts are loading (or if none could be loaded).
+    ImFont* BeginFrame();
+
+    // Render thread: marks the text's glyphs as drawn this frame, so they are the last to
+    // be evicted, and requests the ones that are missing.
+    void Touch(std::string_view utf8);
+
+    Stats GetStats() const;
+
+    // Width of the image region, in pixels; fixed by the font size.
+    int ImageRegionWidth() const { return textureWidth_; }
+    // Render thread, after BeginFrame returned a font: copies RGBA pixels into the image region.
+    bool UploadImage(int x, int y, int width, int height, const uint32_t* pixels);
+    // Texture coordinates of a point in the image region.
+    ImVec2 ImageUv(float x, float y) const;
+    // The texture the chat font draws from; nullptr until it exists.
+    ImTextureID TextureId() const { return view_; }
+
+    // Texture size for a font size, as allocated by BeginFrame.
+    static size_t TextureBytes(float sizePixels);
+
+private:
+    static constexpr ImWchar FIRST_PINNED = 0x20;
+    static constexpr ImWchar LAST_PINNED = 0x7E;
+    static constexpr uint16_t WHITE_CELL = 0; // Solid cell for ImGui's white pixel
+    static constexpr size_t COLUMNS = 32;
+
+    struct Request
+    {
+        ImWchar codepoint = 0;
+        std::chrono::steady_clock::time_point requestedAt;
+    };
+
+    struct ReadyGlyph
+    {
+        FontSet::Glyph glyph;
+        std::chrono::steady_clock::time_point requestedAt;
+    };
+
+    struct Cell
+    {
+        ImWchar codepoint = 0;
+        int glyphIndex = -1; // In font_->Glyphs; reused by the cell's next glyph
+        uint64_t lastUsedFrame = 0;
+        bool pinned = false;
+        std::list<uint16_t>::iterator lruPosition;
+    };
+
+    static bool IsPinned(ImWchar codepoint) { return codepoint >= FIRST_PINNED && codepoint <= LAST_PINNED; }
+    static int CellSize(float sizePixels);
+    // Appends the text's non-ASCII codepoints that ImWchar can hold.
+    static void CollectCodepoints(std::string_view utf8, std::vector<ImWchar>& out);
+
+    void Run(std::vector<std::filesystem::path> fontFiles, float sizePixels);
+    void Enqueue(const std::vector<ImWchar>& codepoints, bool front);
+    bool CreateTexture();
+    void InstallReady();
+    int AllocateCell(bool pinned);
+    void UploadCell(int cell, const FontSet::Glyph& glyph);
+    void SetGlyph(int cell, const FontSet::Glyph& glyph);
+    void MarkUsed(uint16_t cell);
+
+    FontSet fonts_;
+    int cellSize_ = 0;
+    int textureWidth_ = 0;
+    int textureHeight_ = 0;
+    int imageTop_ = 0; // First row of the image region
+    std::atomic<bool> fontsLoaded_{ false };
+    std::atomic<size_t> resident_{ 0 };
+    std::atomic<uint64_t> unavailable_{ 0 };
+
+    // Shared with the worker.
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Request> queue_;
+    std::unordered_set<ImWchar> known_; // Queued, rasterized, resident or unavailable
+    std::vector<ReadyGlyph> ready_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    // Render thread only.
+    bool textureFailed_ = false;
+    std::unique_ptr<ImFontAtlas> atlas_;
+    ImFont* font_ = nullptr; // Owned by atlas_
+    ID3D11Texture2D* texture_ = nullptr;
+    ID3D11ShaderResourceView* view_ = nullptr;
+    ID3D11DeviceContext* context_ = nullptr;
+    std::vector<Cell> cells_;
+    std::vector<uint16_t> freeCells_;
+    std::list<uint16_t> lru_; // Evictable cells, most recently drawn first
+    std::unordered_map<ImWchar, uint16_t> residentCells_;
+    std::unordered_set<ImWchar> requested_; // Asked for by Touch, not installed yet
+    std::unordered_set<ImWchar> missing_; // No font has them
+    std::vector<ReadyGlyph> deferred_; // Every evictable cell was drawn this frame
+    std::vector<ImWchar> scratch_;
+    std::vector<uint32_t> uploadBuffer_;
+    size_t pinnedRemaining_ = LAST_PINNED - FIRST_PINNED + 1;
+    uint64_t frame_ = 0;
+};
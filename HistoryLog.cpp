@@ -0,0 +1,420 @@
+#include "HistoryLog.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+namespace
+{
+    constexpr char LOG_MAGIC[4] = { 'G', 'C', 'H', 'L' };
+    constexpr uint16_t LOG_VERSION = 2;          // 2 added the server sequence number
+    constexpr uint16_t OLDEST_READABLE_VERSION = 1;
+    constexpr const char* LOG_EXTENSION = ".gclog";
+    constexpr size_t RECORD_HEADER_SIZE = 8;
+
+    constexpr size_t PayloadHeaderSize(uint16_t version)
+    {
+        return version >= 2 ? 14 : 6;
+    }
+
+    struct RecordSpan
+    {
+        size_t offset; // Start of the record header
+        size_t size;   // Header + payload
+    };
+
+    /**
+     * @brief Index of a mapped log: its channel and every valid record up to the first damaged one.
+     */
+    struct ParsedLog
+    {
+        std::string channel;
+        uint16_t version = 0;
+        size_t headerSize = 0;
+        std::vector<RecordSpan> records;
+        size_t validEnd = 0;
+    };
+
+    uint32_t Fnv1a(const uint8_t* data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    template <typename T>
+    T ReadValue(const uint8_t* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void WriteValue(std::string& out, T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    bool ParseLog(const uint8_t* data, size_t size, ParsedLog& out)
+    {
+        if (!data || size < 8 || std::memcmp(data, LOG_MAGIC, 4) != 0) return false;
+        out.version = ReadValue<uint16_t>(data + 4);
+        if (out.version < OLDEST_READABLE_VERSION || out.version > LOG_VERSION) return false;
+
+        const uint16_t channelLength = ReadValue<uint16_t>(data + 6);
+        if (size < 8u + channelLength) return false;
+
+        out.channel.assign(reinterpret_cast<const char*>(data + 8), channelLength);
+        out.headerSize = 8u + channelLength;
+
+        size_t offset = out.headerSize;
+        while (offset + RECORD_HEADER_SIZE <= size)
+        {
+            const uint32_t payloadLength = ReadValue<uint32_t>(data + offset);
+            const uint32_t checksum = ReadValue<uint32_t>(data + offset + 4);
+            const size_t end = offset + RECORD_HEADER_SIZE + payloadLength;
+            if (payloadLength < PayloadHeaderSize(out.version) || end > size) break;
+            if (Fnv1a(data + offset + RECORD_HEADER_SIZE, payloadLength) != checksum) break;
+
+            out.records.push_back({ offset, end - offset });
+            offset = end;
+        }
+        out.validEnd = offset;
+        return true;
+    }
+
+    bool DecodeRecord(const uint8_t* record, size_t size, const std::string& channel, uint16_t version, ChatMessage& out)
+    {
+        const uint8_t* payload = record + RECORD_HEADER_SIZE;
+        size_t payloadLength = size - RECORD_HEADER_SIZE;
+
+        out.seq = 0;
+        if (version >= 2)
+        {
+            out.seq = ReadValue<uint64_t>(payload);
+            payload += sizeof(uint64_t);
+            payloadLength -= sizeof(uint64_t);
+        }
+        constexpr size_t PAYLOAD_HEADER_SIZE = PayloadHeaderSize(1);
+
+        const int8_t rank = ReadValue<int8_t>(payload);
+        const uint8_t platformLength = payload[1];
+        const uint16_t userLength = ReadValue<uint16_t>(payload + 2);
+        const uint16_t textLength = ReadValue<uint16_t>(payload + 4);
+        if (PAYLOAD_HEADER_SIZE + platformLength + userLength + textLength != payloadLength) return false;
+
+        const char* strings = reinterpret_cast<const char*>(payload + PAYLOAD_HEADER_SIZE);
+        out.channel = channel;
+        out.highestRank = rank;
+        out.platform.assign(strings, platformLength);
+        out.user.assign(strings + platformLength, userLength);
+        out.text.assign(strings + platformLength + userLength, textLength);
+        return true;
+    }
+
+    std::string EncodeHeader(const std::string& channel)
+    {
+        const uint16_t channelLength = static_cast<uint16_t>(std::min<size_t>(channel.size(), UINT16_MAX));
+        std::string header(LOG_MAGIC, sizeof(LOG_MAGIC));
+        WriteValue<uint16_t>(header, LOG_VERSION);
+        WriteValue<uint16_t>(header, channelLength);
+        header.append(channel, 0, channelLength);
+        return header;
+    }
+
+    std::string EncodeRecord(const ChatMessage& message)
+    {
+        const uint8_t platformLength = static_cast<uint8_t>(std::min<size_t>(message.platform.size(), UINT8_MAX));
+        const uint16_t userLength = static_cast<uint16_t>(std::min<size_t>(message.user.size(), UINT16_MAX));
+        const uint16_t textLength = static_cast<uint16_t>(std::min<size_t>(message.text.size(), UINT16_MAX));
+        const int8_t rank = static_cast<int8_t>(std::clamp(message.highestRank, -1, static_cast<int>(INT8_MAX)));
+
+        std::string payload;
+        payload.reserve(PayloadHeaderSize(LOG_VERSION) + platformLength + userLength + textLength);
+        WriteValue<uint64_t>(payload, message.seq);
+        WriteValue<int8_t>(payload, rank);
+        WriteValue<uint8_t>(payload, platformLength);
+        WriteValue<uint16_t>(payload, userLength);
+        WriteValue<uint16_t>(payload, textLength);
+        payload.append(message.platform, 0, platformLength);
+        payload.append(message.user, 0, userLength);
+        payload.append(message.text, 0, textLength);
+
+        std::string record;
+        record.reserve(RECORD_HEADER_SIZE + payload.size());
+        WriteValue<uint32_t>(record, static_cast<uint32_t>(payload.size()));
+        WriteValue<uint32_t>(record, Fnv1a(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()));
+        record += payload;
+        return record;
+    }
+}
+
+HistoryLog::HistoryLog(std::filesystem::path directory) : directory_(std::move(directory))
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+}
+
+HistoryLog::~HistoryLog() = default;
+
+std::filesystem::path HistoryLog::PathFor(const std::string& channel) const
+{
+    // Channel names are user-visible strings; keep the file name portable and
+    // disambiguate with a hash. The real name lives in the file header.
+    std::string name;
+    for (char c : channel)
+    {
+        const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+        name.push_back(safe ? c : '_');
+    }
+    char hash[9];
+    std::snprintf(hash, sizeof(hash), "%08x", Fnv1a(reinterpret_cast<const uint8_t*>(channel.data()), channel.size()));
+    return directory_ / (name.substr(0, 32) + "-" + hash + LOG_EXTENSION);
+}
+
+std::ofstream* HistoryLog::StreamFor(const std::string& channel)
+{
+    auto it = streams_.find(channel);
+    if (it != streams_.end()) return &it->second;
+
+    const auto path = PathFor(channel);
+    std::error_code ec;
+    const bool isNew = !std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0;
+
+    std::ofstream stream(path, std::ios::binary | std::ios::app);
+    if (!stream) return nullptr;
+    if (isNew)
+    {
+        const std::string header = EncodeHeader(channel);
+        stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+    }
+    return &streams_.emplace(channel, std::move(stream)).first->second;
+}
+
+void HistoryLog::Compact(size_t keepPerChannel)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.clear();
+    indexes_.clear();
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, ec))
+    {
+        if (entry.path().extension() != LOG_EXTENSION) continue;
+
+        std::string rewritten;
+        bool unreadable = false;
+        {
+            MappedFile file(entry.path());
+            ParsedLog log;
+            if (!ParseLog(file.Data(), file.Size(), log))
+            {
+                unreadable = true;
+            }
+            else if (log.version != LOG_VERSION)
+            {
+                // Upgrade older logs in place; later appends are written in the current format.
+                const size_t first = log.records.size() > keepPerChannel ? log.records.size() - keepPerChannel : 0;
+                rewritten = EncodeHeader(log.channel);
+                for (size_t i = first; i < log.records.size(); ++i)
+                {
+                    ChatMessage message;
+                    if (DecodeRecord(file.Data() + log.records[i].offset, log.records[i].size, log.channel, log.version, message))
+                    {
+                        rewritten += EncodeRecord(message);
+                    }
+                }
+            }
+            else if (log.records.size() > keepPerChannel || log.validEnd != file.Size())
+            {
+                const size_t first = log.records.size() > keepPerChannel ? log.records.size() - keepPerChannel : 0;
+                rewritten.assign(reinterpret_cast<const char*>(file.Data()), log.headerSize);
+                if (first < log.records.size())
+                {
+                    const size_t begin = log.records[first].offset;
+                    rewritten.append(reinterpret_cast<const char*>(file.Data()) + begin, log.validEnd - begin);
+                }
+            }
+        }
+
+        if (unreadable)
+        {
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        if (rewritten.empty()) continue;
+
+        auto temp = entry.path();
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(rewritten.data(), static_cast<std::streamsize>(rewritten.size()));
+            if (!out) continue;
+        }
+        std::filesystem::rename(temp, entry.path(), ec);
+    }
+}
+
+size_t HistoryLog::RemoveIf(const std::function<bool(const ChatMessage&)>& predicate)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.clear();
+    indexes_.clear();
+
+    size_t removed = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, ec))
+    {
+        if (entry.path().extension() != LOG_EXTENSION) continue;
+
+        std::string rewritten;
+        size_t removedHere = 0;
+        {
+            MappedFile file(entry.path());
+            ParsedLog log;
+            if (!ParseLog(file.Data(), file.Size(), log)) continue;
+
+            // Kept records are copied as they are; Compact upgrades older versions on its own.
+            rewritten.assign(reinterpret_cast<const char*>(file.Data()), log.headerSize);
+            ChatMessage message;
+            for (const auto& record : log.records)
+            {
+                const uint8_t* data = file.Data() + record.offset;
+                if (DecodeRecord(data, record.size, log.channel, log.version, message) && predicate(message))
+                {
+                    ++removedHere;
+                    continue;
+                }
+                rewritten.append(reinterpret_cast<const char*>(data), record.size);
+            }
+        }
+        if (removedHere == 0) continue;
+
+        auto temp = entry.path();
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(rewritten.data(), static_cast<std::streamsize>(rewritten.size()));
+            if (!out) continue;
+        }
+        std::filesystem::rename(temp, entry.path(), ec);
+        if (!ec) removed += removedHere;
+    }
+    return removed;
+}
+
+std::vector<std::string> HistoryLog::Channels()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> channels;
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, ec))
+    {
+        if (entry.path().extension() != LOG_EXTENSION) continue;
+
+        MappedFile file(entry.path());
+        ParsedLog log;
+        if (ParseLog(file.Data(), file.Size(), log) && !log.records.empty())
+        {
+            channels.push_back(log.channel);
+        }
+    }
+    return channels;
+}
+
+bool HistoryLog::Append(const ChatMessage& message)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ofstream* stream = StreamFor(message.channel);
+    if (!stream) return false;
+
+    const std::string record = EncodeRecord(message);
+    stream->write(record.data(), static_cast<std::streamsize>(record.size()));
+    stream->flush();
+
+    const auto index = indexes_.find(message.channel);
+    if (!*stream)
+    {
+        // Unknown how much reached the file; the next read parses it again.
+        if (index != indexes_.end()) indexes_.erase(index);
+        return false;
+    }
+    if (index != indexes_.end())
+    {
+        RecordIndex& log = index->second;
+        if (log.validEnd == log.fileSize)
+        {
+            log.offsets.push_back(log.validEnd);
+            log.validEnd += record.size();
+        }
+        log.fileSize += record.size();
+    }
+    return true;
+}
+
+const HistoryLog::RecordIndex* HistoryLog::IndexFor(const std::string& channel)
+{
+    const auto cached = indexes_.find(channel);
+    if (cached != indexes_.end()) return &cached->second;
+
+    MappedFile file(PathFor(channel));
+    ParsedLog log;
+    if (!ParseLog(file.Data(), file.Size(), log)) return nullptr;
+
+    RecordIndex index;
+    index.version = log.version;
+    index.offsets.reserve(log.records.size());
+    for (const auto& record : log.records) index.offsets.push_back(record.offset);
+    index.validEnd = log.validEnd;
+    index.fileSize = file.Size();
+    return &indexes_.emplace(channel, std::move(index)).first->second;
+}
+
+size_t HistoryLog::Count(const std::string& channel)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const RecordIndex* index = IndexFor(channel);
+    return index ? index->offsets.size() : 0;
+}
+
+std::vector<ChatMessage> HistoryLog::ReadBefore(const std::string& channel, size_t skipFromEnd, size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ChatMessage> messages;
+
+    const RecordIndex* index = IndexFor(channel);
+    if (!index || skipFromEnd >= index->offsets.size()) return messages;
+
+    MappedFile file(PathFor(channel));
+    if (file.Size() < index->validEnd)
+    {
+        // Truncated by someone else; parse it afresh next time.
+        indexes_.erase(channel);
+        return messages;
+    }
+
+    const auto& offsets = index->offsets;
+    const size_t end = offsets.size() - skipFromEnd;
+    const size_t begin = end > count ? end - count : 0;
+    messages.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i)
+    {
+        const size_t recordEnd = i + 1 < offsets.size() ? offsets[i + 1] : index->validEnd;
+        ChatMessage message;
+        if (DecodeRecord(file.Data() + offsets[i], recordEnd - offsets[i], channel, index->version, message))
+        {
+            messages.push_back(std::move(message));
+        }
+    }
+    return messages;
+}
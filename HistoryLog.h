@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ChatMessage.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Optional on-disk chat history: one append-only log per channel.
+ *
+ * File layout (little-endian):
+ *   header: "GCHL" u16 version, u16 channel length, channel bytes
+ *   record: u32 payload length, u32 FNV-1a of payload, payload
+ *   payload: u64 server sequence, i8 rank, u8 platform length, u16 user length, u16 text length,
+ *            platform, user, text
+ * Version 1 payloads lack the sequence number; Compact() upgrades such files.
+ *
+ * Appends go through a buffered stream and are flushed per record; reads map the
+ * file read-only. The first read of a channel validates its log once and keeps an
+ * index of record offsets, which appends extend, so a page read only decodes the
+ * records it returns. A torn trailing record (crash mid-write) fails its checksum
+ * and is dropped by the next Compact(). Thread-safe.
+ *
+ * Uses only the standard library and MappedFile, so it also builds (and is tested)
+ * outside the plugin.
+ */
+class HistoryLog
+{
+public:
+    explicit HistoryLog(std::filesystem::path directory);
+    ~HistoryLog();
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    // Rewrites every log keeping only its newest keepPerChannel valid records.
+    void Compact(size_t keepPerChannel);
+
+    // Rewrites the logs holding records the predicate matches, without them. Returns the
+    // number of records removed.
+    size_t RemoveIf(const std::function<bool(const ChatMessage&)>& predicate);
+
+    // Channels that have a log on disk.
+    std::vector<std::string> Channels();
+
+    bool Append(const ChatMessage& message);
+
+    // Number of valid records stored for a channel.
+    size_t Count(const std::string& channel);
+
+    // Reads up to `count` records ending `skipFromEnd` records before the newest, oldest first.
+    std::vector<ChatMessage> ReadBefore(const std::string& channel, size_t skipFromEnd, size_t count);
+
+private:
+    // The valid records of one log, as found by parsing it plus what was appended since.
+    // Record i runs from offsets[i] to the next offset, the last one to validEnd.
+    struct RecordIndex
+    {
+        uint16_t version = 0;
+        std::vector<size_t> offsets;
+        size_t validEnd = 0;
+        size_t fileSize = 0; // Past validEnd after a damaged record; appends there stay unreadable until Compact()
+    };
+
+    std::filesystem::path PathFor(const std::string& channel) const;
+    std::ofstream* StreamFor(const std::string& channel);
+    const RecordIndex* IndexFor(const std::string& channel);
+
+    std::filesystem::path directory_;
+    std::map<std::string, std::ofstream> streams_;
+    std::map<std::string, RecordIndex> indexes_; // Dropped whenever files are rewritten
+    std::mutex mutex_;
+};
@@ -155,52 +155,106 @@ void ImGui::EndSearchableCombo()
 }
 
 
+static char FoldChar(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+// Rebuilds the lowercase keys when the items changed; every item matches the empty query.
+static void SyncSearchableComboKeys(ImGui::SearchableComboState* state, bool (*items_getter)(void*, int, const char**), void* data, int items_count, unsigned int items_version)
+{
+    if (state->ItemsCount == items_count && state->ItemsVersion == items_version)
+        return;
+
+    state->Keys.resize(0);
+    state->KeyOffsets.resize(0);
+    state->Matches.resize(0);
+    for (int i = 0; i < items_count; i++)
+    {
+        const char* text = NULL;
+        if (!items_getter(data, i, &text) || text == NULL)
+            text = "";
+        state->KeyOffsets.push_back(state->Keys.Size);
+        for (; *text; text++)
+            state->Keys.push_back(FoldChar(*text));
+        state->Keys.push_back('\0');
+        state->Matches.push_back(i);
+    }
+    state->MatchedQuery[0] = '\0';
+    state->ItemsCount = items_count;
+    state->ItemsVersion = items_version;
+}
+
+// Brings Matches up to date with the query. A query containing the previous one can only
+// match a subset of its items, so only those are searched again.
+static void UpdateSearchableComboMatches(ImGui::SearchableComboState* state)
+{
+    char query[IM_ARRAYSIZE(state->Query)];
+    int length = 0;
+    for (; state->Query[length] && length < IM_ARRAYSIZE(query) - 1; length++)
+        query[length] = FoldChar(state->Query[length]);
+    query[length] = '\0';
+    if (strcmp(query, state->MatchedQuery) == 0)
+        return;
+
+    if (strstr(query, state->MatchedQuery) == NULL)
+    {
+        state->Matches.resize(state->ItemsCount);
+        for (int i = 0; i < state->ItemsCount; i++)
+            state->Matches[i] = i;
+    }
+    int kept = 0;
+    for (int n = 0; n < state->Matches.Size; n++)
+    {
+        const int i = state->Matches[n];
+        if (strstr(state->Keys.Data + state->KeyOffsets[i], query) != NULL)
+            state->Matches[kept++] = i;
+    }
+    state->Matches.resize(kept);
+    ImStrncpy(state->MatchedQuery, query, IM_ARRAYSIZE(state->MatchedQuery));
+}
+
+static bool StringSpanGetter(void* data, int idx, const char** out_text)
+{
+    *out_text = static_cast<const std::string*>(data)[idx].c_str();
+    return true;
+}
+
 /* Modified version of Combo from imgui.cpp at line 9343,
- * to include a input field to be able to filter the combo values. */
-bool ImGui::SearchableCombo(const char* label, int* current_item, std::vector<std::string> items, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items)
+ * to include a input field to be able to filter the combo values.
+ * Items are read through the getter, never copied; filtering works on the keys kept in state. */
+bool ImGui::SearchableCombo(const char* label, int* current_item, SearchableComboState* state, bool (*items_getter)(void* data, int idx, const char** out_text), void* data, int items_count, unsigned int items_version, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items)
 {
     ImGuiContext& g = *GImGui;
 
     const char* preview_text = NULL;
-    if (*current_item >= (int)items.size())
-        *current_item = 0;
-    if (*current_item >= 0 && *current_item < (int)items.size())
-        preview_text = items[*current_item].c_str();
-    else
+    if (*current_item >= items_count)
+        *current_item = -1;
+    if (*current_item < 0 || !items_getter(data, *current_item, &preview_text) || preview_text == NULL)
         preview_text = default_preview_text;
 
     // The old Combo() API exposed "popup_max_height_in_items". The new more general BeginCombo() API doesn't have/need it, but we emulate it here.
     if (popup_max_height_in_items != -1 && !(g.NextWindowData.Flags & ImGuiNextWindowDataFlags_HasSizeConstraint))
         SetNextWindowSizeConstraints(ImVec2(0, 0), ImVec2(FLT_MAX, CalcMaxPopupHeightFromItemCount(popup_max_height_in_items)));
 
-    const int input_size = 64;
-    char input_buffer[input_size] = "";
-    if (!BeginSearchableCombo(label, preview_text, input_buffer, input_size, input_preview_value, ImGuiComboFlags_None))
+    state->Open = BeginSearchableCombo(label, preview_text, state->Query, IM_ARRAYSIZE(state->Query), input_preview_value, ImGuiComboFlags_None);
+    if (!state->Open)
         return false;
 
-    // Display items
-    // FIXME-OPT: Use clipper (but we need to disable it on the appearing frame to make sure our call to SetItemDefaultFocus() is processed)
-    int matched_items = 0;
+    SyncSearchableComboKeys(state, items_getter, data, items_count, items_version);
+    UpdateSearchableComboMatches(state);
+
+    // Display items. On the appearing frame all of them are submitted, so SetItemDefaultFocus()
+    // can scroll to the selected one; after that only the visible ones are.
     bool value_changed = false;
-    for (int i = 0; i < (int)items.size(); i++)
+    auto display_item = [&](int n)
     {
-        char buffer[input_size] = "";
-        ImStrncpy(buffer, input_buffer, input_size);
-        std::string input(buffer);
-        std::string item = items[i];
-
-        std::transform(item.begin(), item.end(), item.begin(),
-            [](unsigned char c) { return (unsigned char)std::tolower(c); });
-        std::transform(input.begin(), input.end(), input.begin(),
-            [](unsigned char c) { return (unsigned char)std::tolower(c); });
-
-        if (item.find(input, 0) == std::string::npos)
-            continue;
-
-        matched_items++;
+        const int i = state->Matches[n];
+        const char* item_text = NULL;
+        if (!items_getter(data, i, &item_text) || item_text == NULL)
+            item_text = "*Unknown item*";
         PushID((void*)(intptr_t)i);
         const bool item_selected = (i == *current_item);
-        const char* item_text = items[i].c_str();
         if (Selectable(item_text, item_selected))
         {
             value_changed = true;
@@ -209,11 +263,28 @@ bool ImGui::SearchableCombo(const char* label, int* current_item, std::vector<st
         if (item_selected)
             SetItemDefaultFocus();
         PopID();
+    };
+    if (IsWindowAppearing())
+    {
+        for (int n = 0; n < state->Matches.Size; n++)
+            display_item(n);
+    }
+    else
+    {
+        ImGuiListClipper clipper(state->Matches.Size);
+        while (clipper.Step())
+            for (int n = clipper.DisplayStart; n < clipper.DisplayEnd; n++)
+                display_item(n);
     }
-    if (matched_items == 0)
-        ImGui::Selectable("No maps found", false, ImGuiSelectableFlags_Disabled);
+    if (state->Matches.Size == 0)
+        ImGui::Selectable("No matches", false, ImGuiSelectableFlags_Disabled);
 
     EndSearchableCombo();
 
     return value_changed;
-}
\ No newline at end of file
+}
+
+bool ImGui::SearchableCombo(const char* label, int* current_item, SearchableComboState* state, const std::string* items, int items_count, unsigned int items_version, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items)
+{
+    return SearchableCombo(label, current_item, state, StringSpanGetter, (void*)items, items_count, items_version, default_preview_text, input_preview_value, popup_max_height_in_items);
+}
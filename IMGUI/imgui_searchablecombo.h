@@ -1,14 +1,29 @@
 #pragma once
 #include "imgui.h"
 
-#include <ctype.h>      // isprint
-#include <vector>       // vector<>
 #include <string>       // string
-#include <algorithm>    // transform
 
 namespace ImGui
 {
+    // Search state of a SearchableCombo, kept by the caller across frames. Holds a lowercase
+    // key per item, rebuilt only when items_count or items_version change, and the items
+    // matching the query, narrowed in place while the query only grows. Its buffers are
+    // reused, so once they have grown to fit the combo allocates nothing per frame.
+    struct SearchableComboState
+    {
+        char            Query[64] = "";
+        bool            Open = false;           // The popup was showing this frame
+        ImVector<char>  Keys;                   // Lowercase item texts, each null-terminated
+        ImVector<int>   KeyOffsets;             // Per item, its key's offset in Keys
+        ImVector<int>   Matches;                // Indices of the items matching MatchedQuery
+        char            MatchedQuery[64] = "";  // Lowercase
+        unsigned int    ItemsVersion = 0;
+        int             ItemsCount = -1;
+    };
+
     IMGUI_API bool          BeginSearchableCombo(const char* label, const char* preview_value, char* input, int input_size, const char* input_preview_value, ImGuiComboFlags flags = 0);
     IMGUI_API void          EndSearchableCombo();
-    IMGUI_API bool          SearchableCombo(const char* label, int* current_item, std::vector<std::string> items, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items = -1);
-} // namespace ImGui
\ No newline at end of file
+    // Items come from a getter, as with Combo(); bump items_version whenever their texts change.
+    IMGUI_API bool          SearchableCombo(const char* label, int* current_item, SearchableComboState* state, bool (*items_getter)(void* data, int idx, const char** out_text), void* data, int items_count, unsigned int items_version, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items = -1);
+    IMGUI_API bool          SearchableCombo(const char* label, int* current_item, SearchableComboState* state, const std::string* items, int items_count, unsigned int items_version, const char* default_preview_text, const char* input_preview_value, int popup_max_height_in_items = -1);
+} // namespace ImGui
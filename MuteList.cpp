@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "MuteList.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace
+{
+    constexpr char MUTE_MAGIC[4] = { 'G', 'C', 'M', 'U' };
+    constexpr uint16_t MUTE_VERSION = 1;
+    constexpr size_t HEADER_SIZE = 10;
+
+    template <typename T>
+    T ReadValue(const char* data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void WriteValue(std::string& out, T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    void WriteName(std::string& out, const std::string& name)
+    {
+        const auto length = static_cast<uint8_t>(std::min<size_t>(name.size(), UINT8_MAX));
+        WriteValue<uint8_t>(out, length);
+        out.append(name, 0, length);
+    }
+
+    bool ReadName(const std::string& data, size_t& offset, std::string& name)
+    {
+        if (offset >= data.size()) return false;
+        const auto length = static_cast<uint8_t>(data[offset]);
+        if (offset + 1 + length > data.size()) return false;
+        name.assign(data, offset + 1, length);
+        offset += 1 + length;
+        return true;
+    }
+}
+
+bool MuteList::Contains(std::string_view platform, std::string_view user) const
+{
+    if (muted_.empty()) return false;
+    const uint32_t userId = IdOf(user);
+    if (userId == 0) return false;
+    const uint32_t platformId = IdOf(platform);
+    return platformId != 0 && muted_.count(Key(platformId, userId)) != 0;
+}
+
+bool MuteList::Add(std::string_view platform, std::string_view user)
+{
+    return muted_.insert(Key(Intern(platform), Intern(user))).second;
+}
+
+bool MuteList::Remove(std::string_view platform, std::string_view user)
+{
+    const uint32_t platformId = IdOf(platform);
+    const uint32_t userId = IdOf(user);
+    return platformId != 0 && userId != 0 && muted_.erase(Key(platformId, userId)) != 0;
+}
+
+std::vector<MuteList::Entry> MuteList::Entries() const
+{
+    std::vector<Entry> entries;
+    entries.reserve(muted_.size());
+    for (const uint64_t key : muted_)
+    {
+        entries.push_back({ names_[(key >> 32) - 1], names_[(key & 0xFFFFFFFFu) - 1] });
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.user != b.user ? a.user < b.user : a.platform < b.platform;
+    });
+    return entries;
+}
+
+bool MuteList::Load(const std::filesystem::path& file)
+{
+    ids_.clear();
+    names_.clear();
+    muted_.clear();
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return true;
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < HEADER_SIZE || std::memcmp(data.data(), MUTE_MAGIC, 4) != 0) return false;
+    if (ReadValue<uint16_t>(data.data() + 4) != MUTE_VERSION) return false;
+
+    const uint32_t count = ReadValue<uint32_t>(data.data() + 6);
+    size_t offset = HEADER_SIZE;
+    std::string platform;
+    std::string user;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        // Keep what was read before a truncated entry.
+        if (!ReadName(data, offset, platform) || !ReadName(data, offset, user)) return false;
+        Add(platform, user);
+    }
+    return true;
+}
+
+bool MuteList::Save(const std::filesystem::path& file) const
+{
+    std::string data(MUTE_MAGIC, sizeof(MUTE_MAGIC));
+    WriteValue<uint16_t>(data, MUTE_VERSION);
+    WriteValue<uint32_t>(data, static_cast<uint32_t>(muted_.size()));
+    for (const auto& entry : Entries())
+    {
+        WriteName(data, entry.platform);
+        WriteName(data, entry.user);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(file.parent_path(), ec);
+    auto temp = file;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) return false;
+    }
+    std::filesystem::rename(temp, file, ec);
+    return !ec;
+}
+
+uint32_t MuteList::Intern(std::string_view name)
+{
+    if (const uint32_t id = IdOf(name)) return id;
+    names_.emplace_back(name);
+    const auto id = static_cast<uint32_t>(names_.size());
+    ids_.emplace(names_.back(), id);
+    return id;
+}
+
+uint32_t MuteList::IdOf(std::string_view name) const
+{
+    const auto it = ids_.find(name);
+    return it != ids_.end() ? it->second : 0;
+}
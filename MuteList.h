@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Users whose messages are hidden, keyed by (platform, user).
+ *
+ * Names are interned to small ids, and a muted pair is stored as one 64-bit key, so a
+ * check is a lookup per name and one in the set, with no allocation. Only names that
+ * were ever muted are interned. Not thread-safe; GlobalChat guards it with historyMutex.
+ *
+ * File layout (little-endian): "GCMU" u16 version, u32 count, then per entry
+ * u8 platform length, platform, u8 user length, user.
+ */
+class MuteList
+{
+public:
+    struct Entry
+    {
+        std::string platform;
+        std::string user;
+    };
+
+    bool Contains(std::string_view platform, std::string_view user) const;
+    // Both return false if nothing changed.
+    bool Add(std::string_view platform, std::string_view user);
+    bool Remove(std::string_view platform, std::string_view user);
+
+    // Muted users, sorted by name.
+    std::vector<Entry> Entries() const;
+    size_t Size() const { return muted_.size(); }
+
+    // Load replaces the list; a missing file gives an empty one.
+    bool Load(const std::filesystem::path& file);
+    bool Save(const std::filesystem::path& file) const;
+
+private:
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+
+    std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>> ids_;
+    std::vector<std::string> names_; // By id - 1
+    std::unordered_set<uint64_t> muted_;
+
+    uint32_t Intern(std::string_view name);
+    uint32_t IdOf(std::string_view name) const; // 0 if never interned
+
+    static uint64_t Key(uint32_t platform, uint32_t user) { return (uint64_t{ platform } << 32) | user; }
+};
@@ -0,0 +1,76 @@
+#include "Outbox.h"
+
+bool Outbox::Reserve()
+{
+    if (reserved_.fetch_add(1) >= MAX_FRAMES)
+    {
+        reserved_.fetch_sub(1);
+        return false;
+    }
+    return true;
+}
+
+void Outbox::Push(Serializer serialize, std::string key, Clock::time_point now)
+{
+    Frame frame;
+    frame.serialize = std::move(serialize);
+    frame.queued = now;
+    frame.key = std::move(key);
+    frames_.push_back(std::move(frame));
+}
+
+bool Outbox::Coalesce(std::string_view key, Serializer& serialize, bool skipFront)
+{
+    if (key.empty()) return false;
+    for (size_t i = skipFront ? 1 : 0; i < frames_.size(); ++i)
+    {
+        Frame& queued = frames_[i];
+        if (queued.key != key) continue;
+        queued.serialize = std::move(serialize);
+        queued.serialized = false;
+        return true;
+    }
+    return false;
+}
+
+size_t Outbox::DropStale(Clock::time_point now)
+{
+    const auto cutoff = now - MAX_AGE;
+    size_t dropped = 0;
+    while (!frames_.empty() && frames_.front().queued < cutoff)
+    {
+        frames_.pop_front();
+        reserved_.fetch_sub(1);
+        ++dropped;
+    }
+    return dropped;
+}
+
+Outbox::Frame& Outbox::Front(std::string_view protocol, bool binary)
+{
+    Frame& frame = frames_.front();
+    if (!frame.serialized)
+    {
+        frame.data = frame.serialize(protocol);
+        frame.binary = binary;
+        frame.serialized = true;
+    }
+    return frame;
+}
+
+void Outbox::PopFront()
+{
+    frames_.pop_front();
+    reserved_.fetch_sub(1);
+}
+
+void Outbox::ResetFront()
+{
+    if (!frames_.empty()) frames_.front().serialized = false;
+}
+
+void Outbox::Clear()
+{
+    frames_.clear();
+    reserved_ = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Frames waiting to be written to the server, oldest first.
+ *
+ * Callers reserve a slot on their own thread before handing a frame to the network
+ * thread, so a full outbox is refused at once; everything else runs on the network
+ * thread. Frames queued while the connection is down stay in order for the next one,
+ * unless they are older than MAX_AGE by the time they would be written. Frames are
+ * serialized right before their first write, for the protocol of the connection that
+ * writes them. Used by WSManager; it has no dependency on the socket, so it is tested
+ * on its own.
+ */
+class Outbox
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    // Builds the frame for the negotiated subprotocol (empty if none).
+    using Serializer = std::function<std::string(std::string_view protocol)>;
+
+    static constexpr size_t MAX_FRAMES = 32;
+    static constexpr auto MAX_AGE = std::chrono::seconds(60);
+
+    struct Frame
+    {
+        Serializer serialize;
+        Clock::time_point queued;
+        bool serialized = false; // data is valid for the current connection
+        bool binary = false;
+        std::string data;
+        std::string key; // Set for frames that may be coalesced
+    };
+
+    // Claims a slot for a frame about to be pushed. False when MAX_FRAMES are already
+    // queued or reserved. Any thread.
+    bool Reserve();
+
+    // Queues a frame into a slot claimed by Reserve().
+    void Push(Serializer serialize, std::string key = {}, Clock::time_point now = Clock::now());
+    // Replaces the serializer of a queued frame with the same non-empty key, keeping its
+    // place and age. With `skipFront`, the front frame is being written and is left alone.
+    // Returns false, leaving `serialize` untouched, if no frame matches.
+    bool Coalesce(std::string_view key, Serializer& serialize, bool skipFront);
+
+    // Drops frames queued before now - MAX_AGE from the front and returns how many. Call
+    // between writes only, so the front is never a frame in flight.
+    size_t DropStale(Clock::time_point now = Clock::now());
+    // The front frame, serialized for `protocol` unless it already is.
+    Frame& Front(std::string_view protocol, bool binary);
+    // Forgets the front frame once it is written.
+    void PopFront();
+    // Makes the front frame serialize again, for a write that failed with its connection.
+    void ResetFront();
+    // Drops everything, reservations included.
+    void Clear();
+
+    bool Empty() const { return frames_.empty(); }
+    size_t Size() const { return frames_.size(); }
+
+private:
+    std::deque<Frame> frames_;
+    // Frames reserved and not yet written or dropped; read on the callers' threads.
+    std::atomic<size_t> reserved_{ 0 };
+};
@@ -0,0 +1,79 @@
+#include "RecentIdSet.h"
+
+#include <algorithm>
+#include <bit>
+
+RecentIdSet::RecentIdSet(size_t capacity)
+    : slots_(std::bit_ceil(std::max<size_t>(capacity, 1) * 2), 0), order_(std::max<size_t>(capacity, 1), 0)
+{
+    mask_ = slots_.size() - 1;
+}
+
+size_t RecentIdSet::Home(uint64_t id) const
+{
+    // Fibonacci hashing spreads sequential ids across the table.
+    return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> 32) & mask_;
+}
+
+size_t RecentIdSet::Find(uint64_t id) const
+{
+    size_t i = Home(id);
+    while (slots_[i] != 0 && slots_[i] != id) i = (i + 1) & mask_;
+    return i;
+}
+
+bool RecentIdSet::Contains(uint64_t id) const
+{
+    return id != 0 && slots_[Find(id)] == id;
+}
+
+bool RecentIdSet::Insert(uint64_t id)
+{
+    if (id == 0) return false;
+
+    size_t slot = Find(id);
+    if (slots_[slot] == id) return false;
+
+    if (size_ == order_.size())
+    {
+        Erase(order_[head_]);
+        slot = Find(id); // Erasing may have shifted entries into the probe sequence
+    }
+    else
+    {
+        ++size_;
+    }
+
+    slots_[slot] = id;
+    order_[head_] = id;
+    head_ = (head_ + 1) % order_.size();
+    return true;
+}
+
+void RecentIdSet::Erase(uint64_t id)
+{
+    size_t hole = Find(id);
+    if (slots_[hole] != id) return;
+    slots_[hole] = 0;
+
+    // Backward-shift deletion: pull later entries of the cluster into the hole when
+    // their home slot does not lie strictly between the hole and their position.
+    for (size_t next = (hole + 1) & mask_; slots_[next] != 0; next = (next + 1) & mask_)
+    {
+        const size_t home = Home(slots_[next]);
+        const bool between = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (between) continue;
+
+        slots_[hole] = slots_[next];
+        slots_[next] = 0;
+        hole = next;
+    }
+}
+
+void RecentIdSet::Clear()
+{
+    std::fill(slots_.begin(), slots_.end(), 0);
+    std::fill(order_.begin(), order_.end(), 0);
+    head_ = 0;
+    size_ = 0;
+}
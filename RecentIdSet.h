@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Fixed-capacity set remembering the most recently inserted ids.
+ *
+ * Open addressing with linear probing, so Contains and Insert are O(1) and never
+ * allocate after construction. Once full, each insert forgets the oldest id.
+ * Zero marks an empty slot and cannot be stored.
+ */
+class RecentIdSet
+{
+public:
+    explicit RecentIdSet(size_t capacity);
+
+    bool Contains(uint64_t id) const;
+    // Returns false if the id was already present.
+    bool Insert(uint64_t id);
+    void Clear();
+
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return order_.size(); }
+
+private:
+    std::vector<uint64_t> slots_; // Power-of-two table, at most half full
+    std::vector<uint64_t> order_; // Insertion ring used to evict the oldest id
+    size_t mask_ = 0;
+    size_t head_ = 0;
+    size_t size_ = 0;
+
+    size_t Home(uint64_t id) const;
+    // Slot holding the id, or the empty slot that ends its probe sequence.
+    size_t Find(uint64_t id) const;
+    void Erase(uint64_t id);
+};
@@ -0,0 +1,443 @@
+#include "pch.h"
+#include "StressTest.h"
+#include "TypingTracker.h"
+#include "WireFormat.h"
+
+#include <Windows.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    int64_t PrivateBytes()
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) return 0;
+        return static_cast<int64_t>(counters.PrivateUsage);
+    }
+
+    double Megabytes(int64_t bytes)
+    {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+    // Cheap, stable per-index pseudo-randomness, so a run can be repeated exactly.
+    uint64_t Mix(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        return x ^ (x >> 33);
+    }
+}
+
+bool StressTest::Options::Parse(const std::vector<std::string>& args, size_t first, Options& options, std::string& error)
+{
+    for (size_t i = first; i < args.size(); ++i)
+    {
+        const auto separator = args[i].find('=');
+        if (separator == std::string::npos) {
+            error = "expected key=value, got '" + args[i] + "'";
+            return false;
+        }
+        const std::string key = args[i].substr(0, separator);
+        const std::string value = args[i].substr(separator + 1);
+        try
+        {
+            if (key == "rate") options.rate = std::stod(value);
+            else if (key == "channels") options.channels = std::stoul(value);
+            else if (key == "text") options.textBytes = std::stoul(value);
+            else if (key == "malformed") options.malformedPercent = std::stod(value);
+            else if (key == "errors") options.errorPercent = std::stod(value);
+            else if (key == "drop") options.dropInterval = std::chrono::seconds(std::stoul(value));
+            else if (key == "minutes") options.duration = std::chrono::minutes(std::stoul(value));
+            else if (key == "binary") options.binary = value == "1" || value == "true";
+            else if (key == "filter") options.filter = value == "1" || value == "true";
+            else if (key == "typists") options.typists = std::stoul(value);
+            else {
+                error = "unknown option '" + key + "'";
+                return false;
+            }
+        }
+        catch (const std::exception&)
+        {
+            error = "bad value for '" + key + "'";
+            return false;
+        }
+    }
+
+    if (options.rate <= 0.0 || options.channels == 0) {
+        error = "rate and channels must be positive";
+        return false;
+    }
+    return true;
+}
+
+StressTest::StressTest(Options options, Hooks hooks, const ChatHistory& history)
+    : options_(std::move(options)), hooks_(std::move(hooks)), history_(history)
+{
+    progress_->deliver = hooks_.deliver;
+}
+
+StressTest::~StressTest()
+{
+    Stop();
+}
+
+void StressTest::Start()
+{
+    if (running_) return;
+    if (thread_.joinable()) thread_.join(); // A finished earlier run
+
+    running_ = true;
+    stopRequested_ = false;
+    thread_ = std::thread(&StressTest::Run, this);
+}
+
+void StressTest::Stop()
+{
+    stopRequested_ = true;
+    if (thread_.joinable()) thread_.join();
+}
+
+std::string StressTest::ChannelName(size_t index) const
+{
+    return CHANNEL_PREFIX + std::to_string(index);
+}
+
+std::string StressTest::MakeText(uint64_t index) const
+{
+    static const char* words[] = {
+        "gg", "nice", "shot", "what", "a", "save", "rotate", "boost", "kickoff", "demo",
+        "anyone", "queue", "ranked", "champ", "flip", "reset", "ceiling", "dribble", "lag", "server"
+    };
+
+    std::string text;
+    text.reserve(options_.textBytes + 16);
+    uint64_t state = index;
+    while (text.size() < options_.textBytes)
+    {
+        state = Mix(state + 1);
+        if (!text.empty()) text.push_back(' ');
+        text += words[state % std::size(words)];
+    }
+    return text;
+}
+
+void StressTest::Post(std::string frame, bool binary)
+{
+    auto progress = progress_;
+    progress->inFlight.fetch_add(1, std::memory_order_relaxed);
+    const auto queued = Clock::now();
+    const bool posted = hooks_.post([progress, frame = std::move(frame), binary, queued]() {
+        progress->deliver(frame, binary);
+        progress->ingestLatency.Record(Clock::now() - queued);
+        progress->inFlight.fetch_sub(1, std::memory_order_relaxed);
+    });
+    if (!posted) progress->inFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void StressTest::SendBroadcast(uint64_t index)
+{
+    const size_t channel = static_cast<size_t>(Mix(index) % options_.channels);
+    if (options_.filter && hooks_.subscribed && !hooks_.subscribed(ChannelName(channel))) {
+        ++totals_.filtered;
+        return;
+    }
+    const uint64_t seq = nextSeq_++;
+    const nlohmann::json payload = {
+        {"platform", index % 3 ? "steam" : "epic"},
+        {"channel", ChannelName(channel)},
+        {"highest_rank", static_cast<int>(Mix(index + 7) % 23)},
+        {"user", "Stress" + std::to_string(Mix(index + 13) % 500)},
+        {"text", MakeText(index)},
+        {"seq", seq},
+    };
+    Post(WireFormat::Encode(payload, options_.binary ? WireFormat::MSGPACK_PROTOCOL : WireFormat::JSON_PROTOCOL), options_.binary);
+    ++totals_.broadcasts;
+
+    // Only the newest capacity-worth can still be in the history; trim in batches.
+    auto& sent = sentSeqs_[channel];
+    sent.push_back(seq);
+    const size_t capacity = history_.Capacity();
+    if (sent.size() > capacity * 2) sent.erase(sent.begin(), sent.end() - static_cast<std::ptrdiff_t>(capacity));
+
+    auto& recent = recentFrames_[channel];
+    recent.push_back(payload.dump());
+    if (recent.size() > BOOTSTRAP_MESSAGES) recent.erase(recent.begin());
+}
+
+void StressTest::SendMalformed(uint64_t index)
+{
+    const nlohmann::json payload = {
+        {"platform", "steam"},
+        {"channel", ChannelName(0)},
+        {"user", 12345}, // Wrong type
+        {"text", MakeText(index)},
+    };
+    std::string frame = WireFormat::Encode(payload, options_.binary ? WireFormat::MSGPACK_PROTOCOL : WireFormat::JSON_PROTOCOL);
+    if (index % 2) frame.resize(frame.size() / 2); // Truncated instead
+    Post(std::move(frame), options_.binary);
+    ++totals_.malformed;
+}
+
+void StressTest::SendBootstrap(bool includeStressChannels)
+{
+    // Keep the real channels listed; a bootstrap replaces the channel list.
+    nlohmann::json data = nlohmann::json::object();
+    for (const auto& channel : history_.GetSnapshot()->channelOrder)
+    {
+        if (channel.rfind(CHANNEL_PREFIX, 0) != 0) data[channel] = nlohmann::json::array();
+    }
+    if (includeStressChannels)
+    {
+        for (size_t i = 0; i < options_.channels; ++i)
+        {
+            // Text frames embed each message as a JSON string, binary frames as a map.
+            nlohmann::json messages = nlohmann::json::array();
+            for (const auto& message : recentFrames_[i])
+            {
+                if (options_.binary) messages.push_back(nlohmann::json::parse(message));
+                else messages.push_back(message);
+            }
+            data[ChannelName(i)] = std::move(messages);
+        }
+    }
+
+    const nlohmann::json bootstrap = { {"type", "all_histories"}, {"data", std::move(data)} };
+    Post(WireFormat::Encode(bootstrap, options_.binary ? WireFormat::MSGPACK_PROTOCOL : WireFormat::JSON_PROTOCOL), options_.binary);
+}
+
+void StressTest::SendTyping(size_t typist, bool typing)
+{
+    const nlohmann::json payload = {
+        {"type", "typing"},
+        {"platform", "steam"},
+        {"channel", ChannelName(typist % options_.channels)},
+        {"user", TYPIST_PREFIX + std::to_string(typist)},
+        {"typing", typing},
+    };
+    Post(WireFormat::Encode(payload, options_.binary ? WireFormat::MSGPACK_PROTOCOL : WireFormat::JSON_PROTOCOL), options_.binary);
+    ++totals_.typingFrames;
+}
+
+void StressTest::UpdateTypists(Clock::time_point now)
+{
+    for (size_t i = 0; i < typists_.size(); ++i)
+    {
+        Typist& typist = typists_[i];
+        if (now < typist.next) continue;
+
+        const uint64_t roll = Mix((uint64_t{ i } << 32) ^ typist.round);
+        if (typist.state != Typist::State::Typing)
+        {
+            // Types for 2 to 15 s, refreshing its start the way the client does.
+            typist.state = Typist::State::Typing;
+            typist.typingUntil = now + std::chrono::milliseconds(2000 + roll % 13000);
+        }
+        if (now < typist.typingUntil)
+        {
+            SendTyping(i, true);
+            typist.lastFrame = now;
+            typist.next = now + TYPING_REFRESH;
+            continue;
+        }
+
+        if ((roll >> 32) % 4 == 0) {
+            typist.state = Typist::State::Quiet;
+        }
+        else {
+            SendTyping(i, false);
+            typist.state = Typist::State::Idle;
+        }
+        typist.next = now + std::chrono::milliseconds(1000 + (roll >> 16) % 7000);
+        ++typist.round;
+    }
+}
+
+void StressTest::StopTypists()
+{
+    for (size_t i = 0; i < typists_.size(); ++i)
+    {
+        if (typists_[i].state == Typist::State::Typing) SendTyping(i, false);
+        typists_[i].state = Typist::State::Idle;
+    }
+}
+
+void StressTest::CheckTypists(Clock::time_point now)
+{
+    if (typists_.empty() || !hooks_.typists) return;
+
+    size_t tracked = 0;
+    for (size_t i = 0; i < options_.channels; ++i) tracked += hooks_.typists(ChannelName(i));
+
+    // A start is tracked from when it is handled until TTL (plus a tick) later. The slack
+    // covers the time between handling and sending, and between `now` and the count above.
+    constexpr auto slack = std::chrono::seconds(1);
+    size_t mustTrack = 0;
+    size_t mayTrack = 0;
+    for (const Typist& typist : typists_)
+    {
+        if (typist.state == Typist::State::Idle || typist.lastFrame <= lastDrop_) continue; // Stopped, or cleared by a drop
+        const auto age = now - typist.lastFrame;
+        if (typist.state == Typist::State::Typing && age < TypingTracker::TTL - slack) ++mustTrack;
+        else if (age < TypingTracker::TTL + TypingTracker::TICK + slack) ++mayTrack;
+    }
+
+    const bool inBounds = tracked >= mustTrack && tracked <= mustTrack + mayTrack;
+    if (!inBounds) ++totals_.typingMismatches;
+    LOG("[stress] typists: {} typing frames, {} tracked (expected {} to {}){}, {} reports out of bounds",
+        totals_.typingFrames, tracked, mustTrack, mustTrack + mayTrack, inBounds ? "" : " OUT OF BOUNDS", totals_.typingMismatches);
+}
+
+bool StressTest::WaitForPipeline(std::chrono::milliseconds timeout)
+{
+    const auto deadline = Clock::now() + timeout;
+    while (progress_->inFlight.load(std::memory_order_relaxed) != 0)
+    {
+        if (Clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+uint64_t StressTest::CountMissing() const
+{
+    const auto snapshot = history_.GetSnapshot();
+    const size_t capacity = history_.Capacity();
+
+    uint64_t missing = 0;
+    for (size_t i = 0; i < options_.channels; ++i)
+    {
+        const auto& sent = sentSeqs_[i];
+        const size_t expected = std::min(sent.size(), capacity);
+        if (expected == 0) continue;
+
+        std::unordered_set<uint64_t> stored;
+        if (const auto* messages = snapshot->GetChannel(ChannelName(i)))
+        {
+            for (const auto& message : *messages) stored.insert(message->seq);
+        }
+        for (size_t k = sent.size() - expected; k < sent.size(); ++k)
+        {
+            if (!stored.count(sent[k])) ++missing;
+        }
+    }
+    return missing;
+}
+
+void StressTest::Report(const char* label, Clock::duration elapsed)
+{
+    // Let everything sent so far land before checking the history against it.
+    if (!WaitForPipeline(std::chrono::seconds(5))) {
+        LOG("[stress] pipeline still has {} frames queued after 5 s", progress_->inFlight.load());
+    }
+    totals_.missing = CountMissing();
+
+    const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 0.001);
+    const auto latency = progress_->ingestLatency.Read();
+    const auto& metrics = GetMetrics();
+    const int64_t memory = PrivateBytes();
+
+    LOG("[stress] {} {:.0f} s: {} broadcasts ({:.1f}/s), {} filtered out, backlogged {} times",
+        label, seconds, totals_.broadcasts, static_cast<double>(totals_.broadcasts) / seconds, totals_.filtered, totals_.backlogged);
+    LOG("[stress] injected {} malformed, {} errors, {} drops", totals_.malformed, totals_.errors, totals_.drops);
+    LOG("[stress] ingest latency n={} mean={:.1f} us p50<{:.0f} us p99<{:.0f} us max={:.1f} us",
+        latency.count, latency.MeanUs(), latency.PercentileUs(0.50), latency.PercentileUs(0.99), static_cast<double>(latency.maxNs) / 1000.0);
+    LOG("[stress] parse errors {} (injected {}), duplicates {}, missing from history {}",
+        metrics.parseErrors.load() - parseErrorsAtStart_, totals_.malformed, metrics.duplicateMessages.load() - duplicatesAtStart_, totals_.missing);
+    LOG("[stress] private memory {:.1f} MB ({:+.1f} MB since start)", Megabytes(memory), Megabytes(memory - memoryAtStart_));
+    CheckTypists(Clock::now());
+}
+
+void StressTest::Run()
+{
+    sentSeqs_.assign(options_.channels, {});
+    recentFrames_.assign(options_.channels, {});
+    typists_.assign(options_.typists, {});
+    lastDrop_ = {};
+    totals_ = {};
+    nextSeq_ = FIRST_SEQ;
+    progress_->ingestLatency.Reset();
+    parseErrorsAtStart_ = GetMetrics().parseErrors.load();
+    duplicatesAtStart_ = GetMetrics().duplicateMessages.load();
+    memoryAtStart_ = PrivateBytes();
+
+    LOG("[stress] started: {:.0f}/s over {} channels, {} byte texts, {}% malformed, {}% errors, drop every {} s, {} min, {}",
+        options_.rate, options_.channels, options_.textBytes, options_.malformedPercent, options_.errorPercent,
+        options_.dropInterval.count(), options_.duration.count(),
+        options_.binary ? (options_.filter ? "msgpack, filtered" : "msgpack") : (options_.filter ? "json, filtered" : "json"));
+    if (!typists_.empty()) {
+        LOG("[stress] {} typists over {} channels", typists_.size(), options_.channels);
+    }
+
+    const auto start = Clock::now();
+    const auto end = start + options_.duration;
+    auto nextReport = start + REPORT_INTERVAL;
+    auto nextDrop = options_.dropInterval.count() > 0 ? start + options_.dropInterval : Clock::time_point::max();
+    const uint64_t malformedThreshold = static_cast<uint64_t>(options_.malformedPercent * 100.0);
+    const uint64_t errorThreshold = malformedThreshold + static_cast<uint64_t>(options_.errorPercent * 100.0);
+
+    SendBootstrap(true);
+    // Typists join over the first five seconds rather than all at once.
+    for (size_t i = 0; i < typists_.size(); ++i) typists_[i].next = start + std::chrono::milliseconds(Mix(i) % 5000);
+
+    uint64_t index = 0;
+    bool backlogged = false;
+    while (!stopRequested_)
+    {
+        const auto now = Clock::now();
+        if (now >= end) break;
+
+        const uint64_t due = static_cast<uint64_t>(std::chrono::duration<double>(now - start).count() * options_.rate);
+        while (index < due)
+        {
+            if (progress_->inFlight.load(std::memory_order_relaxed) >= MAX_IN_FLIGHT) {
+                if (!backlogged) ++totals_.backlogged;
+                backlogged = true;
+                break;
+            }
+            backlogged = false;
+
+            const uint64_t roll = Mix(index ^ 0x5EED) % 10000;
+            if (roll < malformedThreshold) SendMalformed(index);
+            else if (roll < errorThreshold) {
+                Post(R"({"error":"stress test: simulated server error"})", false);
+                ++totals_.errors;
+            }
+            else SendBroadcast(index);
+            ++index;
+        }
+        UpdateTypists(now);
+
+        if (now >= nextDrop)
+        {
+            // What a reconnect looks like to the pipeline: a disconnect, then a bootstrap
+            // overlapping messages it already has.
+            hooks_.post(hooks_.disconnect);
+            SendBootstrap(true);
+            lastDrop_ = now;
+            ++totals_.drops;
+            nextDrop += options_.dropInterval;
+        }
+
+        if (now >= nextReport)
+        {
+            Report("progress", now - start);
+            nextReport += REPORT_INTERVAL;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    Report("finished", Clock::now() - start);
+    StopTypists();
+    SendBootstrap(false); // Drop the stress channels from the channel list again
+    WaitForPipeline(std::chrono::seconds(1));
+    running_ = false;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "ChatHistory.h"
+#include "ChatMetrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Load and soak generator for the message ingest pipeline (globalchat_stress).
+ *
+ * Plays the server's side of the protocol: an all_histories bootstrap, then chat
+ * broadcasts at a fixed rate over a number of channels, mixed with error frames,
+ * malformed frames and simulated connection drops (a disconnect followed by a fresh
+ * bootstrap overlapping what was already sent). Frames are handed to the real message
+ * handler on the network thread, so they take exactly the path of server traffic.
+ *
+ * With `filter` on it also filters like a server that supports channel subscriptions:
+ * broadcasts for channels the client has not subscribed to are not sent.
+ *
+ * With `typists` above zero that many simulated users also type in the stress channels:
+ * each starts, refreshes its start every few seconds, and then either stops or (one time
+ * in four) just goes quiet, leaving the client to expire it.
+ *
+ * Every report interval the generator pauses until its frames are processed, checks
+ * that the newest messages of each channel are all in the history, and logs
+ * throughput, ingest latency, parse errors against injected ones, missing messages,
+ * typists tracked against those that should be, and process memory growth.
+ */
+class StressTest
+{
+public:
+    struct Options
+    {
+        double rate = 200.0; // Broadcasts per second, over all channels
+        size_t channels = 8;
+        size_t textBytes = 80;
+        double malformedPercent = 1.0;
+        double errorPercent = 0.1;
+        std::chrono::seconds dropInterval{ 60 }; // Zero disables simulated drops
+        std::chrono::minutes duration{ 10 };
+        bool binary = false; // MessagePack frames instead of JSON text
+        bool filter = false; // Skip broadcasts for channels the client is not subscribed to
+        size_t typists = 0; // Simulated users sending typing frames
+
+        // Parses "key=value" arguments (rate, channels, text, malformed, errors, drop,
+        // minutes, binary, filter, typists). Returns false and sets `error` on an unknown key or bad value.
+        static bool Parse(const std::vector<std::string>& args, size_t first, Options& options, std::string& error);
+    };
+
+    struct Hooks
+    {
+        // Runs a task on the network thread; false if that is not possible right now.
+        std::function<bool(std::function<void()>)> post;
+        // The handler for incoming frames, and the one for a lost connection.
+        std::function<void(std::string_view frame, bool binary)> deliver;
+        std::function<void()> disconnect;
+        // Whether the client subscribed to a channel; used with Options::filter.
+        std::function<bool(const std::string& channel)> subscribed;
+        // How many users the client shows as typing in a channel.
+        std::function<size_t(const std::string& channel)> typists;
+    };
+
+    StressTest(Options options, Hooks hooks, const ChatHistory& history);
+    ~StressTest();
+
+    StressTest(const StressTest&) = delete;
+    StressTest& operator=(const StressTest&) = delete;
+
+    void Start();
+    // Stops generating, waits briefly for queued frames and logs the final report.
+    void Stop();
+    bool IsRunning() const { return running_; }
+
+private:
+    static constexpr auto REPORT_INTERVAL = std::chrono::seconds(10);
+    static constexpr size_t MAX_IN_FLIGHT = 50000; // Frames posted but not yet handled
+    static constexpr size_t BOOTSTRAP_MESSAGES = 20; // Per channel, as the server sends on connect
+    static constexpr const char* CHANNEL_PREFIX = "stress-";
+    // Far above real server sequence numbers, so the shared dedup set never confuses the two.
+    static constexpr uint64_t FIRST_SEQ = uint64_t{ 1 } << 62;
+    static constexpr auto TYPING_REFRESH = std::chrono::seconds(3);
+    static constexpr const char* TYPIST_PREFIX = "StressTypist";
+
+    // Shared with tasks still queued on the network thread, which may outlive this object.
+    struct Progress
+    {
+        std::function<void(std::string_view frame, bool binary)> deliver;
+        std::atomic<size_t> inFlight{ 0 };
+        LatencyHistogram ingestLatency;
+    };
+
+    struct Totals
+    {
+        uint64_t broadcasts = 0;
+        uint64_t malformed = 0;
+        uint64_t errors = 0;
+        uint64_t drops = 0;
+        uint64_t filtered = 0; // Broadcasts not sent for unsubscribed channels
+        uint64_t missing = 0;
+        uint64_t backlogged = 0; // Times generation waited for the pipeline to catch up
+        uint64_t typingFrames = 0;
+        uint64_t typingMismatches = 0; // Reports whose tracked typists were out of bounds
+    };
+
+    // A simulated user's typing, driven by the generator.
+    struct Typist
+    {
+        enum class State { Idle, Typing, Quiet }; // Quiet: stopped without a stop frame
+        State state = State::Idle;
+        std::chrono::steady_clock::time_point next; // Of its next frame or state change
+        std::chrono::steady_clock::time_point typingUntil;
+        std::chrono::steady_clock::time_point lastFrame; // Last start sent
+        uint64_t round = 0;
+    };
+
+    Options options_;
+    Hooks hooks_;
+    const ChatHistory& history_;
+    std::shared_ptr<Progress> progress_ = std::make_shared<Progress>();
+    std::atomic<bool> running_{ false };
+    std::atomic<bool> stopRequested_{ false };
+    std::thread thread_;
+
+    // Generator thread only.
+    uint64_t nextSeq_ = FIRST_SEQ;
+    std::vector<std::vector<uint64_t>> sentSeqs_; // Per channel, oldest first, trimmed to the history capacity
+    std::vector<std::vector<std::string>> recentFrames_; // Per channel, for bootstraps
+    std::vector<Typist> typists_;
+    std::chrono::steady_clock::time_point lastDrop_{};
+    Totals totals_;
+    uint64_t parseErrorsAtStart_ = 0;
+    uint64_t duplicatesAtStart_ = 0;
+    int64_t memoryAtStart_ = 0;
+
+    void Run();
+    void Post(std::string frame, bool binary);
+    void SendBroadcast(uint64_t index);
+    void SendMalformed(uint64_t index);
+    void SendBootstrap(bool includeStressChannels);
+    void SendTyping(size_t typist, bool typing);
+    void UpdateTypists(std::chrono::steady_clock::time_point now);
+    void StopTypists();
+    // Logs the typists the client tracks, and whether that is between the ones that must be
+    // tracked and the ones that may still be (gone quiet, not yet expired).
+    void CheckTypists(std::chrono::steady_clock::time_point now);
+    bool WaitForPipeline(std::chrono::milliseconds timeout);
+    uint64_t CountMissing() const;
+    void Report(const char* label, std::chrono::steady_clock::duration elapsed);
+    std::string ChannelName(size_t index) const;
+    std::string MakeText(uint64_t index) const;
+};
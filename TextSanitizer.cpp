@@ -0,0 +1,311 @@
+#include "pch.h"
+#include "TextSanitizer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GLOBALCHAT_SANITIZER_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#endif
+
+// MSVC allows SSSE3 intrinsics in any function; GCC and Clang need the target per function.
+#if defined(GLOBALCHAT_SANITIZER_X86) && defined(__GNUC__)
+#define SSSE3_FUNCTION __attribute__((target("ssse3")))
+#else
+#define SSSE3_FUNCTION
+#endif
+
+namespace
+{
+    constexpr uint32_t INVALID = 0xFFFFFFFF;
+    constexpr char REPLACEMENT[] = "\xEF\xBF\xBD"; // U+FFFD
+
+    /**
+     * @brief Decodes the codepoint at `p`. On an invalid sequence returns INVALID, with
+     * `length` covering its longest valid prefix (at least one byte), so each broken
+     * sequence becomes a single replacement character.
+     */
+    uint32_t DecodeOne(const unsigned char* p, size_t available, size_t& length)
+    {
+        const unsigned char lead = p[0];
+        length = 1;
+        if (lead < 0x80) return lead;
+
+        size_t continuations = 0;
+        uint32_t codepoint = 0;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            continuations = 1;
+            codepoint = lead & 0x1F;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF) {
+            continuations = 2;
+            codepoint = lead & 0x0F;
+            if (lead == 0xE0) low = 0xA0; // Overlong
+            if (lead == 0xED) high = 0x9F; // Surrogates
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4) {
+            continuations = 3;
+            codepoint = lead & 0x07;
+            if (lead == 0xF0) low = 0x90; // Overlong
+            if (lead == 0xF4) high = 0x8F; // Past U+10FFFF
+        }
+        else {
+            return INVALID;
+        }
+
+        for (size_t i = 1; i <= continuations; ++i)
+        {
+            if (i >= available || p[i] < low || p[i] > high) return INVALID;
+            codepoint = (codepoint << 6) | (p[i] & 0x3F);
+            length = i + 1;
+            low = 0x80;
+            high = 0xBF;
+        }
+        return codepoint;
+    }
+
+    bool IsDrawable(uint32_t codepoint)
+    {
+        return codepoint >= 0x20 && codepoint != 0x7F && !(codepoint >= 0x80 && codepoint <= 0x9F) && codepoint <= 0xFFFF;
+    }
+
+    bool IsCleanFrom(const unsigned char* data, size_t size, size_t maxCodepoints)
+    {
+        size_t codepoints = 0;
+        for (size_t i = 0; i < size;)
+        {
+            size_t length = 0;
+            if (!IsDrawable(DecodeOne(data + i, size - i, length)) || ++codepoints > maxCodepoints) return false;
+            i += length;
+        }
+        return true;
+    }
+
+#ifdef GLOBALCHAT_SANITIZER_X86
+    /**
+     * @brief Length of the leading run of 16-byte blocks that are all printable ASCII.
+     * SSE2 only, so it is the fast path on every CPU.
+     */
+    size_t PrintableAsciiPrefix(const unsigned char* data, size_t size)
+    {
+        const __m128i space = _mm_set1_epi8(0x1F);
+        const __m128i del = _mm_set1_epi8(0x7F);
+        size_t offset = 0;
+        for (; offset + 16 <= size; offset += 16)
+        {
+            const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            // Signed compare: bytes from 0x80 up are negative and fail it too.
+            const __m128i printable = _mm_andnot_si128(_mm_cmpeq_epi8(input, del), _mm_cmpgt_epi8(input, space));
+            if (_mm_movemask_epi8(printable) != 0xFFFF) break;
+        }
+        return offset;
+    }
+
+    bool HasSsse3()
+    {
+#ifdef _MSC_VER
+        int info[4] = {};
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#else
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) != 0;
+#endif
+    }
+
+    const bool hasSsse3 = HasSsse3();
+
+    struct VectorState
+    {
+        __m128i previous = _mm_setzero_si128();
+        __m128i incomplete = _mm_setzero_si128(); // Non-zero if the previous block ends mid-sequence
+        __m128i error = _mm_setzero_si128();
+        size_t codepoints = 0;
+        bool rejected = false; // Valid UTF-8, but a character that is not drawable
+    };
+
+    /**
+     * @brief One 16-byte block of the Keiser-Lemire validator ("Validating UTF-8 In Less
+     * Than One Instruction Per Byte", 2021), extended with the checks for controls, C1
+     * and astral characters and a codepoint count. `validMask` has a bit per byte that
+     * belongs to the input; the rest is zero padding.
+     */
+    SSSE3_FUNCTION void ScanBlock(__m128i input, int validMask, VectorState& state)
+    {
+        // Error bits, set when a pair of consecutive bytes matches the pattern.
+        constexpr char TOO_SHORT = 1 << 0; // Lead or ASCII, then a lead or ASCII where a continuation belongs
+        constexpr char TOO_LONG = 1 << 1; // ASCII, then a continuation
+        constexpr char OVERLONG_3 = 1 << 2;
+        constexpr char TOO_LARGE = 1 << 3;
+        constexpr char SURROGATE = 1 << 4;
+        constexpr char OVERLONG_2 = 1 << 5;
+        constexpr char TOO_LARGE_1000 = 1 << 6;
+        constexpr char OVERLONG_4 = 1 << 6;
+        constexpr char TWO_CONTS = static_cast<char>(1 << 7); // Checked against the expected length below
+        constexpr char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            // All ASCII: only a sequence left open by the previous block can be wrong.
+            state.error = _mm_or_si128(state.error, state.incomplete);
+        }
+        else
+        {
+            const __m128i byte1HighTable = _mm_setr_epi8(
+                TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                TOO_SHORT | OVERLONG_2,
+                TOO_SHORT,
+                TOO_SHORT | OVERLONG_3 | SURROGATE,
+                TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+            const __m128i byte1LowTable = _mm_setr_epi8(
+                CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+                CARRY | OVERLONG_2,
+                CARRY,
+                CARRY,
+                CARRY | TOO_LARGE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000);
+            const __m128i byte2HighTable = _mm_setr_epi8(
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+            const __m128i prev1 = _mm_alignr_epi8(input, state.previous, 15);
+            const __m128i prev2 = _mm_alignr_epi8(input, state.previous, 14);
+            const __m128i prev3 = _mm_alignr_epi8(input, state.previous, 13);
+
+            const __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+            const __m128i byte1Low = _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(prev1, nibble));
+            const __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+            const __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+            // Bytes two and three places after a 3- or 4-byte lead must be continuations;
+            // that is exactly where TWO_CONTS is expected, so the two cancel out.
+            const __m128i thirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+            const __m128i fourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+            const __m128i expected = _mm_and_si128(_mm_or_si128(thirdByte, fourthByte), _mm_set1_epi8(static_cast<char>(0x80)));
+            state.error = _mm_or_si128(state.error, _mm_xor_si128(expected, special));
+
+            // C1 controls are C2 80 to C2 9F; anything past the BMP starts with F0 or above.
+            const __m128i c1 = _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8(static_cast<char>(0xC2))),
+                _mm_cmpeq_epi8(_mm_and_si128(input, _mm_set1_epi8(static_cast<char>(0xE0))), _mm_set1_epi8(static_cast<char>(0x80))));
+            const __m128i fourByteLead = _mm_cmpeq_epi8(_mm_max_epu8(input, _mm_set1_epi8(static_cast<char>(0xF0))), input);
+            state.rejected |= (_mm_movemask_epi8(_mm_or_si128(c1, fourByteLead)) & validMask) != 0;
+        }
+
+        // A lead byte in the last three places that needs more bytes than remain.
+        const __m128i incompleteLimit = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+        state.incomplete = _mm_subs_epu8(input, incompleteLimit);
+
+        const __m128i control = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(input, _mm_set1_epi8(0x1F)), input),
+            _mm_cmpeq_epi8(input, _mm_set1_epi8(0x7F)));
+        state.rejected |= (_mm_movemask_epi8(control) & validMask) != 0;
+
+        // Every byte but a continuation (0x80 to 0xBF, below -64 signed) starts a codepoint.
+        const __m128i starts = _mm_cmpgt_epi8(input, _mm_set1_epi8(-65));
+        state.codepoints += static_cast<size_t>(std::popcount(static_cast<unsigned int>(_mm_movemask_epi8(starts) & validMask)));
+
+        state.previous = input;
+    }
+
+    SSSE3_FUNCTION bool IsCleanSsse3(const unsigned char* data, size_t size, size_t maxCodepoints)
+    {
+        VectorState state;
+        size_t offset = 0;
+        for (; offset + 16 <= size; offset += 16)
+        {
+            ScanBlock(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)), 0xFFFF, state);
+            if (state.rejected || state.codepoints > maxCodepoints) return false;
+        }
+
+        // The tail, zero padded. Zeros are ASCII, so this also catches a sequence cut off at
+        // the end even when the input fills whole blocks.
+        alignas(16) unsigned char tail[16] = {};
+        const size_t remaining = size - offset;
+        std::copy_n(data + offset, remaining, tail);
+        ScanBlock(_mm_load_si128(reinterpret_cast<const __m128i*>(tail)), (1 << remaining) - 1, state);
+
+        return !state.rejected && state.codepoints <= maxCodepoints
+            && _mm_movemask_epi8(_mm_cmpeq_epi8(state.error, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif
+}
+
+bool TextSanitizer::IsCleanScalar(std::string_view text, size_t maxCodepoints)
+{
+    return IsCleanFrom(reinterpret_cast<const unsigned char*>(text.data()), text.size(), maxCodepoints);
+}
+
+bool TextSanitizer::IsClean(std::string_view text, size_t maxCodepoints)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+#ifdef GLOBALCHAT_SANITIZER_X86
+    // Most chat is printable ASCII: one codepoint per byte, nothing else to check.
+    const size_t prefix = PrintableAsciiPrefix(data, text.size());
+    if (prefix > maxCodepoints) return false;
+    if (prefix == text.size()) return true;
+
+    // The prefix ends on a character boundary, so the rest can be checked on its own.
+    if (hasSsse3) return IsCleanSsse3(data + prefix, text.size() - prefix, maxCodepoints - prefix);
+    return IsCleanFrom(data + prefix, text.size() - prefix, maxCodepoints - prefix);
+#else
+    return IsCleanFrom(data, text.size(), maxCodepoints);
+#endif
+}
+
+bool TextSanitizer::Sanitize(std::string& text, size_t maxCodepoints)
+{
+    if (IsClean(text, maxCodepoints)) return false;
+
+    const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+    std::string clean;
+    clean.reserve(std::min(text.size(), maxCodepoints * 3));
+    size_t codepoints = 0;
+    for (size_t i = 0; i < text.size() && codepoints < maxCodepoints;)
+    {
+        size_t length = 0;
+        const uint32_t codepoint = DecodeOne(data + i, text.size() - i, length);
+        if (codepoint == INVALID || codepoint > 0xFFFF) {
+            clean += REPLACEMENT;
+        }
+        else if (codepoint == '\t' || codepoint == '\n' || codepoint == '\r') {
+            clean.push_back(' ');
+        }
+        else if (IsDrawable(codepoint)) {
+            clean.append(text, i, length);
+        }
+        else {
+            i += length;
+            continue;
+        }
+        ++codepoints;
+        i += length;
+    }
+    text = std::move(clean);
+    return true;
+}
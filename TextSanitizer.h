@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Cleans strings from the server once, at ingest, so everything stored can be
+ * drawn as it is.
+ *
+ * A clean string is valid UTF-8 with no control characters and no codepoints past the
+ * BMP (ImGui's 16-bit ImWchar would draw those as the wrong glyph), and is no longer
+ * than its limit in codepoints. Checking is vectorized: printable ASCII is skipped 16
+ * bytes at a time with SSE2, and other text is validated with the SSSE3 lookup
+ * algorithm of Keiser and Lemire where the CPU has it. Only strings that fail the
+ * check are rewritten, byte by byte.
+ */
+namespace TextSanitizer
+{
+    // Longest message text kept. Also keeps a formatted message well inside ImGui's
+    // 3 KB text buffer, so TextWrapped never truncates it mid-character.
+    constexpr size_t MAX_TEXT_CODEPOINTS = 500;
+    // User, channel and platform names.
+    constexpr size_t MAX_NAME_CODEPOINTS = 32;
+
+    // Whether Sanitize would leave the string unchanged.
+    bool IsClean(std::string_view text, size_t maxCodepoints);
+
+    // Makes a string clean: invalid sequences and codepoints past the BMP become U+FFFD,
+    // tabs and line breaks become spaces, other control characters (C0, DEL, C1) are
+    // dropped, and the result is cut after maxCodepoints. Returns true if it changed.
+    bool Sanitize(std::string& text, size_t maxCodepoints);
+
+    // Byte-at-a-time IsClean, the baseline for globalchat_bench_utf8.
+    bool IsCleanScalar(std::string_view text, size_t maxCodepoints);
+}
@@ -0,0 +1,64 @@
+#include "TokenBucket.h"
+
+#include <algorithm>
+
+TokenBucket::TokenBucket(double ratePerSecond, uint32_t burst)
+{
+    Configure(ratePerSecond, burst);
+}
+
+void TokenBucket::Configure(double ratePerSecond, uint32_t burst)
+{
+    // NaN fails every comparison, so it is caught by the first test rather than passed through by clamp.
+    const double rate = ratePerSecond >= MIN_RATE ? std::min(ratePerSecond, MAX_RATE) : MIN_RATE;
+    const int64_t interval = static_cast<int64_t>(1e9 / rate);
+    intervalNs_.store(interval, std::memory_order_relaxed);
+    toleranceNs_.store(interval * (std::clamp<uint32_t>(burst, 1, MAX_BURST) - 1), std::memory_order_relaxed);
+}
+
+int64_t TokenBucket::ToNs(Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+bool TokenBucket::TryAcquire(uint32_t cost, Clock::time_point now)
+{
+    return Acquire(cost, 0, now);
+}
+
+bool TokenBucket::TryAcquireKeeping(uint32_t reserve, Clock::time_point now)
+{
+    return Acquire(1, reserve, now);
+}
+
+bool TokenBucket::Acquire(uint32_t cost, uint32_t reserve, Clock::time_point now)
+{
+    const int64_t nowNs = ToNs(now);
+    const int64_t interval = intervalNs_.load(std::memory_order_relaxed);
+    const int64_t tolerance = toleranceNs_.load(std::memory_order_relaxed);
+    // A cost above the burst can never be met; capping it (and the reserve) keeps the products in range.
+    const int64_t increment = interval * std::clamp<uint32_t>(cost, 1, MAX_BURST + 1);
+    const int64_t limit = tolerance + interval - interval * std::min<uint32_t>(reserve, MAX_BURST);
+
+    int64_t tat = tatNs_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        const int64_t newTat = std::max(tat, nowNs) + increment;
+        if (newTat - nowNs > limit) return false;
+        if (tatNs_.compare_exchange_weak(tat, newTat, std::memory_order_relaxed)) return true;
+    }
+}
+
+TokenBucket::Clock::duration TokenBucket::TimeUntilNext(Clock::time_point now) const
+{
+    const int64_t wait = tatNs_.load(std::memory_order_relaxed) - toleranceNs_.load(std::memory_order_relaxed) - ToNs(now);
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(std::max<int64_t>(wait, 0)));
+}
+
+uint32_t TokenBucket::Available(Clock::time_point now) const
+{
+    const int64_t interval = intervalNs_.load(std::memory_order_relaxed);
+    const int64_t headroom = toleranceNs_.load(std::memory_order_relaxed) + interval
+        - std::max<int64_t>(tatNs_.load(std::memory_order_relaxed) - ToNs(now), 0);
+    return headroom > 0 ? static_cast<uint32_t>(headroom / interval) : 0;
+}
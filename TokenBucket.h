@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Token bucket limiting how often frames may be sent: `ratePerSecond`
+ * tokens refill continuously, up to `burst` saved for a quick succession.
+ *
+ * Kept as a single "theoretical arrival time" (GCRA), so acquiring and querying are
+ * one atomic read or compare-exchange and can be used from any thread. Configure
+ * may be called at any time; a send racing with it sees either the old or the new
+ * parameters.
+ */
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Configure clamps to these, so no server-sent value can overflow the nanosecond arithmetic.
+    static constexpr double MIN_RATE = 0.01;
+    static constexpr double MAX_RATE = 1000.0;
+    static constexpr uint32_t MAX_BURST = 1000;
+
+    TokenBucket(double ratePerSecond, uint32_t burst);
+
+    void Configure(double ratePerSecond, uint32_t burst);
+
+    // Takes `cost` tokens if they are all available.
+    bool TryAcquire(uint32_t cost = 1, Clock::time_point now = Clock::now());
+    // Takes one token only if `reserve` more would still be left, so low-priority frames
+    // never spend the tokens that more important ones are waiting for.
+    bool TryAcquireKeeping(uint32_t reserve, Clock::time_point now = Clock::now());
+    // Zero when a token is available now.
+    Clock::duration TimeUntilNext(Clock::time_point now = Clock::now()) const;
+    // Whole tokens available now.
+    uint32_t Available(Clock::time_point now = Clock::now()) const;
+
+private:
+    std::atomic<int64_t> intervalNs_{ 0 }; // Time to refill one token
+    std::atomic<int64_t> toleranceNs_{ 0 }; // (burst - 1) * interval
+    std::atomic<int64_t> tatNs_{ 0 }; // When the bucket will be full again, on the steady clock
+
+    static int64_t ToNs(Clock::time_point time);
+    bool Acquire(uint32_t cost, uint32_t reserve, Clock::time_point now);
+};
@@ -0,0 +1,143 @@
+#include "TypingTracker.h"
+
+#include <algorithm>
+
+TypingTracker::TypingTracker(Clock::time_point now)
+    : origin_(now)
+{
+    wheel_.fill(NONE);
+}
+
+uint64_t TypingTracker::TickOf(Clock::time_point time) const
+{
+    if (time <= origin_) return 0;
+    return static_cast<uint64_t>((time - origin_) / TICK);
+}
+
+std::string_view TypingTracker::Key(std::string_view channel, std::string_view platform, std::string_view user)
+{
+    scratch_.assign(channel);
+    scratch_.push_back('\0');
+    scratch_.append(platform);
+    scratch_.push_back('\0');
+    scratch_.append(user);
+    return scratch_;
+}
+
+void TypingTracker::Start(std::string_view channel, std::string_view platform, std::string_view user, Clock::time_point now)
+{
+    // Catch the wheel up first, so the deadline lands within one lap of it.
+    Expire(now);
+    const auto slot = static_cast<uint32_t>((tick_ + static_cast<uint64_t>(TTL / TICK)) % SLOTS);
+
+    const std::string_view key = Key(channel, platform, user);
+    auto found = index_.find(key);
+    uint32_t index;
+    if (found != index_.end()) {
+        index = found->second;
+        UnlinkWheel(index);
+    }
+    else {
+        if (free_.empty()) {
+            index = static_cast<uint32_t>(entries_.size());
+            entries_.emplace_back();
+        }
+        else {
+            index = free_.back();
+            free_.pop_back();
+        }
+        found = index_.emplace(std::string(key), index).first;
+
+        auto list = channels_.find(channel);
+        if (list == channels_.end()) list = channels_.emplace(std::string(channel), ChannelList{}).first;
+
+        Entry& entry = entries_[index];
+        entry.key = &found->first;
+        entry.channel = &list->second;
+        entry.platformBegin = channel.size() + 1;
+        entry.userBegin = entry.platformBegin + platform.size() + 1;
+        entry.peers = { NONE, list->second.head };
+        if (list->second.head != NONE) entries_[list->second.head].peers.prev = index;
+        list->second.head = index;
+        ++list->second.count;
+    }
+    LinkWheel(index, slot);
+}
+
+bool TypingTracker::Stop(std::string_view channel, std::string_view platform, std::string_view user)
+{
+    const auto found = index_.find(Key(channel, platform, user));
+    if (found == index_.end()) return false;
+    Free(found);
+    return true;
+}
+
+void TypingTracker::Clear()
+{
+    index_.clear();
+    channels_.clear();
+    entries_.clear();
+    free_.clear();
+    wheel_.fill(NONE);
+}
+
+size_t TypingTracker::Expire(Clock::time_point now)
+{
+    const uint64_t current = TickOf(now);
+    if (current < tick_) return 0;
+
+    // Every live deadline is within one lap of tick_, so a bucket's entries are all due
+    // when its tick comes, and after a longer gap one pass over the wheel frees them all.
+    size_t freed = 0;
+    const uint64_t end = (std::min)(current + 1, tick_ + SLOTS);
+    for (; tick_ < end; ++tick_) {
+        const uint32_t& head = wheel_[tick_ % SLOTS];
+        while (head != NONE) {
+            Free(index_.find(*entries_[head].key));
+            ++freed;
+        }
+    }
+    tick_ = current + 1;
+    return freed;
+}
+
+size_t TypingTracker::Count(std::string_view channel) const
+{
+    const auto found = channels_.find(channel);
+    return found == channels_.end() ? 0 : found->second.count;
+}
+
+void TypingTracker::LinkWheel(uint32_t index, uint32_t slot)
+{
+    Entry& entry = entries_[index];
+    entry.slot = slot;
+    entry.wheel = { NONE, wheel_[slot] };
+    if (wheel_[slot] != NONE) entries_[wheel_[slot]].wheel.prev = index;
+    wheel_[slot] = index;
+}
+
+void TypingTracker::UnlinkWheel(uint32_t index)
+{
+    const Entry& entry = entries_[index];
+    if (entry.wheel.prev != NONE) entries_[entry.wheel.prev].wheel.next = entry.wheel.next;
+    else wheel_[entry.slot] = entry.wheel.next;
+    if (entry.wheel.next != NONE) entries_[entry.wheel.next].wheel.prev = entry.wheel.prev;
+}
+
+void TypingTracker::Free(Index::iterator it)
+{
+    const uint32_t index = it->second;
+    UnlinkWheel(index);
+
+    Entry& entry = entries_[index];
+    ChannelList& list = *entry.channel;
+    if (entry.peers.prev != NONE) entries_[entry.peers.prev].peers.next = entry.peers.next;
+    else list.head = entry.peers.next;
+    if (entry.peers.next != NONE) entries_[entry.peers.next].peers.prev = entry.peers.prev;
+    --list.count;
+
+    // Channel lists stay once created; there are only as many as channels ever typed in.
+    entry = {};
+    index_.erase(it);
+    free_.push_back(index);
+}
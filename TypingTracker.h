@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Who is typing in each channel. A typist is dropped on Stop, or TTL after the
+ * last Start if the stop never arrives.
+ *
+ * Entries live in one slab and sit on two intrusive lists: their channel's, for listing,
+ * and a bucket of a timing wheel with one bucket per TICK, for expiry. A (re)started entry
+ * moves to the bucket of the tick it runs out in, so Start and Stop are O(1), and advancing
+ * the wheel by a tick frees exactly one bucket, all of whose entries are due. Not
+ * thread-safe; GlobalChat guards it with typingMutex.
+ */
+class TypingTracker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto TICK = std::chrono::milliseconds(250);
+    static constexpr auto TTL = std::chrono::seconds(7); // Senders refresh well within this
+    static constexpr size_t SLOTS = 32;
+    static_assert(static_cast<size_t>(TTL / TICK) < SLOTS, "an entry must not lap the wheel");
+
+    explicit TypingTracker(Clock::time_point now = Clock::now());
+
+    // Marks the user as typing in the channel until TTL from now.
+    void Start(std::string_view channel, std::string_view platform, std::string_view user, Clock::time_point now);
+    // Returns false if the user was not typing there.
+    bool Stop(std::string_view channel, std::string_view platform, std::string_view user);
+    void Clear();
+
+    // Frees the entries that ran out by `now` and returns how many. Costs a bucket per tick
+    // since the last call, and never more than one sweep of the wheel.
+    size_t Expire(Clock::time_point now);
+
+    size_t Size() const { return index_.size(); }
+    size_t Count(std::string_view channel) const;
+
+    // Calls f(platform, user) for the channel's typists, newest first, until it returns false.
+    template <typename F>
+    void ForEach(std::string_view channel, F&& f) const
+    {
+        const auto found = channels_.find(channel);
+        if (found == channels_.end()) return;
+        for (uint32_t i = found->second.head; i != NONE; i = entries_[i].peers.next) {
+            const Entry& entry = entries_[i];
+            const std::string_view key = *entry.key;
+            if (!f(key.substr(entry.platformBegin, entry.userBegin - entry.platformBegin - 1), key.substr(entry.userBegin))) return;
+        }
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+
+    struct ChannelList
+    {
+        uint32_t head = NONE;
+        uint32_t count = 0;
+    };
+
+    struct Link
+    {
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+    };
+
+    struct Entry
+    {
+        const std::string* key = nullptr; // Owned by index_; null while the entry is free
+        ChannelList* channel = nullptr; // Owned by channels_
+        size_t platformBegin = 0; // Offsets into key
+        size_t userBegin = 0;
+        uint32_t slot = 0;
+        Link wheel;
+        Link peers; // In the channel's list
+    };
+
+    using Index = std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>>;
+
+    uint64_t TickOf(Clock::time_point time) const;
+    // Channel, platform and user joined into scratch_, the index key of the pair.
+    std::string_view Key(std::string_view channel, std::string_view platform, std::string_view user);
+    void LinkWheel(uint32_t entry, uint32_t slot);
+    void UnlinkWheel(uint32_t entry);
+    void Free(Index::iterator it);
+
+    Index index_;
+    std::unordered_map<std::string, ChannelList, NameHash, std::equal_to<>> channels_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> free_;
+    std::array<uint32_t, SLOTS> wheel_;
+    Clock::time_point origin_;
+    uint64_t tick_ = 0; // Buckets of every earlier tick have been swept
+    std::string scratch_;
+};
@@ -1,67 +1,115 @@
-#include "pch.h"
+#define WIN32_LEAN_AND_MEAN // As pch.h does; this unit builds without it so the tests can drive it
 #include "WSManager.h"
 #include "resource.h"
+#include "ChatMetrics.h"
 #include <boost/asio/connect.hpp>
+#include <algorithm>
 #include <iostream>
 
 WSManager::WSManager() {}
 
 WSManager::~WSManager() {
-    if (IsConnected()) {
-        Disconnect();
+    Disconnect();
+    if (tls_session_) {
+        SSL_SESSION_free(tls_session_);
     }
 }
 
 void WSManager::Connect(const std::string& host, const std::string& port, const std::string& target, HMODULE dll_handle, Callbacks callbacks) {
-    if (is_connected_) return;
+    if (network_thread_) return;
+
+    timing_ = {};
+    timing_.requested = ConnectTiming::Clock::now();
 
     host_ = host;
     port_ = port;
     target_ = target;
+    dll_handle_ = dll_handle;
     callbacks_ = std::move(callbacks);
+    stopping_ = false;
 
     ioc_ = std::make_unique<net::io_context>();
+    network_thread_ = std::make_unique<std::thread>(&WSManager::Run, this);
+}
+
+bool WSManager::InitTls() {
     ctx_ = std::make_unique<ssl::context>(ssl::context::tlsv12_client);
 
-    HRSRC hRes = FindResource(dll_handle, MAKEINTRESOURCE(IDR_PEM1), L"PEM");
+    HRSRC hRes = FindResource(dll_handle_, MAKEINTRESOURCE(IDR_PEM1), L"PEM");
     if (hRes) {
-        HGLOBAL hResLoad = LoadResource(dll_handle, hRes);
+        HGLOBAL hResLoad = LoadResource(dll_handle_, hRes);
         if (hResLoad) {
             void* pCertData = LockResource(hResLoad);
-            DWORD dwCertSize = SizeofResource(dll_handle, hRes);
+            DWORD dwCertSize = SizeofResource(dll_handle_, hRes);
 
             boost::system::error_code ec;
             ctx_->add_certificate_authority(net::buffer(pCertData, dwCertSize), ec);
             if (ec) {
                 Fail(ec, "add_certificate_authority_from_resource");
-                return;
+                return false;
             }
         }
     }
     else {
         Fail({}, "PEM resource not found in DLL");
-        return;
+        return false;
     }
 
     ctx_->set_verify_mode(ssl::verify_peer);
 
-    resolver_ = std::make_unique<tcp::resolver>(net::make_strand(*ioc_));
-    ws_ = std::make_unique<websocket::stream<beast::ssl_stream<tcp::socket>>>(net::make_strand(*ioc_), *ctx_);
+    // Keep the latest session ticket ourselves so reconnects can resume it.
+    // (The context's app data slot is taken by Asio's verify callback.)
+    SSL_CTX* native = ctx_->native_handle();
+    SSL_CTX_set_ex_data(native, TlsExDataIndex(), this);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &WSManager::OnNewTlsSession);
+    return true;
+}
 
-    network_thread_ = std::make_unique<std::thread>(&WSManager::Run, this);
+int WSManager::TlsExDataIndex() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+int WSManager::OnNewTlsSession(SSL* ssl, SSL_SESSION* session) {
+    auto* self = static_cast<WSManager*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TlsExDataIndex()));
+    if (!self) return 0;
+
+    // Keep a private copy: when a connection drops without a TLS close_notify, OpenSSL
+    // marks that connection's session object as not resumable.
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (!copy) return 0;
+
+    if (self->tls_session_) {
+        SSL_SESSION_free(self->tls_session_);
+    }
+    self->tls_session_ = copy;
+    return 0;
 }
 
 void WSManager::Run() {
-    resolver_->async_resolve(host_, port_,
-        beast::bind_front_handler(&WSManager::OnResolve, this));
+    timing_.thread_started = ConnectTiming::Clock::now();
+    if (callbacks_.on_startup) callbacks_.on_startup();
+
+    if (!InitTls()) return;
+    timing_.context_ready = ConnectTiming::Clock::now();
+
+    resolver_ = std::make_unique<tcp::resolver>(net::make_strand(*ioc_));
+    reconnect_timer_ = std::make_unique<net::steady_timer>(*ioc_);
+    ping_timer_ = std::make_unique<net::steady_timer>(*ioc_);
+
+    StartConnect();
     ioc_->run();
-    if (callbacks_.on_disconnect) {
+    if (session_open_ && callbacks_.on_disconnect) {
         callbacks_.on_disconnect();
     }
 }
 
 void WSManager::Disconnect() {
-    if (!is_connected_.exchange(false)) return;
+    // The thread may still be resolving or handshaking, so stop it even if we never connected.
+    stopping_ = true;
+    is_connected_ = false;
+    if (!network_thread_) return;
 
     if (ioc_) {
         net::post(*ioc_, [this]() {
@@ -78,80 +126,359 @@ void WSManager::Disconnect() {
     }
 
     network_thread_.reset();
+    outbox_.Clear();
+    writing_ = false;
     ws_.reset();
+    reconnect_timer_.reset();
+    ping_timer_.reset();
     resolver_.reset();
     ctx_.reset();
     ioc_.reset();
 }
 
 bool WSManager::IsConnected() const {
-    return is_connected_ && ws_ && ws_->is_open();
+    return is_connected_;
+}
+
+void WSManager::SetSubprotocols(std::vector<Subprotocol> protocols) {
+    subprotocols_ = std::move(protocols);
+    offered_protocols_.clear();
+    for (const auto& protocol : subprotocols_) {
+        if (!offered_protocols_.empty()) offered_protocols_ += ", ";
+        offered_protocols_ += protocol.name;
+    }
+}
+
+bool WSManager::Send(Serializer serialize) {
+    if (!ioc_ || stopping_) return false;
+    if (!outbox_.Reserve()) {
+        GetMetrics().outboxDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    net::post(*ioc_, [this, serialize = std::move(serialize)]() mutable {
+        outbox_.Push(std::move(serialize));
+        GetMetrics().SetWriteQueueDepth(outbox_.Size());
+        if (!writing_ && session_open_) {
+            DoWrite();
+        }
+    });
+    return true;
+}
+
+bool WSManager::Send(std::string message) {
+    return Send([message = std::move(message)](std::string_view) { return message; });
 }
 
-void WSManager::Send(const std::string& message) {
-    if (!IsConnected()) return;
-    net::post(ws_->get_executor(), [this, message]() {
-        write_queue_.push_back(message);
-        if (write_queue_.size() == 1) {
+bool WSManager::SendCoalesced(std::string key, Serializer serialize) {
+    if (!ioc_ || stopping_) return false;
+
+    // The outbox slot is only reserved once the frame turns out not to merge, so a burst of
+    // updates to one state never fills the outbox ahead of the frames it would replace.
+    net::post(*ioc_, [this, key = std::move(key), serialize = std::move(serialize)]() mutable {
+        // The front frame may be mid-write; everything behind it is still just a serializer.
+        if (outbox_.Coalesce(key, serialize, writing_)) {
+            GetMetrics().coalescedFrames.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (!outbox_.Reserve()) {
+            GetMetrics().outboxDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        outbox_.Push(std::move(serialize), std::move(key));
+        GetMetrics().SetWriteQueueDepth(outbox_.Size());
+        if (!writing_ && session_open_) {
             DoWrite();
         }
     });
+    return true;
 }
 
-void WSManager::OnResolve(beast::error_code ec, tcp::resolver::results_type results) {
-    if (ec) return Fail(ec, "resolve");
-    net::async_connect(beast::get_lowest_layer(*ws_), results, beast::bind_front_handler(&WSManager::OnConnect, this));
+bool WSManager::Post(std::function<void()> task) {
+    if (!ioc_ || stopping_) return false;
+    net::post(*ioc_, std::move(task));
+    return true;
 }
 
-void WSManager::OnConnect(beast::error_code ec, const tcp::endpoint& endpoint) {
-    if (ec) return Fail(ec, "connect");
+void WSManager::StartConnect() {
+    if (stopping_) return;
+
+    ++connection_id_;
+    reconnect_pending_ = false;
+    ws_.reset();
+
+    const int attempt = timing_.attempt + 1;
+    if (attempt > 1) {
+        GetMetrics().reconnects.fetch_add(1, std::memory_order_relaxed);
+    }
+    const auto requested = timing_.requested;
+    const auto threadStarted = timing_.thread_started;
+    const auto contextReady = timing_.context_ready;
+    timing_ = {};
+    timing_.requested = requested;
+    timing_.thread_started = threadStarted;
+    timing_.context_ready = contextReady;
+    timing_.attempt = attempt;
+    timing_.attempt_started = ConnectTiming::Clock::now();
 
-    if (!SSL_set_tlsext_host_name(ws_->next_layer().native_handle(), host_.c_str())) {
-        ec = beast::error_code(static_cast<int>(::ERR_get_error()), net::error::get_ssl_category());
-        return Fail(ec, "set SNI");
+    // Skip DNS while the last good answer is fresh.
+    if (!cached_endpoints_.empty() && timing_.attempt_started < cached_endpoints_expiry_) {
+        timing_.used_cached_endpoints = true;
+        timing_.resolved = timing_.attempt_started;
+        RaceConnect(cached_endpoints_);
+        return;
     }
 
-    ws_->next_layer().async_handshake(ssl::stream_base::client, beast::bind_front_handler(&WSManager::OnSslHandshake, this));
+    resolver_->async_resolve(host_, port_,
+        beast::bind_front_handler(&WSManager::OnResolve, this, connection_id_));
 }
 
-void WSManager::OnSslHandshake(beast::error_code ec) {
-    if (ec) return Fail(ec, "ssl_handshake");
-    ws_->async_handshake(host_, target_, beast::bind_front_handler(&WSManager::OnHandshake, this));
+void WSManager::OnResolve(uint64_t id, beast::error_code ec, tcp::resolver::results_type results) {
+    if (id != connection_id_) return;
+    if (ec) return ConnectionLost(ec, "resolve");
+    timing_.resolved = ConnectTiming::Clock::now();
+
+    std::vector<tcp::endpoint> endpoints;
+    for (const auto& entry : results) {
+        endpoints.push_back(entry.endpoint());
+    }
+    RaceConnect(std::move(endpoints));
+}
+
+void WSManager::RaceConnect(std::vector<tcp::endpoint> endpoints) {
+    auto race = std::make_shared<ConnectRace>();
+    race->endpoints = std::move(endpoints);
+    race->sockets.resize(race->endpoints.size());
+    race->stagger = std::make_unique<net::steady_timer>(*ioc_);
+
+    if (race->endpoints.empty()) {
+        return ConnectionLost(net::error::host_not_found, "resolve");
+    }
+    StartRaceAttempt(race);
 }
 
-void WSManager::OnHandshake(beast::error_code ec) {
-    if (ec) return Fail(ec, "handshake");
+void WSManager::StartRaceAttempt(const std::shared_ptr<ConnectRace>& race) {
+    if (race->finished || race->next >= race->endpoints.size()) return;
+
+    const size_t index = race->next++;
+    race->sockets[index] = std::make_unique<tcp::socket>(net::make_strand(*ioc_));
+    ++race->pending;
+    race->sockets[index]->async_connect(race->endpoints[index], [this, race, index](beast::error_code ec) {
+        OnRaceAttempt(race, index, ec);
+    });
+
+    // Give this endpoint a head start before racing the next one.
+    if (race->next < race->endpoints.size()) {
+        race->stagger->expires_after(CONNECT_STAGGER);
+        race->stagger->async_wait([this, race](beast::error_code ec) {
+            if (!ec) StartRaceAttempt(race);
+        });
+    }
+}
+
+void WSManager::OnRaceAttempt(const std::shared_ptr<ConnectRace>& race, size_t index, beast::error_code ec) {
+    --race->pending;
+    if (race->finished || stopping_) return;
+
+    if (ec) {
+        race->last_error = ec;
+        if (race->next < race->endpoints.size()) {
+            // Don't wait out the stagger once an attempt has already failed.
+            race->stagger->cancel();
+            StartRaceAttempt(race);
+        }
+        else if (race->pending == 0) {
+            race->finished = true;
+            // Every endpoint failed; the cached answer may be stale.
+            cached_endpoints_.clear();
+            ConnectionLost(race->last_error, "connect");
+        }
+        return;
+    }
+
+    race->finished = true;
+    race->stagger->cancel();
+    for (size_t i = 0; i < race->sockets.size(); ++i) {
+        if (i != index && race->sockets[i]) {
+            beast::error_code ignored;
+            race->sockets[i]->close(ignored);
+        }
+    }
+
+    cached_endpoints_ = race->endpoints;
+    // Try the winner first next time.
+    std::rotate(cached_endpoints_.begin(), cached_endpoints_.begin() + index, cached_endpoints_.begin() + index + 1);
+    cached_endpoints_expiry_ = ConnectTiming::Clock::now() + DNS_CACHE_TTL;
+
+    ws_ = std::make_unique<Stream>(std::move(*race->sockets[index]), *ctx_);
+    // Bounds the websocket handshake and close; an open session is watched by the pings.
+    ws_->set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+    ws_->control_callback([this](websocket::frame_type kind, beast::string_view) {
+        if (kind == websocket::frame_type::pong && ping_outstanding_) {
+            ping_outstanding_ = false;
+            GetMetrics().roundTripTime.Record(ConnectTiming::Clock::now() - ping_sent_);
+        }
+    });
+    if (!offered_protocols_.empty()) {
+        ws_->set_option(websocket::stream_base::decorator([offer = offered_protocols_](websocket::request_type& req) {
+            req.set(beast::http::field::sec_websocket_protocol, offer);
+        }));
+    }
+    OnConnect(connection_id_, race->endpoints[index]);
+}
+
+void WSManager::OnConnect(uint64_t id, const tcp::endpoint&) {
+    if (id != connection_id_) return;
+    timing_.tcp_connected = ConnectTiming::Clock::now();
+
+    SSL* ssl = ws_->next_layer().native_handle();
+    if (!SSL_set_tlsext_host_name(ssl, host_.c_str())) {
+        beast::error_code ec(static_cast<int>(::ERR_get_error()), net::error::get_ssl_category());
+        return ConnectionLost(ec, "set SNI");
+    }
+    if (tls_session_) {
+        SSL_set_session(ssl, tls_session_);
+    }
+
+    ws_->next_layer().async_handshake(ssl::stream_base::client, beast::bind_front_handler(&WSManager::OnSslHandshake, this, id));
+}
+
+void WSManager::OnSslHandshake(uint64_t id, beast::error_code ec) {
+    if (id != connection_id_) return;
+    if (ec) {
+        // A rejected ticket should not poison every later attempt.
+        if (tls_session_) {
+            SSL_SESSION_free(tls_session_);
+            tls_session_ = nullptr;
+        }
+        return ConnectionLost(ec, "ssl_handshake");
+    }
+    timing_.tls_handshake = ConnectTiming::Clock::now();
+    timing_.tls_session_resumed = SSL_session_reused(ws_->next_layer().native_handle()) == 1;
+    handshake_response_ = {};
+    ws_->async_handshake(handshake_response_, host_, target_, beast::bind_front_handler(&WSManager::OnHandshake, this, id));
+}
+
+void WSManager::OnHandshake(uint64_t id, beast::error_code ec) {
+    if (id != connection_id_) return;
+    if (ec) return ConnectionLost(ec, "handshake");
+    timing_.ws_handshake = ConnectTiming::Clock::now();
+    // Anything we did not offer is treated as no subprotocol.
+    protocol_.clear();
+    protocol_binary_ = false;
+    const auto selected = handshake_response_[beast::http::field::sec_websocket_protocol];
+    for (const auto& protocol : subprotocols_) {
+        if (protocol.name == selected) {
+            protocol_ = protocol.name;
+            protocol_binary_ = protocol.binary;
+        }
+    }
+    consecutive_failures_ = 0;
+    session_open_ = true;
     is_connected_ = true;
     if (callbacks_.on_connect) callbacks_.on_connect();
     DoRead();
+    SchedulePing();
+    if (!outbox_.Empty() && !writing_) DoWrite();
+}
+
+void WSManager::SchedulePing() {
+    // Periodic pings measure round-trip time and keep idle connections alive. A pong still
+    // missing a whole interval later means the connection is gone even if TCP has not noticed,
+    // and a second ping must not be started while the first may still be in flight anyway.
+    ping_timer_->expires_after(PING_INTERVAL);
+    ping_timer_->async_wait([this, id = connection_id_](beast::error_code ec) {
+        if (ec || id != connection_id_) return;
+        if (ping_outstanding_) return ConnectionLost(net::error::timed_out, "ping");
+        ping_sent_ = ConnectTiming::Clock::now();
+        ping_outstanding_ = true;
+        ws_->async_ping({}, [this, id](beast::error_code ec) {
+            if (id != connection_id_) return;
+            if (ec) return ConnectionLost(ec, "ping");
+        });
+        SchedulePing();
+    });
 }
 
 void WSManager::DoRead() {
-    ws_->async_read(read_buffer_, beast::bind_front_handler(&WSManager::OnRead, this));
+    ws_->async_read(read_buffer_, beast::bind_front_handler(&WSManager::OnRead, this, connection_id_));
 }
 
-void WSManager::OnRead(beast::error_code ec, std::size_t) {
-    if (ec) {
-        is_connected_ = false;
-        if (ec != websocket::error::closed && ec != net::error::eof) Fail(ec, "read");
-        return;
-    }
-    if (callbacks_.on_message) callbacks_.on_message(beast::buffers_to_string(read_buffer_.data()));
+void WSManager::OnRead(uint64_t id, beast::error_code ec, std::size_t) {
+    if (id != connection_id_) return;
+    if (ec) return ConnectionLost(ec, "read");
+
+    auto& metrics = GetMetrics();
+    metrics.messagesIn.fetch_add(1, std::memory_order_relaxed);
+    metrics.bytesIn.fetch_add(read_buffer_.size(), std::memory_order_relaxed);
+    if (callbacks_.on_message) callbacks_.on_message(beast::buffers_to_string(read_buffer_.data()), ws_->got_binary());
     read_buffer_.consume(read_buffer_.size());
     DoRead();
 }
 
 void WSManager::DoWrite() {
-    ws_->async_write(net::buffer(write_queue_.front()), beast::bind_front_handler(&WSManager::OnWrite, this));
+    // Only reached between writes, so the front frame is never one in flight.
+    auto& metrics = GetMetrics();
+    metrics.outboxDropped.fetch_add(outbox_.DropStale(), std::memory_order_relaxed);
+    metrics.SetWriteQueueDepth(outbox_.Size());
+    if (outbox_.Empty()) return;
+
+    Outbox::Frame& frame = outbox_.Front(protocol_, protocol_binary_);
+    writing_ = true;
+    ws_->binary(frame.binary);
+    ws_->async_write(net::buffer(frame.data), beast::bind_front_handler(&WSManager::OnWrite, this, connection_id_));
 }
 
-void WSManager::OnWrite(beast::error_code ec, std::size_t) {
-    if (ec) {
-        is_connected_ = false;
-        return Fail(ec, "write");
+void WSManager::OnWrite(uint64_t id, beast::error_code ec, std::size_t bytes_transferred) {
+    if (id != connection_id_) return;
+    writing_ = false;
+    // On failure the frame stays queued and is sent again after reconnecting.
+    if (ec) return ConnectionLost(ec, "write");
+
+    auto& metrics = GetMetrics();
+    metrics.messagesOut.fetch_add(1, std::memory_order_relaxed);
+    metrics.bytesOut.fetch_add(bytes_transferred, std::memory_order_relaxed);
+    outbox_.PopFront();
+    metrics.SetWriteQueueDepth(outbox_.Size());
+    if (!outbox_.Empty()) DoWrite();
+}
+
+void WSManager::ConnectionLost(beast::error_code ec, const char* what) {
+    if (stopping_ || reconnect_pending_) return;
+    reconnect_pending_ = true;
+
+    const bool wasOpen = session_open_;
+    session_open_ = false;
+    is_connected_ = false;
+    writing_ = false;
+    ping_outstanding_ = false;
+    read_buffer_.consume(read_buffer_.size());
+    // A frame that was being written is rebuilt for whatever the next connection negotiates.
+    outbox_.ResetFront();
+
+    if (ec && ec != websocket::error::closed && ec != net::error::eof) Fail(ec, what);
+    if (wasOpen && callbacks_.on_disconnect) callbacks_.on_disconnect();
+
+    // Stale handlers from this connection are ignored via connection_id_.
+    ++connection_id_;
+    ping_timer_->cancel();
+    if (ws_) {
+        beast::error_code ignored;
+        beast::get_lowest_layer(*ws_).close(ignored);
     }
-    write_queue_.erase(write_queue_.begin());
-    if (!write_queue_.empty()) DoWrite();
+    ScheduleReconnect();
+}
+
+void WSManager::ScheduleReconnect() {
+    if (stopping_) return;
+
+    const int shift = (std::min)(consecutive_failures_++, 5);
+    const auto delay = std::min<std::chrono::steady_clock::duration>(RECONNECT_BASE_DELAY * (1 << shift), RECONNECT_MAX_DELAY);
+    reconnect_timer_->expires_after(delay);
+    reconnect_timer_->async_wait([this](beast::error_code ec) {
+        if (!ec) StartConnect();
+    });
 }
 
 void WSManager::Fail(beast::error_code ec, const char* what) {
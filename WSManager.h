@@ -3,15 +3,20 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/websocket.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <Windows.h>
 
+#include "Outbox.h"
+
 #include <string>
 #include <functional>
 #include <memory>
 #include <string_view>
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
@@ -22,47 +27,152 @@ using tcp = net::ip::tcp;
 class WSManager {
 public:
     struct Callbacks {
+        // Runs on the network thread before the first connection attempt.
+        std::function<void()> on_startup;
         std::function<void()> on_connect;
-        std::function<void(std::string_view message)> on_message;
+        // `binary` tells binary frames from text frames.
+        std::function<void(std::string_view message, bool binary)> on_message;
         std::function<void(std::string_view error)> on_error;
+        // Fires when an established connection is lost; a reconnect is scheduled afterwards.
         std::function<void()> on_disconnect;
     };
 
+    // Milestones of the current connection attempt. `requested` is the time of Connect().
+    struct ConnectTiming {
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point requested;
+        Clock::time_point thread_started;
+        Clock::time_point context_ready;
+        Clock::time_point attempt_started;
+        Clock::time_point resolved;
+        Clock::time_point tcp_connected;
+        Clock::time_point tls_handshake;
+        Clock::time_point ws_handshake;
+        int attempt = 0;
+        bool used_cached_endpoints = false;
+        bool tls_session_resumed = false;
+    };
+
+    // A Sec-WebSocket-Protocol value to offer. Frames written on a connection that negotiated
+    // a binary subprotocol are sent as binary frames.
+    struct Subprotocol {
+        std::string name;
+        bool binary = false;
+    };
+
+    // Builds a frame for the subprotocol negotiated on the connection it is written to
+    // (empty if none), so a frame queued across a reconnect matches the new connection.
+    using Serializer = Outbox::Serializer;
+
     WSManager();
     ~WSManager();
 
     WSManager(const WSManager&) = delete;
     WSManager& operator=(const WSManager&) = delete;
 
-    // Correct 5-argument signature
+    // Returns immediately; TLS setup, resolution and the handshakes run on the network thread.
+    // Lost connections are re-established with backoff until Disconnect().
     void Connect(const std::string& host, const std::string& port, const std::string& target, HMODULE dll_handle, Callbacks callbacks);
-    void Send(const std::string& message);
+    // Offered in this order on every handshake. Call before Connect().
+    void SetSubprotocols(std::vector<Subprotocol> protocols);
+    // Queues a frame in the outbox; `serialize` runs on the network thread, right before the
+    // frame is first written. Frames queued while
+    // the connection is down are kept and sent in order once it is back, unless they are older
+    // than Outbox::MAX_AGE by then. Returns false, dropping the frame, when the outbox is full or
+    // Connect() has not been called; queued frames are never displaced by newer ones.
+    bool Send(Serializer serialize);
+    bool Send(std::string message); // Sent as is, whatever the subprotocol
+    // Like Send, except that a queued frame with the same key that has not started writing
+    // yet is replaced in place, so a burst of updates to the same state costs one frame, which
+    // keeps the place and age of the first. Plain Send frames have no key and never match.
+    // Whether the outbox has room is only known on the network thread; a frame that neither
+    // merges nor fits is dropped there, so true means handed over, not queued.
+    bool SendCoalesced(std::string key, Serializer serialize);
+    // Runs `task` on the network thread, in order with the connection's own callbacks.
+    // Returns false if Connect() has not been called.
+    bool Post(std::function<void()> task);
     void Disconnect();
     bool IsConnected() const;
+    // Only stable once on_connect has fired; read it from the network thread callbacks.
+    const ConnectTiming& GetConnectTiming() const { return timing_; }
+    // Subprotocol the server picked for the current connection, empty if none. Same rules as above.
+    const std::string& Protocol() const { return protocol_; }
 
 private:
+    using Stream = websocket::stream<beast::ssl_stream<tcp::socket>>;
+
+    // Parallel TCP connects across the resolved endpoints, started a short stagger apart;
+    // the first socket to connect wins and the rest are closed.
+    struct ConnectRace {
+        std::vector<tcp::endpoint> endpoints;
+        std::vector<std::unique_ptr<tcp::socket>> sockets;
+        std::unique_ptr<net::steady_timer> stagger;
+        size_t next = 0;
+        size_t pending = 0;
+        bool finished = false;
+        beast::error_code last_error;
+    };
+
+    static constexpr auto DNS_CACHE_TTL = std::chrono::minutes(5);
+    static constexpr auto CONNECT_STAGGER = std::chrono::milliseconds(250);
+    static constexpr auto RECONNECT_BASE_DELAY = std::chrono::seconds(1);
+    static constexpr auto RECONNECT_MAX_DELAY = std::chrono::seconds(30);
+    static constexpr auto PING_INTERVAL = std::chrono::seconds(15);
+
     std::unique_ptr<net::io_context> ioc_;
     std::unique_ptr<ssl::context> ctx_;
     std::unique_ptr<tcp::resolver> resolver_;
-    std::unique_ptr<websocket::stream<beast::ssl_stream<tcp::socket>>> ws_;
+    std::unique_ptr<Stream> ws_;
+    std::unique_ptr<net::steady_timer> reconnect_timer_;
+    std::unique_ptr<net::steady_timer> ping_timer_;
     std::unique_ptr<std::thread> network_thread_;
 
     beast::flat_buffer read_buffer_;
-    std::vector<std::string> write_queue_;
+    Outbox outbox_;
+    bool writing_ = false;
     std::string host_;
     std::string port_;
     std::string target_;
+    std::vector<Subprotocol> subprotocols_;
+    std::string offered_protocols_; // Comma-separated header value
+    websocket::response_type handshake_response_;
+    std::string protocol_;
+    bool protocol_binary_ = false;
+    HMODULE dll_handle_ = nullptr;
     Callbacks callbacks_;
+    ConnectTiming timing_;
     std::atomic<bool> is_connected_{ false };
+    std::atomic<bool> stopping_{ false };
+
+    // Network-thread state for reconnects.
+    uint64_t connection_id_ = 0;
+    bool session_open_ = false;
+    bool reconnect_pending_ = false;
+    int consecutive_failures_ = 0;
+    std::vector<tcp::endpoint> cached_endpoints_;
+    ConnectTiming::Clock::time_point cached_endpoints_expiry_{};
+    SSL_SESSION* tls_session_ = nullptr;
+    ConnectTiming::Clock::time_point ping_sent_{};
+    bool ping_outstanding_ = false;
 
     void Run();
-    void OnResolve(beast::error_code ec, tcp::resolver::results_type results);
-    void OnConnect(beast::error_code ec, const tcp::endpoint& endpoint);
-    void OnSslHandshake(beast::error_code ec);
-    void OnHandshake(beast::error_code ec);
+    bool InitTls();
+    static int TlsExDataIndex();
+    static int OnNewTlsSession(SSL* ssl, SSL_SESSION* session);
+    void StartConnect();
+    void OnResolve(uint64_t id, beast::error_code ec, tcp::resolver::results_type results);
+    void RaceConnect(std::vector<tcp::endpoint> endpoints);
+    void StartRaceAttempt(const std::shared_ptr<ConnectRace>& race);
+    void OnRaceAttempt(const std::shared_ptr<ConnectRace>& race, size_t index, beast::error_code ec);
+    void OnConnect(uint64_t id, const tcp::endpoint& endpoint);
+    void OnSslHandshake(uint64_t id, beast::error_code ec);
+    void OnHandshake(uint64_t id, beast::error_code ec);
+    void SchedulePing();
     void DoRead();
-    void OnRead(beast::error_code ec, std::size_t bytes_transferred);
+    void OnRead(uint64_t id, beast::error_code ec, std::size_t bytes_transferred);
     void DoWrite();
-    void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
+    void OnWrite(uint64_t id, beast::error_code ec, std::size_t bytes_transferred);
+    void ConnectionLost(beast::error_code ec, const char* what);
+    void ScheduleReconnect();
     void Fail(beast::error_code ec, const char* what);
-};
\ No newline at end of file
+};
@@ -0,0 +1,193 @@
+#include "WireFormat.h"
+
+#include <array>
+#include <utility>
+
+namespace
+{
+    // Short name, full name. Never reuse a short name for a different field.
+    constexpr std::array<std::pair<std::string_view, std::string_view>, 11> SHORT_KEYS = { {
+        { "y", "type" },
+        { "d", "data" },
+        { "e", "error" },
+        { "p", "platform" },
+        { "c", "channel" },
+        { "u", "user" },
+        { "t", "text" },
+        { "r", "highest_rank" },
+        { "s", "seq" },
+        { "i", "client_id" },
+        { "g", "typing" },
+    } };
+
+    std::string_view FullKey(std::string_view key)
+    {
+        for (const auto& [shortKey, fullKey] : SHORT_KEYS) {
+            if (shortKey == key) return fullKey;
+        }
+        return key;
+    }
+
+    std::string_view ShortKey(std::string_view key)
+    {
+        for (const auto& [shortKey, fullKey] : SHORT_KEYS) {
+            if (fullKey == key) return shortKey;
+        }
+        return key;
+    }
+
+    /**
+     * @brief SAX handler for a flat chat message object. Stops the parse (returns false)
+     * as soon as the frame turns out to be anything the generic path should handle, so it
+     * accepts exactly the frames that path would treat as a chat message without error.
+     */
+    class ChatMessageSax
+    {
+    public:
+        using json = nlohmann::json;
+
+        // Short keys are only expanded for binary frames, as Decode does.
+        ChatMessageSax(ChatMessage& message, std::string& clientId, bool shortKeys)
+            : message_(message), clientId_(clientId), shortKeys_(shortKeys) {}
+
+        bool Complete() const { return done_ && hasChannel_ && hasUser_; }
+
+        bool null() { return field_ == Field::Ignored; }
+        bool boolean(bool) { return field_ == Field::Ignored; }
+        bool number_integer(json::number_integer_t value) { return Number(value); }
+        bool number_unsigned(json::number_unsigned_t value) { return Number(value); }
+        bool number_float(json::number_float_t value, const json::string_t&) { return Number(value); }
+        bool binary(json::binary_t&) { return field_ == Field::Ignored; }
+
+        bool string(json::string_t& value)
+        {
+            switch (field_) {
+            case Field::Platform: message_.platform = std::move(value); return true;
+            case Field::Channel: message_.channel = std::move(value); return true;
+            case Field::User: message_.user = std::move(value); return true;
+            case Field::Text: message_.text = std::move(value); return true;
+            case Field::ClientId: clientId_ = std::move(value); return true;
+            case Field::Ignored: return true;
+            default: return false;
+            }
+        }
+
+        bool start_object(std::size_t)
+        {
+            if (started_) return false; // Nested objects mean another frame type
+            started_ = true;
+            return true;
+        }
+
+        bool key(json::string_t& key)
+        {
+            const std::string_view name = shortKeys_ ? FullKey(key) : std::string_view(key);
+            if (name == "type" || name == "error") return false;
+
+            field_ = name == "platform" ? Field::Platform
+                : name == "channel" ? Field::Channel
+                : name == "user" ? Field::User
+                : name == "text" ? Field::Text
+                : name == "highest_rank" ? Field::HighestRank
+                : name == "seq" ? Field::Seq
+                : name == "client_id" ? Field::ClientId
+                : Field::Ignored;
+            hasChannel_ |= field_ == Field::Channel;
+            hasUser_ |= field_ == Field::User;
+            return true;
+        }
+
+        bool end_object()
+        {
+            done_ = true;
+            return true;
+        }
+
+        bool start_array(std::size_t) { return false; }
+        bool end_array() { return false; }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+    private:
+        enum class Field { Ignored, Platform, Channel, User, Text, HighestRank, Seq, ClientId };
+
+        ChatMessage& message_;
+        std::string& clientId_;
+        bool shortKeys_;
+        Field field_ = Field::Ignored;
+        bool started_ = false;
+        bool done_ = false;
+        bool hasChannel_ = false;
+        bool hasUser_ = false;
+
+        template <typename T>
+        bool Number(T value)
+        {
+            switch (field_) {
+            case Field::HighestRank: message_.highestRank = static_cast<int>(value); return true;
+            case Field::Seq: message_.seq = static_cast<uint64_t>(value); return true;
+            case Field::Ignored: return true;
+            default: return false;
+            }
+        }
+    };
+}
+
+bool WireFormat::IsBinary(std::string_view protocol)
+{
+    return protocol == MSGPACK_PROTOCOL;
+}
+
+nlohmann::json WireFormat::Decode(std::string_view frame, bool binary)
+{
+    if (!binary) return nlohmann::json::parse(frame);
+
+    nlohmann::json decoded = nlohmann::json::from_msgpack(frame.begin(), frame.end());
+    ExpandKeys(decoded);
+    return decoded;
+}
+
+std::string WireFormat::Encode(const nlohmann::json& payload, std::string_view protocol)
+{
+    if (!IsBinary(protocol) || !payload.is_object()) return payload.dump();
+
+    nlohmann::json compact = nlohmann::json::object();
+    for (const auto& [key, value] : payload.items()) {
+        compact[std::string(ShortKey(key))] = value;
+    }
+    std::string frame;
+    nlohmann::json::to_msgpack(compact, frame);
+    return frame;
+}
+
+ChatMessage WireFormat::ParseChatMessage(const nlohmann::json& payload)
+{
+    ChatMessage message;
+    message.platform = payload.value("platform", "");
+    message.channel = payload.value("channel", "");
+    message.user = payload.value("user", "???");
+    message.text = payload.value("text", "");
+    message.highestRank = payload.value("highest_rank", -1);
+    message.seq = payload.value("seq", uint64_t{ 0 });
+    return message;
+}
+
+bool WireFormat::DecodeChatMessage(std::string_view frame, bool binary, ChatMessage& message, std::string& clientId)
+{
+    message = ChatMessage{};
+    clientId.clear();
+
+    ChatMessageSax handler(message, clientId, binary);
+    const auto format = binary ? nlohmann::json::input_format_t::msgpack : nlohmann::json::input_format_t::json;
+    return nlohmann::json::sax_parse(frame.begin(), frame.end(), &handler, format) && handler.Complete();
+}
+
+void WireFormat::ExpandKeys(nlohmann::json& object)
+{
+    if (!object.is_object()) return;
+
+    nlohmann::json expanded = nlohmann::json::object();
+    for (auto& [key, value] : object.items()) {
+        expanded[std::string(FullKey(key))] = std::move(value);
+    }
+    object = std::move(expanded);
+}
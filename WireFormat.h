@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ChatMessage.h"
+#include "json.hpp"
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Encoding of the frames exchanged with the server.
+ *
+ * Without a negotiated subprotocol every frame is JSON text. A server that selects
+ * MSGPACK_PROTOCOL sends and receives MessagePack frames whose well-known keys are
+ * shortened to one or two characters ("user" -> "u"); unknown keys pass through
+ * unchanged. Incoming frames are decoded by frame type, so a server may mix text
+ * frames into a binary session.
+ */
+namespace WireFormat
+{
+    // Offered in this order. JSON comes first so a server that simply echoes the first
+    // offer keeps speaking text; a server that knows MessagePack picks it explicitly.
+    constexpr std::string_view JSON_PROTOCOL = "globalchat.json.v1";
+    constexpr std::string_view MSGPACK_PROTOCOL = "globalchat.msgpack.v1";
+
+    bool IsBinary(std::string_view protocol);
+
+    // Parses a frame. Binary frames get their top-level keys expanded; nested messages
+    // (the entries of all_histories) go through ExpandKeys as they are read.
+    nlohmann::json Decode(std::string_view frame, bool binary);
+    std::string Encode(const nlohmann::json& payload, std::string_view protocol);
+
+    // Renames shortened keys of one object back to their JSON names. No-op for JSON input.
+    void ExpandKeys(nlohmann::json& object);
+
+    // Extracts the stored fields of a chat message from a decoded payload.
+    ChatMessage ParseChatMessage(const nlohmann::json& payload);
+
+    // Single-pass decoder for the common frame, a lone chat message, straight into the
+    // typed record without building a DOM. Returns false for anything else (other frame
+    // types, unexpected field types, malformed input); such frames go through Decode.
+    bool DecodeChatMessage(std::string_view frame, bool binary, ChatMessage& message, std::string& clientId);
+}
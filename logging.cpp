@@ -0,0 +1,424 @@
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace
+{
+	using logging_detail::LogRecord;
+
+	constexpr size_t RING_CAPACITY = 512;         // Power of two
+	constexpr size_t MAX_RECORDS_PER_FLUSH = 128; // Bounds the console work done in one game tick
+	constexpr size_t RATE_LIMIT_SITES = 128;      // Power of two
+	constexpr size_t RATE_LIMIT_PROBES = 8;
+	constexpr uint32_t RATE_LIMIT_PER_WINDOW = 20;
+	constexpr int64_t RATE_LIMIT_WINDOW_MS = 1000;
+
+	constexpr auto RELAXED = std::memory_order_relaxed;
+
+	int64_t NowMs()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/*
+	 * Bounded multi-producer ring (Vyukov). Each cell's sequence tells producers and the single
+	 * consumer whose turn it is, so neither side takes a lock or allocates.
+	 */
+	class LogRing
+	{
+	public:
+		LogRing()
+		{
+			for (size_t i = 0; i < RING_CAPACITY; ++i) cells_[i].sequence.store(i, RELAXED);
+		}
+
+		LogRecord* Reserve()
+		{
+			size_t position = enqueuePos_.load(RELAXED);
+			for (;;)
+			{
+				Cell& cell = cells_[position & (RING_CAPACITY - 1)];
+				const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+				if (diff == 0)
+				{
+					if (enqueuePos_.compare_exchange_weak(position, position + 1, RELAXED))
+					{
+						cell.record.position = position;
+						return &cell.record;
+					}
+				}
+				else if (diff < 0)
+				{
+					return nullptr; // Full
+				}
+				else
+				{
+					position = enqueuePos_.load(RELAXED);
+				}
+			}
+		}
+
+		void Publish(LogRecord* record)
+		{
+			Cell& cell = cells_[record->position & (RING_CAPACITY - 1)];
+			cell.sequence.store(record->position + 1, std::memory_order_release);
+		}
+
+		// Consumer side; only one thread may call these.
+		LogRecord* Front()
+		{
+			Cell& cell = cells_[dequeuePos_ & (RING_CAPACITY - 1)];
+			return cell.sequence.load(std::memory_order_acquire) == dequeuePos_ + 1 ? &cell.record : nullptr;
+		}
+
+		void Pop()
+		{
+			Cell& cell = cells_[dequeuePos_ & (RING_CAPACITY - 1)];
+			cell.sequence.store(dequeuePos_ + RING_CAPACITY, std::memory_order_release);
+			++dequeuePos_;
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence{ 0 };
+			LogRecord record;
+		};
+
+		std::unique_ptr<Cell[]> cells_ = std::make_unique<Cell[]>(RING_CAPACITY);
+		alignas(64) std::atomic<size_t> enqueuePos_{ 0 };
+		alignas(64) size_t dequeuePos_ = 0;
+	};
+
+	/*
+	 * Per-call-site rate limit, keyed by the format string pointer. The window bookkeeping is
+	 * approximate under contention, which is fine for deciding whether a line is worth printing.
+	 */
+	struct RateLimitSite
+	{
+		std::atomic<const char*> format{ nullptr };
+		std::atomic<int64_t> windowStart{ 0 };
+		std::atomic<uint32_t> count{ 0 };
+		std::atomic<uint32_t> suppressed{ 0 };
+	};
+
+	struct LogState
+	{
+		LogRing ring;
+		std::array<RateLimitSite, RATE_LIMIT_SITES> sites;
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+
+	LogState& State()
+	{
+		static LogState state;
+		return state;
+	}
+
+	RateLimitSite* FindSite(const char* format)
+	{
+		auto& sites = State().sites;
+		const size_t start = (reinterpret_cast<uintptr_t>(format) >> 3) * 0x9E3779B97F4A7C15ull >> 32;
+		for (size_t probe = 0; probe < RATE_LIMIT_PROBES; ++probe)
+		{
+			RateLimitSite& site = sites[(start + probe) & (RATE_LIMIT_SITES - 1)];
+			const char* current = site.format.load(std::memory_order_acquire);
+			if (current == format) return &site;
+			if (current == nullptr)
+			{
+				if (site.format.compare_exchange_strong(current, format, std::memory_order_acq_rel) || current == format)
+				{
+					return &site;
+				}
+			}
+		}
+		return nullptr; // Table crowded; this site is not limited
+	}
+
+	bool AllowRecord(const char* format)
+	{
+		RateLimitSite* site = FindSite(format);
+		if (!site) return true;
+
+		const int64_t now = NowMs();
+		int64_t windowStart = site->windowStart.load(RELAXED);
+		if (now - windowStart >= RATE_LIMIT_WINDOW_MS && site->windowStart.compare_exchange_strong(windowStart, now, RELAXED))
+		{
+			site->count.store(0, RELAXED);
+		}
+
+		if (site->count.fetch_add(1, RELAXED) < RATE_LIMIT_PER_WINDOW) return true;
+		site->suppressed.fetch_add(1, RELAXED);
+		return false;
+	}
+
+	template <size_t... I>
+	std::string FormatArgs(const LogRecord& record, std::index_sequence<I...>)
+	{
+		// std::format ignores arguments the format string does not reference, so all slots are passed.
+		return std::vformat(record.format, std::make_format_args(record.args[I]...));
+	}
+
+	std::string FormatEvent(const LogRecord& record)
+	{
+		std::string text(record.format);
+		for (size_t i = 0; i < logging_detail::MAX_ARGS && !record.keys[i].empty(); ++i)
+		{
+			std::format_to(std::back_inserter(text), " {}={}", record.keys[i], record.args[i]);
+		}
+		return text;
+	}
+
+	std::string FormatRecord(const LogRecord& record)
+	{
+		std::string text;
+		try
+		{
+			text = record.structured ? FormatEvent(record) : FormatArgs(record, std::make_index_sequence<logging_detail::MAX_ARGS>{});
+		}
+		catch (const std::format_error& e)
+		{
+			text = std::format("[log format error: {}] {}", e.what(), record.format);
+		}
+
+		switch (record.level)
+		{
+		case LogLevel::Debug:
+			return std::format("{} [{} ({}:{})]", text, record.loc.function_name(), record.loc.file_name(), record.loc.line());
+		case LogLevel::Warning:
+			return "[warning] " + text;
+		case LogLevel::Error:
+			return "[error] " + text;
+		default:
+			return text;
+		}
+	}
+
+	/*
+	 * Binary log file: "GCLG", u16 version, then one record per entry:
+	 *   u32 payload length, i64 timestamp (ns since epoch), u8 level, u8 structured, u32 line,
+	 *   u16 + source file, u16 + format or event name, u8 value count, then per value:
+	 *   u8 + key (empty for positional args), u8 type (LogValue index), and either 8 raw bytes
+	 *   (numbers, bool, char, pointer) or u16 + bytes (strings).
+	 * Values are written as captured; nothing is formatted. Little-endian, as on the only target.
+	 */
+	class BinaryLog
+	{
+	public:
+		static constexpr uint16_t VERSION = 1;
+
+		bool Open(const std::filesystem::path& file)
+		{
+			Close();
+			std::error_code ec;
+			std::filesystem::create_directories(file.parent_path(), ec);
+			stream_.open(file, std::ios::binary | std::ios::trunc);
+			if (!stream_) return false;
+
+			stream_.write("GCLG", 4);
+			stream_.write(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+			return static_cast<bool>(stream_);
+		}
+
+		void Close()
+		{
+			if (stream_.is_open()) stream_.close();
+		}
+
+		bool IsOpen() const { return stream_.is_open(); }
+
+		void Write(const LogRecord& record)
+		{
+			buffer_.clear();
+			Put(record.timestampNs);
+			Put(static_cast<uint8_t>(record.level));
+			Put(static_cast<uint8_t>(record.structured));
+			Put(static_cast<uint32_t>(record.loc.line()));
+			PutString<uint16_t>(record.loc.file_name());
+			PutString<uint16_t>(record.format);
+
+			uint8_t count = 0;
+			while (count < logging_detail::MAX_ARGS && record.args[count].value.index() != 0) ++count;
+			Put(count);
+			for (uint8_t i = 0; i < count; ++i)
+			{
+				PutString<uint8_t>(record.keys[i]);
+				Put(static_cast<uint8_t>(record.args[i].value.index()));
+				std::visit([this](const auto& value) {
+					using T = std::decay_t<decltype(value)>;
+					if constexpr (std::is_same_v<T, std::string_view>)
+						PutString<uint16_t>(value);
+					else if constexpr (!std::is_same_v<T, std::monostate>)
+						PutRaw8(value);
+				}, record.args[i].value);
+			}
+
+			const auto length = static_cast<uint32_t>(buffer_.size());
+			stream_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+			stream_.write(buffer_.data(), buffer_.size());
+		}
+
+		void Flush()
+		{
+			if (stream_.is_open()) stream_.flush();
+		}
+
+	private:
+		std::ofstream stream_;
+		std::string buffer_;
+
+		template <typename T>
+		void Put(T value)
+		{
+			buffer_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		template <typename T>
+		void PutRaw8(T value)
+		{
+			char raw[8] = {};
+			std::memcpy(raw, &value, sizeof(value));
+			buffer_.append(raw, sizeof(raw));
+		}
+
+		template <typename Length>
+		void PutString(std::string_view value)
+		{
+			const auto length = static_cast<Length>(std::min<size_t>(value.size(), std::numeric_limits<Length>::max()));
+			Put(length);
+			buffer_.append(value.data(), length);
+		}
+	};
+
+	BinaryLog& GetBinaryLog()
+	{
+		static BinaryLog binaryLog;
+		return binaryLog;
+	}
+
+	void ReportSuppressed()
+	{
+		const int64_t now = NowMs();
+		for (RateLimitSite& site : State().sites)
+		{
+			const char* format = site.format.load(std::memory_order_acquire);
+			if (!format || site.suppressed.load(RELAXED) == 0) continue;
+			// Report once the window that suppressed them has closed, not on every tick of a storm.
+			if (now - site.windowStart.load(RELAXED) < RATE_LIMIT_WINDOW_MS) continue;
+
+			const uint32_t suppressed = site.suppressed.exchange(0, RELAXED);
+			if (suppressed > 0)
+			{
+				_globalCvarManager->log(std::format("[log] suppressed {} repeats of \"{}\"", suppressed, format));
+			}
+		}
+	}
+}
+
+std::string_view logging_detail::LogRecord::CopyText(std::string_view value)
+{
+	const size_t available = TEXT_CAPACITY - textUsed;
+	if (value.size() > available)
+	{
+		constexpr std::string_view ellipsis = "...";
+		const size_t keep = available > ellipsis.size() ? available - ellipsis.size() : 0;
+		std::copy_n(value.data(), keep, text + textUsed);
+		std::copy_n(ellipsis.data(), available - keep, text + textUsed + keep);
+	}
+	else
+	{
+		std::copy_n(value.data(), value.size(), text + textUsed);
+	}
+
+	const size_t length = value.size() > available ? available : value.size();
+	std::string_view copied(text + textUsed, length);
+	textUsed += length;
+	return copied;
+}
+
+logging_detail::LogRecord* logging_detail::BeginRecord(LogLevel level, std::string_view format, const std::source_location& loc, bool rateLimited)
+{
+	if (rateLimited && !AllowRecord(format.data())) return nullptr;
+
+	LogRecord* record = State().ring.Reserve();
+	if (!record)
+	{
+		State().dropped.fetch_add(1, RELAXED);
+		return nullptr;
+	}
+
+	record->level = level;
+	record->structured = false;
+	record->timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record->format = format;
+	record->loc = loc;
+	record->args.fill({});
+	record->keys.fill({});
+	record->textUsed = 0;
+	return record;
+}
+
+void logging_detail::CommitRecord(LogRecord* record)
+{
+	State().ring.Publish(record);
+}
+
+void FlushLog()
+{
+	if (!_globalCvarManager) return;
+
+	LogState& state = State();
+	BinaryLog& binaryLog = GetBinaryLog();
+	for (size_t i = 0; i < MAX_RECORDS_PER_FLUSH; ++i)
+	{
+		LogRecord* record = state.ring.Front();
+		if (!record) break;
+
+		_globalCvarManager->log(FormatRecord(*record));
+		if (binaryLog.IsOpen()) binaryLog.Write(*record);
+		state.ring.Pop();
+	}
+	binaryLog.Flush();
+
+	if (const uint64_t dropped = state.dropped.exchange(0, RELAXED))
+	{
+		_globalCvarManager->log(std::format("[log] dropped {} messages, log queue full", dropped));
+	}
+	ReportSuppressed();
+}
+
+std::format_context::iterator std::formatter<logging_detail::LogValue>::format(const logging_detail::LogValue& value, std::format_context& ctx) const
+{
+	// Re-apply the call site's format spec to the captured value.
+	char pattern[48] = "{:";
+	const size_t specLength = spec.size() < sizeof(pattern) - 4 ? spec.size() : sizeof(pattern) - 4;
+	std::copy_n(spec.data(), specLength, pattern + 2);
+	pattern[2 + specLength] = '}';
+	const std::string_view fmt(pattern, specLength + 3);
+
+	return std::visit([&](const auto& captured) -> std::format_context::iterator {
+		if constexpr (std::is_same_v<std::decay_t<decltype(captured)>, std::monostate>)
+			return ctx.out();
+		else
+			return std::vformat_to(ctx.out(), fmt, std::make_format_args(captured));
+	}, value.value);
+}
+
+bool OpenBinaryLog(const std::filesystem::path& file)
+{
+	return GetBinaryLog().Open(file);
+}
+
+void CloseBinaryLog()
+{
+	GetBinaryLog().Close();
+}
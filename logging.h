@@ -4,84 +4,267 @@
 #include <source_location>
 #include <format>
 #include <memory>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <filesystem>
 
 #include "bakkesmod/wrappers/cvarmanagerwrapper.h"
 
 extern std::shared_ptr<CVarManagerWrapper> _globalCvarManager;
-constexpr bool DEBUG_LOG = false;
+
+enum class LogLevel : uint8_t
+{
+	Debug,
+	Info,
+	Warning,
+	Error,
+};
+
+// Records below this level are compiled out at the call site, arguments included.
+#ifdef _DEBUG
+constexpr LogLevel MIN_LOG_LEVEL = LogLevel::Debug;
+#else
+constexpr LogLevel MIN_LOG_LEVEL = LogLevel::Info;
+#endif
+
+template <LogLevel Level>
+constexpr bool LOG_ENABLED = Level >= MIN_LOG_LEVEL;
 
 
+// Format string checked against the argument types at compile time, plus the call site.
+template <typename... Args>
 struct FormatString
 {
-	std::string_view str;
-	std::source_location loc{};
+	std::format_string<Args...> str;
+	std::source_location loc;
 
-	FormatString(const char* str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
+	template <typename T> requires std::is_convertible_v<const T&, std::string_view>
+	consteval FormatString(const T& str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
 	{
 	}
+};
 
-	FormatString(const std::string&& str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
+template <typename... Args>
+struct FormatWstring
+{
+	std::wformat_string<Args...> str;
+	std::source_location loc;
+
+	template <typename T> requires std::is_convertible_v<const T&, std::wstring_view>
+	consteval FormatWstring(const T& str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
 	{
 	}
+};
+
+// Key/value pair for LOGEVENT. Keys are kept by pointer, so they must be string literals.
+template <typename T>
+struct LogField
+{
+	std::string_view key;
+	const T& value;
+};
+
+// Event name for LOGEVENT, captured together with the call site.
+struct EventName
+{
+	std::string_view name;
+	std::source_location loc;
 
-	[[nodiscard]] std::string GetLocation() const
+	consteval EventName(const char* name, const std::source_location& loc = std::source_location::current()) : name(name), loc(loc)
 	{
-		return std::format("[{} ({}:{})]", loc.function_name(), loc.file_name(), loc.line());
 	}
 };
 
-struct FormatWstring
+template <typename T>
+LogField<T> Field(std::string_view key, const T& value)
+{
+	return { key, value };
+}
+
+
+/*
+ * Narrow log calls do not format or touch the console at the call site. The arguments are captured
+ * by value into a slot of a fixed-size lock-free ring, and FlushLog() hands the queued records in a
+ * batch to the console (formatted) and, when open, to the binary log file (raw values, no formatting)
+ * on the game thread. Format strings and field keys are kept by pointer; both are literals.
+ */
+namespace logging_detail
 {
-	std::wstring_view str;
-	std::source_location loc{};
+	constexpr size_t MAX_ARGS = 8;
+	constexpr size_t TEXT_CAPACITY = 512; // Shared by all string arguments of one record; longer text is truncated
 
-	FormatWstring(const wchar_t* str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
+	// One captured argument. A struct of our own, so that std::formatter may be specialized for it.
+	struct LogValue
 	{
+		std::variant<std::monostate, int64_t, uint64_t, double, bool, char, std::string_view, const void*> value;
+	};
+
+	struct LogRecord
+	{
+		LogLevel level = LogLevel::Info;
+		bool structured = false; // format is an event name and keys[] name the args
+		int64_t timestampNs = 0; // system_clock
+		std::string_view format;
+		std::source_location loc{};
+		std::array<LogValue, MAX_ARGS> args{};
+		std::array<std::string_view, MAX_ARGS> keys{};
+		size_t textUsed = 0;
+		char text[TEXT_CAPACITY];
+		size_t position = 0; // Ring position, owned by the queue
+
+		std::string_view CopyText(std::string_view value);
+	};
+
+	// Reserves a ring slot, or returns nullptr when the call site is rate limited or the ring is full.
+	LogRecord* BeginRecord(LogLevel level, std::string_view format, const std::source_location& loc, bool rateLimited = true);
+	void CommitRecord(LogRecord* record);
+
+	template <typename T>
+	LogValue Capture(LogRecord& record, const T& arg)
+	{
+		if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>)
+			return { arg };
+		else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+			return { static_cast<int64_t>(arg) };
+		else if constexpr (std::is_integral_v<T>)
+			return { static_cast<uint64_t>(arg) };
+		else if constexpr (std::is_floating_point_v<T>)
+			return { static_cast<double>(arg) };
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+			return { record.CopyText(std::string_view(arg)) };
+		else if constexpr (std::is_pointer_v<T>)
+			return { static_cast<const void*>(arg) };
+		else // No cheap deferred form; format this one argument now
+			return { record.CopyText(std::format("{}", arg)) };
 	}
 
-	FormatWstring(const std::wstring&& str, const std::source_location& loc = std::source_location::current()) : str(str), loc(loc)
+	template <typename... Args>
+	void Enqueue(LogLevel level, bool rateLimited, std::string_view format, const std::source_location& loc, const Args&... args)
 	{
+		static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+
+		LogRecord* record = BeginRecord(level, format, loc, rateLimited);
+		if (!record) return;
+
+		size_t i = 0;
+		((record->args[i++] = Capture(*record, args)), ...);
+		CommitRecord(record);
 	}
 
-	[[nodiscard]] std::wstring GetLocation() const
+	template <typename... T>
+	void EnqueueEvent(LogLevel level, std::string_view event, const std::source_location& loc, const LogField<T>&... fields)
 	{
-		auto basic_string = std::format("[{} ({}:{})]", loc.function_name(), loc.file_name(), loc.line());
-		return std::wstring(basic_string.begin(), basic_string.end());
+		static_assert(sizeof...(T) <= MAX_ARGS, "too many log fields");
+
+		LogRecord* record = BeginRecord(level, event, loc);
+		if (!record) return;
+
+		record->structured = true;
+		size_t i = 0;
+		((record->keys[i] = fields.key, record->args[i++] = Capture(*record, fields.value)), ...);
+		CommitRecord(record);
 	}
-};
+}
+
+// Formats and prints everything queued so far. Call from the game thread only.
+void FlushLog();
+
+// Also write every flushed record, unformatted, to a binary file. Game thread only.
+bool OpenBinaryLog(const std::filesystem::path& file);
+void CloseBinaryLog();
 
 
 template <typename... Args>
-void LOG(std::string_view format_str, Args&&... args)
+void LOG(FormatString<std::type_identity_t<Args>...> format_str, Args&&... args)
 {
-	_globalCvarManager->log(std::vformat(format_str, std::make_format_args(args...)));
+	if constexpr (LOG_ENABLED<LogLevel::Info>)
+	{
+		logging_detail::Enqueue(LogLevel::Info, true, format_str.str.get(), format_str.loc, args...);
+	}
 }
 
 template <typename... Args>
-void LOG(std::wstring_view format_str, Args&&... args)
+void WARNLOG(FormatString<std::type_identity_t<Args>...> format_str, Args&&... args)
 {
-	_globalCvarManager->log(std::vformat(format_str, std::make_wformat_args(args...)));
+	if constexpr (LOG_ENABLED<LogLevel::Warning>)
+	{
+		logging_detail::Enqueue(LogLevel::Warning, true, format_str.str.get(), format_str.loc, args...);
+	}
 }
 
+template <typename... Args>
+void ERRORLOG(FormatString<std::type_identity_t<Args>...> format_str, Args&&... args)
+{
+	if constexpr (LOG_ENABLED<LogLevel::Error>)
+	{
+		logging_detail::Enqueue(LogLevel::Error, true, format_str.str.get(), format_str.loc, args...);
+	}
+}
 
 template <typename... Args>
-void DEBUGLOG(const FormatString& format_str, Args&&... args)
+void DEBUGLOG(FormatString<std::type_identity_t<Args>...> format_str, Args&&... args)
 {
-	if constexpr (DEBUG_LOG)
+	if constexpr (LOG_ENABLED<LogLevel::Debug>)
 	{
-		auto text = std::vformat(format_str.str, std::make_format_args(args...));
-		auto location = format_str.GetLocation();
-		_globalCvarManager->log(std::format("{} {}", text, location));
+		logging_detail::Enqueue(LogLevel::Debug, true, format_str.str.get(), format_str.loc, args...);
 	}
 }
 
+// Output of an explicit console command. Not rate limited: the user asked for every line.
 template <typename... Args>
-void DEBUGLOG(const FormatWstring& format_str, Args&&... args)
+void CONSOLELOG(FormatString<std::type_identity_t<Args>...> format_str, Args&&... args)
+{
+	logging_detail::Enqueue(LogLevel::Info, false, format_str.str.get(), format_str.loc, args...);
+}
+
+// Structured record: an event name plus Field("key", value) pairs, e.g.
+// LOGEVENT<LogLevel::Info>("ws_connected", Field("attempt", 2), Field("total_ms", 180));
+template <LogLevel Level, typename... T>
+void LOGEVENT(const EventName& event, const LogField<T>&... fields)
 {
-	if constexpr (DEBUG_LOG)
+	if constexpr (LOG_ENABLED<Level>)
 	{
-		auto text = std::vformat(format_str.str, std::make_wformat_args(args...));
-		auto location = format_str.GetLocation();
-		_globalCvarManager->log(std::format(L"{} {}", text, location));
+		logging_detail::EnqueueEvent(Level, event.name, event.loc, fields...);
 	}
 }
+
+// Wide-string variants are rare and format synchronously.
+template <typename... Args>
+void LOG(FormatWstring<std::type_identity_t<Args>...> format_str, Args&&... args)
+{
+	if constexpr (LOG_ENABLED<LogLevel::Info>)
+	{
+		_globalCvarManager->log(std::format(format_str.str, std::forward<Args>(args)...));
+	}
+}
+
+template <typename... Args>
+void DEBUGLOG(FormatWstring<std::type_identity_t<Args>...> format_str, Args&&... args)
+{
+	if constexpr (LOG_ENABLED<LogLevel::Debug>)
+	{
+		const auto& loc = format_str.loc;
+		auto location = std::format("[{} ({}:{})]", loc.function_name(), loc.file_name(), loc.line());
+		_globalCvarManager->log(std::format(L"{} {}", std::format(format_str.str, std::forward<Args>(args)...),
+			std::wstring(location.begin(), location.end())));
+	}
+}
+
+template <>
+struct std::formatter<logging_detail::LogValue>
+{
+	std::string_view spec;
+
+	constexpr auto parse(std::format_parse_context& ctx)
+	{
+		auto it = ctx.begin();
+		while (it != ctx.end() && *it != '}') ++it;
+		spec = std::string_view(ctx.begin(), it);
+		return it;
+	}
+
+	std::format_context::iterator format(const logging_detail::LogValue& value, std::format_context& ctx) const;
+};
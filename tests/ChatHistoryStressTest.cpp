@@ -0,0 +1,92 @@
+// Readers on the published snapshots racing a writer that holds the history lock, the
+// way the render and network threads share ChatHistory. Most useful built with
+// -DGLOBALCHAT_TSAN=ON, where ThreadSanitizer reports any access that skips the lock.
+#include "Check.h"
+#include "ChatHistory.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    constexpr size_t CAPACITY = 150;
+    constexpr int MESSAGES = 50000;
+
+    ChatHistory history(CAPACITY);
+    std::mutex historyMutex;
+    std::atomic<bool> done{ false };
+
+    std::thread writer([&]() {
+        for (int i = 0; i < MESSAGES; ++i)
+        {
+            ChatMessage message;
+            message.seq = static_cast<uint64_t>(i) + 1;
+            message.channel = "channel" + std::to_string(i % 8);
+            message.user = "user" + std::to_string(i % 13);
+            message.text = "hello world " + std::to_string(i);
+
+            std::lock_guard<std::mutex> lock(historyMutex);
+            const ChatMessage* stored = history.Append(std::move(message));
+            const uint64_t id = stored ? stored->id : 0; // SetDelivery swaps in a copy
+            if (i % 7 == 0 && stored) history.SetDelivery(id, DeliveryState::Failed);
+            if (i % 11 == 0 && stored) history.Remove(id);
+            if (i % 2500 == 0)
+            {
+                std::vector<ChatMessage> older(20);
+                for (auto& page : older)
+                {
+                    page.channel = "channel1";
+                    page.text = "older page";
+                }
+                history.Prepend("channel1", std::move(older));
+                history.SetChannelOrder({ "channel0", "channel1", "channel2" });
+            }
+            if (i % 5000 == 0) history.RemoveIf([](const ChatMessage& stored) { return stored.user == "user3"; });
+        }
+        done = true;
+    });
+
+    // The render thread's pattern: draw from the snapshot and rerun the search on it when the
+    // generation moved, all without the lock.
+    auto reader = [&](size_t& searches) {
+        uint64_t lastGeneration = 0;
+        while (!done)
+        {
+            const auto snapshot = history.GetSnapshot();
+            CHECK(snapshot->generation >= lastGeneration);
+            for (const auto& [name, messages] : snapshot->channels)
+            {
+                CHECK(messages->size() <= CAPACITY + 20 * (MESSAGES / 2500 + 1));
+                for (const auto& message : *messages) CHECK(message->channel == name);
+            }
+            if (snapshot->generation != lastGeneration)
+            {
+                lastGeneration = snapshot->generation;
+                const auto hits = snapshot->Search("world", 20);
+                for (size_t i = 0; i < hits.size(); ++i)
+                {
+                    CHECK(hits[i]->text.find("world") != std::string::npos);
+                    CHECK(i == 0 || hits[i - 1]->id > hits[i]->id);
+                }
+                ++searches;
+            }
+        }
+    };
+    size_t searches[2] = {};
+    std::thread readers[2] = { std::thread(reader, std::ref(searches[0])), std::thread(reader, std::ref(searches[1])) };
+
+    writer.join();
+    for (auto& thread : readers) thread.join();
+    CHECK(searches[0] > 0 && searches[1] > 0);
+
+    // Once the writer is done, the published snapshot is the writer's state.
+    std::lock_guard<std::mutex> lock(historyMutex);
+    CHECK(history.GetSnapshot()->generation == history.Generation());
+    const auto hits = history.Search("world " + std::to_string(MESSAGES - 1), 10);
+    CHECK(hits.size() == 1);
+    CHECK(history.GetSnapshot()->Search("world " + std::to_string(MESSAGES - 1), 10).size() == 1);
+    return 0;
+}
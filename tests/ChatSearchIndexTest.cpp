@@ -0,0 +1,113 @@
+#include "Check.h"
+#include "ChatSearchIndex.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string Fold(std::string text)
+    {
+        for (char& c : text)
+        {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        }
+        return text;
+    }
+
+    // Brute-force reference: every live message, scanned newest first.
+    std::vector<uint64_t> Expected(const std::map<uint64_t, ChatMessage>& live, const std::string& query, size_t maxHits)
+    {
+        std::vector<uint64_t> hits;
+        const std::string folded = Fold(query);
+        for (auto it = live.rbegin(); it != live.rend() && hits.size() < maxHits; ++it)
+        {
+            if (Fold(it->second.user + "\n" + it->second.text).find(folded) != std::string::npos) hits.push_back(it->first);
+        }
+        return hits;
+    }
+
+    ChatMessage Message(uint64_t id, std::mt19937& rng)
+    {
+        static const char* words[] = { "gg", "Nice shot", "rotate", "boost", "WHAT a save", "kickoff", "lag" };
+        ChatMessage message;
+        message.id = id;
+        message.user = "player" + std::to_string(rng() % 20);
+        message.text = std::string(words[rng() % std::size(words)]) + " " + words[rng() % std::size(words)];
+        return message;
+    }
+
+    // Appends and evictions in the history's pattern, plus out-of-order ids (scrollback pages)
+    // and random removals, checked against a brute-force scan at every step.
+    void MatchesBruteForce()
+    {
+        static const char* queries[] = { "gg", "g", "nice", "SHOT", "player1", "er1\nw", "what a", "zzz", "t r" };
+        std::mt19937 rng(7);
+        ChatSearchIndex index;
+        std::map<uint64_t, ChatMessage> live;
+        uint64_t nextId = 1'000'000;
+        uint64_t nextOlderId = nextId - 1;
+
+        for (int step = 0; step < 20000; ++step)
+        {
+            const unsigned action = rng() % 100;
+            if (action < 70 || live.empty())
+            {
+                const uint64_t id = action % 10 == 0 ? nextOlderId-- : nextId++;
+                const ChatMessage message = Message(id, rng);
+                index.Add(message);
+                live.emplace(id, message);
+            }
+            else
+            {
+                // Mostly the oldest (eviction), sometimes any message.
+                auto it = live.begin();
+                if (action >= 95) std::advance(it, rng() % live.size());
+                index.Remove(it->second);
+                live.erase(it);
+            }
+            if (live.size() > 600)
+            {
+                index.Remove(live.begin()->second);
+                live.erase(live.begin());
+            }
+
+            CHECK(index.Size() == live.size());
+            if (step % 97 == 0)
+            {
+                for (const char* query : queries)
+                {
+                    CHECK(index.Query(query, 25) == Expected(live, query, 25));
+                }
+            }
+        }
+    }
+
+    // A view handed to another thread must not see later changes.
+    void ViewIsImmutable()
+    {
+        std::mt19937 rng(11);
+        ChatSearchIndex index;
+        for (uint64_t id = 1; id <= 300; ++id) index.Add(Message(id, rng));
+
+        const auto view = index.Current();
+        const std::vector<uint64_t> before = view->Query("player", 1000);
+        CHECK(before.size() == 300);
+
+        for (uint64_t id = 1; id <= 200; ++id) index.Remove(Message(id, rng));
+        for (uint64_t id = 301; id <= 500; ++id) index.Add(Message(id, rng));
+        CHECK(index.Query("player", 1000).size() == 300);
+        CHECK(view->Query("player", 1000) == before);
+        CHECK(view->Size() == 300);
+    }
+}
+
+int main()
+{
+    MatchesBruteForce();
+    ViewIsImmutable();
+    return 0;
+}
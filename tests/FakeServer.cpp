@@ -0,0 +1,310 @@
+#include "FakeServer.h"
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <deque>
+#include <stdexcept>
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+namespace ssl = boost::asio::ssl;
+using tcp = net::ip::tcp;
+
+namespace
+{
+    struct Credentials
+    {
+        std::string certificate;
+        std::string key;
+    };
+
+    std::string WritePem(int (*write)(BIO*, void*), void* object)
+    {
+        BIO* bio = BIO_new(BIO_s_mem());
+        if (!bio || !write(bio, object)) throw std::runtime_error("PEM encoding failed");
+        char* data = nullptr;
+        const long length = BIO_get_mem_data(bio, &data);
+        std::string pem(data, static_cast<size_t>(length));
+        BIO_free(bio);
+        return pem;
+    }
+
+    // A self-signed P-256 certificate for localhost, made once per process.
+    const Credentials& GetCredentials()
+    {
+        static const Credentials credentials = [] {
+            EVP_PKEY* key = nullptr;
+            EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+            if (!keyContext || EVP_PKEY_keygen_init(keyContext) <= 0 ||
+                EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) <= 0 ||
+                EVP_PKEY_keygen(keyContext, &key) <= 0)
+            {
+                throw std::runtime_error("key generation failed");
+            }
+            EVP_PKEY_CTX_free(keyContext);
+
+            X509* cert = X509_new();
+            X509_set_version(cert, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+            X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+            X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+            X509_set_pubkey(cert, key);
+
+            X509_NAME* name = X509_get_subject_name(cert);
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+            X509_set_issuer_name(cert, name);
+
+            X509V3_CTX extensionContext;
+            X509V3_set_ctx_nodb(&extensionContext);
+            X509V3_set_ctx(&extensionContext, cert, cert, nullptr, nullptr, 0);
+            for (auto [nid, value] : { std::pair{ NID_basic_constraints, "critical,CA:TRUE" },
+                                       std::pair{ NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1" } })
+            {
+                X509_EXTENSION* extension = X509V3_EXT_conf_nid(nullptr, &extensionContext, nid, value);
+                X509_add_ext(cert, extension, -1);
+                X509_EXTENSION_free(extension);
+            }
+            if (!X509_sign(cert, key, EVP_sha256())) throw std::runtime_error("certificate signing failed");
+
+            Credentials pem;
+            pem.certificate = WritePem([](BIO* bio, void* x) { return PEM_write_bio_X509(bio, static_cast<X509*>(x)); }, cert);
+            pem.key = WritePem([](BIO* bio, void* k) {
+                return PEM_write_bio_PrivateKey(bio, static_cast<EVP_PKEY*>(k), nullptr, nullptr, 0, nullptr, nullptr);
+            }, key);
+            X509_free(cert);
+            EVP_PKEY_free(key);
+            return pem;
+        }();
+        return credentials;
+    }
+}
+
+/**
+ * @brief One accepted connection. Everything runs on the server thread.
+ */
+class FakeServer::Session : public std::enable_shared_from_this<Session>
+{
+public:
+    Session(FakeServer& server, tcp::socket socket) : server_(server), ws_(std::move(socket), server.ctx_)
+    {
+    }
+
+    void Start()
+    {
+        ws_.next_layer().async_handshake(ssl::stream_base::server, [self = shared_from_this()](beast::error_code ec) {
+            if (ec) return self->Close();
+            // The upgrade request is read first to see which subprotocols it offers.
+            beast::http::async_read(self->ws_.next_layer(), self->buffer_, self->request_, [self](beast::error_code ec, size_t) {
+                if (ec) return self->Close();
+                self->Accept();
+            });
+        });
+    }
+
+    // Resumes reading after a stall.
+    void Read()
+    {
+        if (reading_ || closed_) return;
+        if (server_.stalled_) return;
+
+        reading_ = true;
+        ws_.async_read(buffer_, [self = shared_from_this()](beast::error_code ec, size_t) {
+            self->reading_ = false;
+            if (ec) return self->Close();
+
+            Frame frame{ beast::buffers_to_string(self->buffer_.data()), self->ws_.got_binary() };
+            self->buffer_.consume(self->buffer_.size());
+            // Recorded before the echo goes out, so a client that saw the echo sees it recorded.
+            self->server_.OnFrame(frame);
+            if (self->server_.options_.echo) self->Write(std::move(frame.data), !frame.binary);
+            self->Read();
+        });
+    }
+
+    bool Closed() const { return closed_; }
+
+    void Close()
+    {
+        closed_ = true;
+        beast::error_code ignored;
+        beast::get_lowest_layer(ws_).close(ignored);
+    }
+
+private:
+    struct Outgoing
+    {
+        std::string data;
+        bool text;
+    };
+
+    FakeServer& server_;
+    websocket::stream<beast::ssl_stream<tcp::socket>> ws_;
+    beast::flat_buffer buffer_;
+    beast::http::request<beast::http::string_body> request_;
+    std::deque<Outgoing> writes_;
+    bool reading_ = false;
+    bool closed_ = false;
+
+    void Accept()
+    {
+        const std::string& wanted = server_.options_.subprotocol;
+        bool offered = false;
+        const auto header = request_[beast::http::field::sec_websocket_protocol];
+        for (size_t start = 0; !wanted.empty() && start < header.size() && !offered;)
+        {
+            size_t end = header.find(',', start);
+            if (end == beast::string_view::npos) end = header.size();
+            beast::string_view token = header.substr(start, end - start);
+            while (!token.empty() && token.front() == ' ') token.remove_prefix(1);
+            while (!token.empty() && token.back() == ' ') token.remove_suffix(1);
+            offered = token == wanted;
+            start = end + 1;
+        }
+        if (offered)
+        {
+            ws_.set_option(websocket::stream_base::decorator([wanted](websocket::response_type& response) {
+                response.set(beast::http::field::sec_websocket_protocol, wanted);
+            }));
+        }
+
+        ws_.async_accept(request_, [self = shared_from_this()](beast::error_code ec) {
+            if (ec) return self->Close();
+            self->server_.OnHandshake(SSL_session_reused(self->ws_.next_layer().native_handle()) == 1);
+            for (const auto& frame : self->server_.options_.greeting) self->Write(frame, true);
+            self->Read();
+        });
+    }
+
+    void Write(std::string data, bool text)
+    {
+        writes_.push_back({ std::move(data), text });
+        if (writes_.size() == 1) WriteFront();
+    }
+
+    void WriteFront()
+    {
+        ws_.text(writes_.front().text);
+        ws_.async_write(net::buffer(writes_.front().data), [self = shared_from_this()](beast::error_code ec, size_t) {
+            if (ec) return self->Close();
+            self->writes_.pop_front();
+            if (!self->writes_.empty()) self->WriteFront();
+        });
+    }
+};
+
+FakeServer::FakeServer() : FakeServer(Options{})
+{
+}
+
+FakeServer::FakeServer(Options options, uint16_t port)
+    : ctx_(ssl::context::tls_server),
+      acceptor_(ioc_, tcp::endpoint(net::ip::make_address("127.0.0.1"), port)),
+      options_(std::move(options))
+{
+    const Credentials& credentials = GetCredentials();
+    ctx_.use_certificate_chain(net::buffer(credentials.certificate));
+    ctx_.use_private_key(net::buffer(credentials.key), ssl::context::pem);
+    // Lets clients resume sessions across reconnects, as the real server does.
+    static const unsigned char sessionContext[] = "globalchat-tests";
+    SSL_CTX_set_session_id_context(ctx_.native_handle(), sessionContext, sizeof(sessionContext) - 1);
+
+    port_ = acceptor_.local_endpoint().port();
+    Accept();
+    thread_ = std::thread([this] { ioc_.run(); });
+}
+
+FakeServer::~FakeServer()
+{
+    net::post(ioc_, [this] {
+        beast::error_code ignored;
+        acceptor_.close(ignored);
+        for (const auto& session : sessions_) session->Close();
+        sessions_.clear();
+    });
+    thread_.join();
+}
+
+const std::string& FakeServer::Certificate()
+{
+    return GetCredentials().certificate;
+}
+
+void FakeServer::Accept()
+{
+    acceptor_.async_accept([this](beast::error_code ec, tcp::socket socket) {
+        if (ec) return;
+        auto session = std::make_shared<Session>(*this, std::move(socket));
+        std::erase_if(sessions_, [](const auto& open) { return open->Closed(); });
+        sessions_.push_back(session);
+        session->Start();
+        Accept();
+    });
+}
+
+void FakeServer::DropAll()
+{
+    net::post(ioc_, [this] {
+        for (const auto& session : sessions_) session->Close();
+        sessions_.clear();
+    });
+}
+
+void FakeServer::SetStalled(bool stalled)
+{
+    net::post(ioc_, [this, stalled] {
+        stalled_ = stalled;
+        if (stalled) return;
+        for (const auto& session : sessions_) session->Read();
+    });
+}
+
+void FakeServer::OnHandshake(bool resumed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++connections_;
+    if (resumed) ++resumed_;
+}
+
+void FakeServer::OnFrame(Frame frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    received_.push_back(std::move(frame));
+}
+
+std::vector<std::string> FakeServer::Received() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> data;
+    data.reserve(received_.size());
+    for (const Frame& frame : received_) data.push_back(frame.data);
+    return data;
+}
+
+std::vector<FakeServer::Frame> FakeServer::ReceivedFrames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return received_;
+}
+
+int FakeServer::Connections() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_;
+}
+
+int FakeServer::ResumedConnections() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resumed_;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Stand-in for the chat server: a Boost.Beast TLS websocket server on a
+ * loopback port, for driving the real WSManager without the network.
+ *
+ * It sends the configured greeting frames to every new connection, then records
+ * and echoes every frame it receives. Tests can drop all connections (as a server
+ * restart or a NAT timeout would) or stall them, which stops reading and so also
+ * stops answering pings, like a half-open connection.
+ *
+ * Runs its own io_context thread; the public methods may be called from any thread.
+ * The certificate is self-signed for "localhost" and 127.0.0.1, made fresh per process.
+ */
+class FakeServer
+{
+public:
+    struct Options
+    {
+        std::vector<std::string> greeting; // Text frames sent after each handshake
+        bool echo = true;
+        std::string subprotocol; // Selected when the client offers it; otherwise none is
+    };
+
+    struct Frame
+    {
+        std::string data;
+        bool binary = false;
+
+        bool operator==(const Frame&) const = default;
+    };
+
+    FakeServer();
+    explicit FakeServer(Options options, uint16_t port = 0);
+    ~FakeServer();
+
+    FakeServer(const FakeServer&) = delete;
+    FakeServer& operator=(const FakeServer&) = delete;
+
+    uint16_t Port() const { return port_; }
+
+    // Closes every open connection without a websocket or TLS close.
+    void DropAll();
+    // While stalled, new and open connections stop reading: no frames, no pongs.
+    void SetStalled(bool stalled);
+
+    // Frames received so far, over all connections, in arrival order.
+    std::vector<std::string> Received() const;
+    std::vector<Frame> ReceivedFrames() const;
+    int Connections() const;
+    int ResumedConnections() const; // Of those, how many resumed a TLS session
+
+    // PEM of the server certificate, for clients to trust.
+    static const std::string& Certificate();
+
+private:
+    class Session;
+
+    boost::asio::io_context ioc_;
+    boost::asio::ssl::context ctx_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    uint16_t port_ = 0;
+    Options options_;
+    bool stalled_ = false; // Server thread
+    std::vector<std::shared_ptr<Session>> sessions_; // Server thread; kept alive while stalled
+
+    mutable std::mutex mutex_;
+    std::vector<Frame> received_;
+    int connections_ = 0;
+    int resumed_ = 0;
+
+    std::thread thread_;
+
+    void Accept();
+    void OnHandshake(bool resumed);
+    void OnFrame(Frame frame);
+};
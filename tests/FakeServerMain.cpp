@@ -0,0 +1,44 @@
+// fake_server [port] [--drop-after ms] [--stall] [--subprotocol name]
+// Runs FakeServer on its own for manual testing. It writes its certificate to
+// fake_server.pem in the working directory for the client to trust.
+#include "FakeServer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    uint16_t port = 9443;
+    int dropAfterMs = 0;
+    bool stall = false;
+    FakeServer::Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--drop-after") == 0 && i + 1 < argc) dropAfterMs = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--stall") == 0) stall = true;
+        else if (std::strcmp(argv[i], "--subprotocol") == 0 && i + 1 < argc) options.subprotocol = argv[++i];
+        else port = static_cast<uint16_t>(std::atoi(argv[i]));
+    }
+
+    options.greeting.push_back(R"({"type":"all_histories","data":{"general":["{\"platform\":\"steam\",\"channel\":\"general\",\"user\":\"bob\",\"text\":\"hi\"}"]}})");
+    FakeServer server(options, port);
+    server.SetStalled(stall);
+    std::ofstream("fake_server.pem") << FakeServer::Certificate();
+    std::printf("listening on 127.0.0.1:%u, certificate in fake_server.pem\n", server.Port());
+    std::fflush(stdout);
+
+    size_t printed = 0;
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(dropAfterMs > 0 ? dropAfterMs : 1000));
+        if (dropAfterMs > 0) server.DropAll();
+
+        const auto received = server.Received();
+        for (; printed < received.size(); ++printed) std::printf("recv %s\n", received[printed].c_str());
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,164 @@
+#include "Check.h"
+#include "HistoryLog.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    ChatMessage Message(const std::string& channel, uint64_t seq)
+    {
+        ChatMessage message;
+        message.seq = seq;
+        message.platform = "Steam";
+        message.channel = channel;
+        message.user = "user" + std::to_string(seq % 7);
+        message.text = "message " + std::to_string(seq);
+        message.highestRank = static_cast<int>(seq % 23) - 1;
+        return message;
+    }
+
+    bool Same(const ChatMessage& a, const ChatMessage& b)
+    {
+        return a.seq == b.seq && a.platform == b.platform && a.channel == b.channel && a.user == b.user
+            && a.text == b.text && a.highestRank == b.highestRank;
+    }
+
+    fs::path LogFile(const fs::path& directory)
+    {
+        for (const auto& entry : fs::directory_iterator(directory))
+        {
+            if (entry.path().extension() == ".gclog") return entry.path();
+        }
+        return {};
+    }
+
+    struct TempDirectory
+    {
+        fs::path path;
+
+        TempDirectory()
+        {
+            std::random_device random;
+            path = fs::temp_directory_path() / ("gc-historylog-" + std::to_string(random()));
+            fs::create_directories(path);
+        }
+        ~TempDirectory()
+        {
+            std::error_code ec;
+            fs::remove_all(path, ec);
+        }
+    };
+
+    void RoundTrip()
+    {
+        TempDirectory dir;
+        {
+            HistoryLog log(dir.path);
+            for (uint64_t seq = 1; seq <= 100; ++seq) CHECK(log.Append(Message("General", seq)));
+            CHECK(log.Append(Message("Trading #1", 1001)));
+
+            // Index built by the first read, then extended by appends.
+            CHECK(log.Count("General") == 100);
+            CHECK(log.Append(Message("General", 101)));
+            CHECK(log.Count("General") == 101);
+            const auto newest = log.ReadBefore("General", 0, 1);
+            CHECK(newest.size() == 1 && Same(newest[0], Message("General", 101)));
+        }
+
+        HistoryLog log(dir.path);
+        auto channels = log.Channels();
+        CHECK(channels.size() == 2);
+        CHECK(log.Count("General") == 101);
+        CHECK(log.Count("Trading #1") == 1);
+        CHECK(log.Count("Missing") == 0);
+        CHECK(log.ReadBefore("Missing", 0, 10).empty());
+
+        // Page backwards through the whole log, each page oldest first.
+        uint64_t expected = 101;
+        for (size_t skip = 0; skip < 101; skip += 30)
+        {
+            const auto page = log.ReadBefore("General", skip, 30);
+            CHECK(!page.empty() && page.size() <= 30);
+            for (size_t i = page.size(); i-- > 0;)
+            {
+                CHECK(Same(page[i], Message("General", expected)));
+                --expected;
+            }
+        }
+        CHECK(expected == 0);
+        CHECK(log.ReadBefore("General", 101, 10).empty());
+
+        const auto other = log.ReadBefore("Trading #1", 0, 10);
+        CHECK(other.size() == 1 && Same(other[0], Message("Trading #1", 1001)));
+
+        CHECK(log.RemoveIf([](const ChatMessage& message) { return message.seq % 2 == 0; }) == 50);
+        CHECK(log.Count("General") == 51);
+        log.Compact(10);
+        CHECK(log.Count("General") == 10);
+        const auto kept = log.ReadBefore("General", 0, 100);
+        CHECK(kept.size() == 10 && Same(kept.front(), Message("General", 83)) && Same(kept.back(), Message("General", 101)));
+    }
+
+    void Corruption()
+    {
+        TempDirectory dir;
+        {
+            HistoryLog log(dir.path);
+            for (uint64_t seq = 1; seq <= 10; ++seq) CHECK(log.Append(Message("General", seq)));
+        }
+
+        // Flip a byte of the newest record's text, as a torn write would leave it.
+        const fs::path file = LogFile(dir.path);
+        CHECK(!file.empty());
+        {
+            std::fstream stream(file, std::ios::binary | std::ios::in | std::ios::out);
+            stream.seekg(-1, std::ios::end);
+            const char last = static_cast<char>(stream.get());
+            stream.seekp(-1, std::ios::end);
+            stream.put(static_cast<char>(last ^ 0x5a));
+        }
+
+        HistoryLog log(dir.path);
+        CHECK(log.Count("General") == 9);
+        auto page = log.ReadBefore("General", 0, 100);
+        CHECK(page.size() == 9 && Same(page.back(), Message("General", 9)));
+
+        // Appends behind the damage stay unreadable until Compact drops it.
+        CHECK(log.Append(Message("General", 11)));
+        CHECK(log.Count("General") == 9);
+        log.Compact(100);
+        CHECK(log.Count("General") == 9);
+
+        CHECK(log.Append(Message("General", 12)));
+        CHECK(log.Count("General") == 10);
+        page = log.ReadBefore("General", 0, 2);
+        CHECK(page.size() == 2 && Same(page[0], Message("General", 9)) && Same(page[1], Message("General", 12)));
+
+        // A file truncated under a cached index reads as empty once, then is parsed again.
+        const auto size = fs::file_size(file);
+        fs::resize_file(file, size - 3);
+        CHECK(log.ReadBefore("General", 0, 100).empty());
+        CHECK(log.Count("General") == 9);
+
+        // A log without a valid header is unreadable and removed by Compact.
+        {
+            std::ofstream garbage(dir.path / "junk-00000000.gclog", std::ios::binary);
+            garbage << "not a log";
+        }
+        log.Compact(100);
+        CHECK(!fs::exists(dir.path / "junk-00000000.gclog"));
+        CHECK(log.Channels().size() == 1);
+    }
+}
+
+int main()
+{
+    RoundTrip();
+    Corruption();
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "Check.h"
+#include "ChatMetrics.h"
+#include "logging.h"
+
+#include <string>
+#include <vector>
+
+std::shared_ptr<CVarManagerWrapper> _globalCvarManager;
+
+namespace
+{
+    constexpr size_t RATE_LIMIT_PER_WINDOW = 20; // logging.cpp
+
+    std::vector<std::string> Flush()
+    {
+        _globalCvarManager->lines.clear();
+        FlushLog();
+        return _globalCvarManager->lines;
+    }
+
+    // globalchat_metrics prints more lines from one call site than the rate limit lets through.
+    void MetricsDumpComesThroughWhole()
+    {
+        const std::vector<std::string> dump = GetMetrics().Describe();
+        CHECK(dump.size() > RATE_LIMIT_PER_WINDOW);
+
+        for (const auto& line : dump)
+        {
+            CONSOLELOG("[metrics] {}", line);
+        }
+
+        const std::vector<std::string> printed = Flush();
+        CHECK(printed.size() == dump.size());
+        for (size_t i = 0; i < dump.size(); ++i)
+        {
+            CHECK(printed[i] == "[metrics] " + dump[i]);
+        }
+    }
+
+    void ChattyCallSiteIsStillLimited()
+    {
+        for (int i = 0; i < 26; ++i)
+        {
+            LOG("line {}", i);
+        }
+
+        const std::vector<std::string> printed = Flush();
+        CHECK(printed.size() == RATE_LIMIT_PER_WINDOW);
+        CHECK(printed.front() == "line 0");
+        CHECK(printed.back() == "line 19");
+    }
+}
+
+int main()
+{
+    _globalCvarManager = std::make_shared<CVarManagerWrapper>();
+
+    MetricsDumpComesThroughWhole();
+    ChattyCallSiteIsStillLimited();
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "Check.h"
+#include "Outbox.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace std::chrono_literals;
+
+    Outbox::Serializer Frame(const std::string& name)
+    {
+        return [name](std::string_view protocol) { return std::string(protocol) + ":" + name; };
+    }
+
+    // What WSManager does once connected: drop what is too old, then write front to back.
+    std::vector<std::string> Flush(Outbox& outbox, std::string_view protocol, Outbox::Clock::time_point now)
+    {
+        std::vector<std::string> written;
+        outbox.DropStale(now);
+        while (!outbox.Empty())
+        {
+            written.push_back(outbox.Front(protocol, false).data);
+            outbox.PopFront();
+        }
+        return written;
+    }
+
+    // Filled while disconnected: kept in order, and refused past MAX_FRAMES.
+    void FlushesInOrderAfterReconnect()
+    {
+        Outbox outbox;
+        const auto start = Outbox::Clock::now();
+        for (size_t i = 0; i < Outbox::MAX_FRAMES; ++i)
+        {
+            CHECK(outbox.Reserve());
+            outbox.Push(Frame(std::to_string(i)), {}, start + std::chrono::milliseconds(i));
+        }
+        CHECK(!outbox.Reserve());
+        CHECK(outbox.Size() == Outbox::MAX_FRAMES);
+
+        // The first write fails with its connection; the frame is rebuilt for the next one.
+        CHECK(outbox.Front("json", false).data == "json:0");
+        outbox.ResetFront();
+
+        const auto written = Flush(outbox, "msgpack", start + 1s);
+        CHECK(written.size() == Outbox::MAX_FRAMES);
+        for (size_t i = 0; i < written.size(); ++i) CHECK(written[i] == "msgpack:" + std::to_string(i));
+
+        // Written frames give their slots back.
+        CHECK(outbox.Reserve());
+    }
+
+    void DropsFramesPastMaxAge()
+    {
+        Outbox outbox;
+        const auto start = Outbox::Clock::now();
+        for (int i = 0; i < 3; ++i)
+        {
+            CHECK(outbox.Reserve());
+            outbox.Push(Frame("old" + std::to_string(i)), {}, start);
+        }
+        CHECK(outbox.Reserve());
+        outbox.Push(Frame("new"), {}, start + Outbox::MAX_AGE);
+
+        // Exactly MAX_AGE old is still sent.
+        CHECK(outbox.DropStale(start + Outbox::MAX_AGE) == 0);
+        const auto written = Flush(outbox, "json", start + Outbox::MAX_AGE + 1ms);
+        CHECK(written.size() == 1 && written[0] == "json:new");
+
+        // Dropped frames give their slots back too.
+        for (size_t i = 0; i < Outbox::MAX_FRAMES; ++i) CHECK(outbox.Reserve());
+        CHECK(!outbox.Reserve());
+        outbox.Clear();
+        CHECK(outbox.Reserve());
+    }
+
+    // A frame with the key of a queued one replaces it in place, keeping its place and age.
+    void CoalescesByKey()
+    {
+        Outbox outbox;
+        const auto start = Outbox::Clock::now();
+        bool writing = false;
+        auto push = [&](const std::string& name, const std::string& key, Outbox::Clock::time_point now) {
+            Outbox::Serializer serialize = Frame(name);
+            if (outbox.Coalesce(key, serialize, writing)) return true;
+            CHECK(outbox.Reserve());
+            outbox.Push(std::move(serialize), key, now);
+            return false;
+        };
+
+        CHECK(!push("typing a 1", "typing:a", start));
+        CHECK(!push("chat", "", start));
+        CHECK(!push("typing b 1", "typing:b", start));
+        for (int i = 2; i <= 50; ++i) CHECK(push("typing a " + std::to_string(i), "typing:a", start + 1s));
+        CHECK(!push("chat", "", start)); // Plain frames never merge
+        CHECK(outbox.Size() == 4);
+
+        // The merged frame keeps the first one's age, so it goes stale on the first one's clock.
+        CHECK(outbox.DropStale(start + Outbox::MAX_AGE + 1ms) == 4);
+
+        CHECK(!push("typing a 1", "typing:a", start));
+        CHECK(!push("typing b 1", "typing:b", start));
+
+        // The front is being written; an update for it queues behind instead of changing it.
+        CHECK(outbox.Front("json", false).data == "json:typing a 1");
+        writing = true;
+        Outbox::Serializer update = Frame("typing a 2");
+        CHECK(!outbox.Coalesce("typing:a", update, writing));
+        CHECK(update); // Left for the caller to queue
+        CHECK(outbox.Reserve());
+        outbox.Push(std::move(update), "typing:a", start);
+        CHECK(push("typing a 3", "typing:a", start));
+        writing = false;
+
+        const auto written = Flush(outbox, "json", start);
+        CHECK((written == std::vector<std::string>{ "json:typing a 1", "json:typing b 1", "json:typing a 3" }));
+    }
+}
+
+int main()
+{
+    FlushesInOrderAfterReconnect();
+    DropsFramesPastMaxAge();
+    CoalescesByKey();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "Check.h"
+#include "TokenBucket.h"
+
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    using namespace std::chrono_literals;
+    using Clock = TokenBucket::Clock;
+
+    void AcquiresUpToBurstThenRefills()
+    {
+        const auto start = Clock::now();
+        TokenBucket bucket(2.0, 3); // A token every 500 ms
+        CHECK(bucket.Available(start) == 3);
+        CHECK(bucket.TimeUntilNext(start) == Clock::duration::zero());
+
+        CHECK(bucket.TryAcquire(1, start));
+        CHECK(bucket.TryAcquire(2, start));
+        CHECK(!bucket.TryAcquire(1, start));
+        CHECK(bucket.Available(start) == 0);
+        CHECK(bucket.TimeUntilNext(start) == 500ms);
+        CHECK(bucket.TimeUntilNext(start + 200ms) == 300ms);
+
+        CHECK(!bucket.TryAcquire(1, start + 499ms));
+        CHECK(bucket.TryAcquire(1, start + 500ms));
+        CHECK(!bucket.TryAcquire(1, start + 500ms));
+
+        // Idle time refills, but never past the burst.
+        CHECK(bucket.Available(start + 1h) == 3);
+        CHECK(!bucket.TryAcquire(4, start + 1h));
+        CHECK(bucket.TryAcquire(3, start + 1h));
+    }
+
+    void KeepingLeavesTheReserve()
+    {
+        const auto start = Clock::now();
+        TokenBucket bucket(1.0, 2);
+        CHECK(bucket.TryAcquireKeeping(1, start));
+        CHECK(!bucket.TryAcquireKeeping(1, start)); // The last token is kept
+        CHECK(bucket.TimeUntilNext(start) == Clock::duration::zero());
+        CHECK(bucket.TryAcquire(1, start));
+
+        // With a burst of one there is never a token to spare.
+        TokenBucket single(1.0, 1);
+        CHECK(!single.TryAcquireKeeping(1, start + 1h));
+        CHECK(single.TryAcquire(1, start + 1h));
+    }
+
+    void ConfigureClampsServerValues()
+    {
+        const auto start = Clock::now();
+        TokenBucket bucket(1.0, 1);
+
+        // Rates outside [MIN_RATE, MAX_RATE], NaN included, end up at the nearest bound.
+        bucket.Configure(std::numeric_limits<double>::quiet_NaN(), 1);
+        CHECK(bucket.TryAcquire(1, start));
+        CHECK(bucket.TimeUntilNext(start) == 100s); // 1 / MIN_RATE
+
+        bucket.Configure(-5.0, 1);
+        CHECK(bucket.TimeUntilNext(start) > 0s);
+
+        bucket.Configure(1e12, std::numeric_limits<uint32_t>::max());
+        CHECK(bucket.Available(start + 1h) == TokenBucket::MAX_BURST);
+        CHECK(bucket.TryAcquire(TokenBucket::MAX_BURST, start + 1h));
+        CHECK(!bucket.TryAcquire(1, start + 1h));
+        CHECK(bucket.TimeUntilNext(start + 1h) == 1ms); // 1 / MAX_RATE
+
+        // A burst of zero still allows one frame at a time, and a cost past the burst never passes.
+        bucket.Configure(1.0, 0);
+        CHECK(bucket.TryAcquire(1, start + 2h));
+        CHECK(!bucket.TryAcquire(std::numeric_limits<uint32_t>::max(), start + 3h));
+        CHECK(bucket.TryAcquire(1, start + 3h));
+    }
+}
+
+int main()
+{
+    AcquiresUpToBurstThenRefills();
+    KeepingLeavesTheReserve();
+    ConfigureClampsServerValues();
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "Check.h"
+#include "TypingTracker.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace std::chrono_literals;
+    using Clock = TypingTracker::Clock;
+
+    std::vector<std::string> Typists(const TypingTracker& typists, std::string_view channel)
+    {
+        std::vector<std::string> names;
+        typists.ForEach(channel, [&](std::string_view platform, std::string_view user) {
+            names.push_back(std::string(platform) + "/" + std::string(user));
+            return true;
+        });
+        return names;
+    }
+
+    void ExpiresAfterTtl()
+    {
+        const auto start = Clock::now();
+        TypingTracker typists(start);
+        typists.Start("general", "steam", "alice", start);
+        typists.Start("general", "epic", "bob", start + 1s);
+        typists.Start("trading", "steam", "alice", start + 1s);
+        CHECK(typists.Size() == 3);
+        CHECK(typists.Count("general") == 2);
+        CHECK((Typists(typists, "general") == std::vector<std::string>{ "epic/bob", "steam/alice" }));
+
+        // Nothing is due before TTL; alice's entry goes within a tick of it.
+        CHECK(typists.Expire(start + TypingTracker::TTL - TypingTracker::TICK) == 0);
+        CHECK(typists.Expire(start + TypingTracker::TTL + TypingTracker::TICK) == 1);
+        CHECK((Typists(typists, "general") == std::vector<std::string>{ "epic/bob" }));
+        CHECK(typists.Count("trading") == 1);
+
+        CHECK(typists.Expire(start + 1s + TypingTracker::TTL + TypingTracker::TICK) == 2);
+        CHECK(typists.Size() == 0 && typists.Count("general") == 0);
+    }
+
+    void RefreshAndStop()
+    {
+        const auto start = Clock::now();
+        TypingTracker typists(start);
+        typists.Start("general", "steam", "alice", start);
+        typists.Start("general", "epic", "bob", start);
+
+        // A refresh moves the deadline, and does not add a second entry.
+        typists.Start("general", "steam", "alice", start + 5s);
+        CHECK(typists.Size() == 2);
+        CHECK(typists.Expire(start + TypingTracker::TTL + TypingTracker::TICK) == 1);
+        CHECK((Typists(typists, "general") == std::vector<std::string>{ "steam/alice" }));
+
+        CHECK(typists.Stop("general", "steam", "alice"));
+        CHECK(!typists.Stop("general", "steam", "alice"));
+        CHECK(!typists.Stop("general", "epic", "carol"));
+        CHECK(typists.Size() == 0);
+
+        // Freed slots are reused, and a stopped entry never expires later.
+        typists.Start("general", "epic", "carol", start + 6s);
+        CHECK(typists.Expire(start + 5s + TypingTracker::TTL + TypingTracker::TICK) == 0);
+        CHECK(typists.Count("general") == 1);
+    }
+
+    void LongGapSweepsEverything()
+    {
+        const auto start = Clock::now();
+        TypingTracker typists(start);
+        for (int i = 0; i < 100; ++i)
+        {
+            typists.Start("channel" + std::to_string(i % 4), "steam", "user" + std::to_string(i),
+                start + std::chrono::milliseconds(i * 50));
+        }
+        CHECK(typists.Size() == 100);
+
+        // Far past one lap of the wheel: one sweep frees them all, and the wheel keeps working.
+        const auto later = start + 1h;
+        CHECK(typists.Expire(later) == 100);
+        typists.Start("channel0", "steam", "late", later);
+        CHECK(typists.Expire(later + TypingTracker::TTL - TypingTracker::TICK) == 0);
+        CHECK(typists.Expire(later + TypingTracker::TTL + TypingTracker::TICK) == 1);
+
+        typists.Start("channel0", "steam", "again", later + 1min);
+        typists.Clear();
+        CHECK(typists.Size() == 0 && typists.Count("channel0") == 0);
+    }
+}
+
+int main()
+{
+    ExpiresAfterTtl();
+    RefreshAndStop();
+    LongGapSweepsEverything();
+    return 0;
+}
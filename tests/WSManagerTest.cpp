@@ -0,0 +1,218 @@
+// Drives the real WSManager against FakeServer over loopback TLS.
+//   WSManagerTest                 connection, echo, reconnect, coalescing, subprotocols
+//   WSManagerTest ping-timeout    a server that stops answering pings (takes ~30 s)
+#include "Check.h"
+#include "FakeServer.h"
+#include "WSManager.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using namespace std::chrono_literals;
+
+    // Collects what WSManager reports on its network thread.
+    struct Client
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        int connects = 0;
+        int disconnects = 0;
+        std::vector<std::string> messages;
+        std::vector<std::string> errors;
+        bool resumed = false;
+        WSManager ws;
+
+        void Connect(const FakeServer& server)
+        {
+            WSManager::Callbacks callbacks;
+            callbacks.on_connect = [this] {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++connects;
+                resumed = ws.GetConnectTiming().tls_session_resumed;
+                changed.notify_all();
+            };
+            callbacks.on_disconnect = [this] {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++disconnects;
+                changed.notify_all();
+            };
+            callbacks.on_message = [this](std::string_view message, bool) {
+                std::lock_guard<std::mutex> lock(mutex);
+                messages.emplace_back(message);
+                changed.notify_all();
+            };
+            callbacks.on_error = [this](std::string_view error) {
+                std::lock_guard<std::mutex> lock(mutex);
+                errors.emplace_back(error);
+                changed.notify_all();
+            };
+            ws.Connect("127.0.0.1", std::to_string(server.Port()), "/", nullptr, std::move(callbacks));
+        }
+
+        bool WaitFor(const std::function<bool()>& done, std::chrono::seconds timeout = 10s)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            return changed.wait_for(lock, timeout, done);
+        }
+    };
+
+    bool WaitFor(const std::function<bool()>& done, std::chrono::seconds timeout = 10s)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!done())
+        {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(10ms);
+        }
+        return true;
+    }
+
+    void ConnectsAndEchoes()
+    {
+        FakeServer::Options options;
+        options.greeting.push_back(R"({"type":"all_histories","data":{}})");
+        FakeServer server(options);
+        Client client;
+        client.Connect(server);
+        CHECK(client.WaitFor([&] { return client.connects == 1 && client.messages.size() == 1; }));
+        CHECK(client.messages[0] == R"({"type":"all_histories","data":{}})");
+
+        CHECK(client.ws.Send(std::string("hello")));
+        CHECK(client.WaitFor([&] { return client.messages.size() == 2; }));
+        CHECK(client.messages[1] == "hello");
+        CHECK(server.Received() == std::vector<std::string>{ "hello" });
+        client.ws.Disconnect();
+    }
+
+    // Frames sent while the connection is down go out in order on the next one, which
+    // resumes the TLS session of the last.
+    void QueuedFramesSurviveReconnect()
+    {
+        FakeServer server;
+        Client client;
+        client.Connect(server);
+        CHECK(client.WaitFor([&] { return client.connects == 1; }));
+
+        server.DropAll();
+        CHECK(client.WaitFor([&] { return client.disconnects == 1; }));
+        for (const char* frame : { "one", "two", "three" }) CHECK(client.ws.Send(std::string(frame)));
+
+        CHECK(client.WaitFor([&] { return client.connects == 2 && client.messages.size() == 3; }));
+        CHECK((server.Received() == std::vector<std::string>{ "one", "two", "three" }));
+        CHECK(server.Connections() == 2);
+        CHECK(server.ResumedConnections() == 1);
+        CHECK(client.resumed);
+        client.ws.Disconnect();
+    }
+
+    // Updates queued before the connection is up collapse to the latest per key; plain
+    // frames are all kept, in order.
+    void CoalescesQueuedUpdates()
+    {
+        FakeServer::Options options;
+        options.echo = false;
+        FakeServer server(options);
+        Client client;
+        client.Connect(server);
+        for (int i = 0; i < 300; ++i)
+        {
+            const std::string key = "typing:c" + std::to_string(i % 3);
+            CHECK(client.ws.SendCoalesced(key, [key, i](std::string_view) { return key + "=" + std::to_string(i); }));
+            if (i % 30 == 0) CHECK(client.ws.Send("plain " + std::to_string(i)));
+        }
+
+        const auto last = [&](const std::string& key) {
+            const auto received = server.Received();
+            for (auto it = received.rbegin(); it != received.rend(); ++it)
+            {
+                if (it->starts_with(key + "=")) return *it;
+            }
+            return std::string();
+        };
+        CHECK(WaitFor([&] { return last("typing:c0") == "typing:c0=297" && last("typing:c1") == "typing:c1=298" && last("typing:c2") == "typing:c2=299"; }));
+
+        const auto received = server.Received();
+        std::vector<std::string> plain;
+        size_t typing = 0;
+        for (const auto& frame : received)
+        {
+            if (frame.starts_with("plain ")) plain.push_back(frame);
+            else ++typing;
+        }
+        CHECK(plain.size() == 10 && plain.front() == "plain 0" && plain.back() == "plain 270");
+        CHECK(typing < 300);
+        client.ws.Disconnect();
+    }
+
+    // The server picks one of the offered subprotocols, and frames are built for it and sent
+    // binary when it is a binary one.
+    void NegotiatesSubprotocol()
+    {
+        FakeServer::Options options;
+        options.subprotocol = "globalchat.msgpack.v1";
+        FakeServer server(options);
+        Client client;
+        client.ws.SetSubprotocols({ { "globalchat.json.v1", false }, { "globalchat.msgpack.v1", true } });
+        client.Connect(server);
+        CHECK(client.WaitFor([&] { return client.connects == 1; }));
+
+        CHECK(client.ws.Send([](std::string_view protocol) { return "built for " + std::string(protocol); }));
+        CHECK(WaitFor([&] { return server.ReceivedFrames().size() == 1; }));
+        CHECK((server.ReceivedFrames()[0] == FakeServer::Frame{ "built for globalchat.msgpack.v1", true }));
+        client.ws.Disconnect();
+
+        // Nothing offered that it takes: no subprotocol, text frames.
+        FakeServer plain;
+        Client other;
+        other.ws.SetSubprotocols({ { "globalchat.msgpack.v1", true } });
+        other.Connect(plain);
+        CHECK(other.WaitFor([&] { return other.connects == 1; }));
+        CHECK(other.ws.Send([](std::string_view protocol) { return "built for " + std::string(protocol); }));
+        CHECK(WaitFor([&] { return plain.ReceivedFrames().size() == 1; }));
+        CHECK((plain.ReceivedFrames()[0] == FakeServer::Frame{ "built for ", false }));
+        other.ws.Disconnect();
+    }
+
+    // A connection that stops answering pings is given up one ping interval after the
+    // unanswered ping, and the next connection is made.
+    void PingTimeoutReconnects()
+    {
+        FakeServer server;
+        server.SetStalled(true);
+        Client client;
+        client.Connect(server);
+        CHECK(client.WaitFor([&] { return client.connects == 1; }));
+
+        const auto connected = std::chrono::steady_clock::now();
+        CHECK(client.WaitFor([&] { return client.disconnects == 1; }, 45s));
+        const auto elapsed = std::chrono::steady_clock::now() - connected;
+        CHECK(elapsed > 25s && elapsed < 40s); // Two ping intervals: the ping, then its deadline
+        CHECK(client.errors.size() == 1 && client.errors[0].find("ping") != std::string::npos);
+
+        server.SetStalled(false);
+        CHECK(client.WaitFor([&] { return client.connects == 2; }));
+        client.ws.Disconnect();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::strcmp(argv[1], "ping-timeout") == 0)
+    {
+        PingTimeoutReconnects();
+        return 0;
+    }
+
+    ConnectsAndEchoes();
+    QueuedFramesSurviveReconnect();
+    CoalescesQueuedUpdates();
+    NegotiatesSubprotocol();
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Counts heap allocations per decoded chat message. Replacing operator new is fine in
+// this executable of its own; the plugin leaves it alone (see Benchmarks.cpp).
+#include "Check.h"
+#include "WireFormat.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace
+{
+    size_t allocationCount = 0;
+
+    void* Allocate(std::size_t size)
+    {
+        ++allocationCount;
+        return std::malloc(size ? size : 1);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = Allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace
+{
+    std::vector<ChatMessage> MakeMessages(size_t count)
+    {
+        std::vector<ChatMessage> messages(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ChatMessage& message = messages[i];
+            message.seq = i + 1;
+            message.platform = i % 3 ? "steam" : "epic";
+            message.channel = "general";
+            message.user = "Player" + std::to_string(i * 7919 % 2000);
+            message.text = "anyone want to queue 2s ranked, champ or above, message " + std::to_string(i);
+            message.highestRank = static_cast<int>(i % 23);
+        }
+        return messages;
+    }
+
+    template <typename Decode>
+    double AllocationsPerMessage(const std::vector<std::string>& frames, Decode decode)
+    {
+        const size_t before = allocationCount;
+        for (const auto& frame : frames) decode(frame);
+        return static_cast<double>(allocationCount - before) / static_cast<double>(frames.size());
+    }
+}
+
+int main()
+{
+    const auto messages = MakeMessages(1000);
+    for (const bool binary : { false, true })
+    {
+        const auto protocol = binary ? WireFormat::MSGPACK_PROTOCOL : WireFormat::JSON_PROTOCOL;
+        std::vector<std::string> frames;
+        for (const auto& message : messages)
+        {
+            frames.push_back(WireFormat::Encode({
+                {"platform", message.platform},
+                {"channel", message.channel},
+                {"highest_rank", message.highestRank},
+                {"user", message.user},
+                {"text", message.text},
+                {"seq", message.seq},
+                {"client_id", "c-" + std::to_string(message.seq)},
+            }, protocol));
+        }
+
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            ChatMessage decoded;
+            std::string clientId;
+            CHECK(WireFormat::DecodeChatMessage(frames[i], binary, decoded, clientId));
+            CHECK(decoded.seq == messages[i].seq && decoded.platform == messages[i].platform
+                && decoded.channel == messages[i].channel && decoded.user == messages[i].user
+                && decoded.text == messages[i].text && decoded.highestRank == messages[i].highestRank);
+            CHECK(clientId == "c-" + std::to_string(messages[i].seq));
+        }
+
+        const double dom = AllocationsPerMessage(frames, [binary](const std::string& frame) {
+            return WireFormat::ParseChatMessage(WireFormat::Decode(frame, binary)).text.size();
+        });
+        const double singlePass = AllocationsPerMessage(frames, [binary](const std::string& frame) {
+            ChatMessage message;
+            std::string clientId;
+            return WireFormat::DecodeChatMessage(frame, binary, message, clientId);
+        });
+        std::printf("%-8s dom %.2f allocs/msg, single-pass %.2f allocs/msg\n", binary ? "msgpack" : "json", dom, singlePass);
+
+        // The point of the single-pass decoder: no DOM nodes, only the fields it keeps.
+        CHECK(singlePass * 2 < dom);
+    }
+    return 0;
+}
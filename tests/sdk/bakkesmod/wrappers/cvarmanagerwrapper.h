@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Stand-in for the SDK's console wrapper: keeps what the plugin prints so a test can inspect it.
+class CVarManagerWrapper
+{
+public:
+    std::vector<std::string> lines;
+
+    void log(const std::string& text) { lines.push_back(text); }
+    void log(const std::wstring& text) { lines.emplace_back(text.begin(), text.end()); }
+};
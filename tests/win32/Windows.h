@@ -0,0 +1,18 @@
+#pragma once
+// Stand-in for the few Win32 calls WSManager makes, so it builds and runs against FakeServer
+// elsewhere. The only resource is the PEM bundle, and it holds FakeServer's certificate.
+#include "FakeServer.h"
+
+#include <string>
+
+using HMODULE = void*;
+using HRSRC = const std::string*;
+using HGLOBAL = const std::string*;
+using DWORD = unsigned long;
+
+#define MAKEINTRESOURCE(id) (reinterpret_cast<const wchar_t*>(static_cast<uintptr_t>(id)))
+
+inline HRSRC FindResource(HMODULE, const wchar_t*, const wchar_t*) { return &FakeServer::Certificate(); }
+inline HGLOBAL LoadResource(HMODULE, HRSRC resource) { return resource; }
+inline void* LockResource(HGLOBAL resource) { return const_cast<char*>(resource->data()); }
+inline DWORD SizeofResource(HMODULE, HRSRC resource) { return static_cast<DWORD>(resource->size()); }